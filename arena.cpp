@@ -0,0 +1,24 @@
+#include "arena.h"
+#include <algorithm>
+
+using namespace std;
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    // Blocks double up to MAX_BLOCK; anything larger gets a block of its own
+    const size_t blockSize = max(m_next_block, size + align);
+    m_next_block = min(m_next_block * 2, MAX_BLOCK);
+
+    m_blocks.emplace_back(new char[blockSize]);
+    m_cursor = m_blocks.back().get();
+    m_end = m_cursor + blockSize;
+    m_reserved += blockSize;
+    return allocate(size, align);
+}
+
+QStringView Arena::copy(QStringView text) {
+    if (text.isEmpty()) return QStringView();
+    const size_t bytes = sizeof(QChar) * size_t(text.size());
+    QChar* data = static_cast<QChar*>(allocate(bytes, alignof(QChar)));
+    memcpy(static_cast<void*>(data), text.data(), bytes);
+    return QStringView(data, text.size());
+}
@@ -0,0 +1,105 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QString>
+#include <QStringView>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Bump allocator for everything one compilation builds: allocating is a pointer
+// increment and destroying the arena frees all of it at once. Destructors never
+// run, so only trivially destructible objects may live here (make() checks).
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(m_cursor) + align - 1) & ~uintptr_t(align - 1);
+        if (p + size > reinterpret_cast<uintptr_t>(m_end)) return allocateSlow(size, align);
+        m_cursor = reinterpret_cast<char*>(p + size);
+        m_used += size;
+        return reinterpret_cast<void*>(p);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        m_objects++;
+        return ::new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Copies text into the arena; the view lives as long as the arena
+    QStringView copy(QStringView text);
+
+    int objects() const { return m_objects; }      // Made with make()
+    size_t bytesUsed() const { return m_used; }    // Handed out, including lists and text
+    size_t bytesReserved() const { return m_reserved; }
+
+private:
+    static constexpr size_t FIRST_BLOCK = 16 * 1024;
+    static constexpr size_t MAX_BLOCK = 1024 * 1024;
+
+    vector<unique_ptr<char[]>> m_blocks;
+    char* m_cursor = nullptr;
+    char* m_end = nullptr;
+    size_t m_next_block = FIRST_BLOCK;
+    size_t m_used = 0;
+    size_t m_reserved = 0;
+    int m_objects = 0;
+
+    void* allocateSlow(size_t size, size_t align);
+};
+
+// Growable array inside an Arena, for child lists. Growing copies into a larger
+// run and leaves the old one behind; lists are short and built once.
+template <typename T>
+class ArenaVector {
+    static_assert(is_trivially_copyable<T>::value && is_trivially_destructible<T>::value,
+                  "ArenaVector elements are moved with memcpy and never destroyed");
+
+public:
+    explicit ArenaVector(Arena& arena) : m_arena(&arena) {}
+
+    void push_back(const T& value) {
+        if (m_size == m_capacity) grow();
+        m_data[m_size++] = value;
+    }
+
+    // Keeps the run, so refilling up to the old size allocates nothing
+    void clear() { m_size = 0; }
+
+    int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    T& operator[](int index) { return m_data[index]; }
+    const T& operator[](int index) const { return m_data[index]; }
+    T* begin() { return m_data; }
+    T* end() { return m_data + m_size; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+
+private:
+    Arena* m_arena;
+    T* m_data = nullptr;
+    int m_size = 0;
+    int m_capacity = 0;
+
+    void grow() {
+        const int capacity = m_capacity ? m_capacity * 2 : 4;
+        T* data = static_cast<T*>(m_arena->allocate(sizeof(T) * capacity, alignof(T)));
+        if (m_size) memcpy(data, m_data, sizeof(T) * m_size);
+        m_data = data;
+        m_capacity = capacity;
+    }
+};
+
+#endif // ARENA_H
@@ -1,172 +1,362 @@
 #ifndef AST_H
 #define AST_H
 
+#include "arena.h"
+#include "symbol_table.h"
 #include "token.h"
 #include "types.h"
+#include <cstdint>
 #include <memory>
-#include <vector>
+#include <type_traits>
 #include <QString>
-#include <utility>
+#include <QStringView>
 
 using namespace std;
 
+// One per concrete node type below
+enum class NodeKind : uint8_t {
+    PROGRAM, NUMBER, STRING, IDENTIFIER, NONE, UNARY_OP, BINARY_OP, ASSIGNMENT,
+    PRINT, RETURN, FUNCTION_CALL, BLOCK, IF, WHILE, FUNCTION_DEF, TRY_EXCEPT, FOR,
+    SYNTAX_ERROR
+};
+
+// Every node below the ProgramNode lives in the program's Arena: children are
+// plain pointers, lists are ArenaVectors and text is copied into the arena, so
+// nodes are trivially destructible and the tree is freed in one go.
 struct ASTNode {
+    const NodeKind kind; // Passes dispatch on this (see visitNode below), not on RTTI
     DataType determined_type = DataType::UNDEFINED;
-    virtual ~ASTNode() = default;
+    explicit ASTNode(NodeKind k) : kind(k) {}
     virtual QString getNodeName() const = 0;
     // New: Helper to get line number for error reporting
     virtual int getLine() const { return 0; }
+
+protected:
+    ~ASTNode() = default; // Never deleted through a base pointer
 };
 
 
 // A Python script is just a list of statements executed one after another. This node holds that list.
-struct ProgramNode : ASTNode {
-    vector<unique_ptr<ASTNode>> statements;
+// It is the one heap-allocated node and owns the arena the rest of the tree lives in.
+struct ProgramNode final : ASTNode {
+    static constexpr NodeKind KIND = NodeKind::PROGRAM;
+    Arena arena;
+    ArenaVector<ASTNode*> statements{arena};
+    ProgramNode() : ASTNode(KIND) {}
     QString getNodeName() const override { return "Program"; }
 };
 
+// Leaf nodes keep the line and the text the parser materialized from the source
+// span, so the tree depends on neither the source buffer nor the tokens.
 struct NumberNode : ASTNode {
-    Token token;
-    explicit NumberNode(Token t) : token(std::move(t)) {}
-    QString getNodeName() const override { return "Num: " + token.value; }
-    int getLine() const override { return token.line; }
+    static constexpr NodeKind KIND = NodeKind::NUMBER;
+    int line;
+    QStringView value; // In the arena
+    NumberNode(int ln, QStringView v) : ASTNode(KIND), line(ln), value(v) {}
+    QString getNodeName() const override { return "Num: " + value.toString(); }
+    int getLine() const override { return line; }
 };
 
 struct StringNode : ASTNode {
-    Token token;
-    explicit StringNode(Token t) : token(std::move(t)) {}
-    QString getNodeName() const override { return "Str: \"" + token.value + "\""; }
-    int getLine() const override { return token.line; }
+    static constexpr NodeKind KIND = NodeKind::STRING;
+    int line;
+    QStringView value; // In the arena
+    StringNode(int ln, QStringView v) : ASTNode(KIND), line(ln), value(v) {}
+    QString getNodeName() const override { return "Str: \"" + value.toString() + "\""; }
+    int getLine() const override { return line; }
 };
 
+// Names are compared by their interned SymbolId; value() is only for display and output.
+// binding is what the name resolved to in the SemanticAnalyzer's SymbolTable, for
+// the nodes its last analysis reached.
 struct IdentifierNode : ASTNode {
-    Token token;
-    explicit IdentifierNode(Token t) : token(std::move(t)) {}
-    QString getNodeName() const override { return "ID: " + token.value; }
-    int getLine() const override { return token.line; }
+    static constexpr NodeKind KIND = NodeKind::IDENTIFIER;
+    int line;
+    SymbolId symbol;
+    BindingId binding = NO_BINDING;
+    explicit IdentifierNode(const Token& t) : ASTNode(KIND), line(t.line), symbol(t.symbol) {}
+    const QString& value() const { return Interner::global().name(symbol); }
+    QString getNodeName() const override { return "ID: " + value(); }
+    int getLine() const override { return line; }
 };
 
 struct NoneNode : ASTNode {
+    static constexpr NodeKind KIND = NodeKind::NONE;
+    NoneNode() : ASTNode(KIND) {}
     QString getNodeName() const override { return "None"; }
 };
 
 struct UnaryOpNode : ASTNode {
-    Token op;
-    unique_ptr<ASTNode> right;
-    UnaryOpNode(Token o, unique_ptr<ASTNode> r) : op(std::move(o)), right(std::move(r)) {}
-    QString getNodeName() const override { return "Unary Op: " + op.value; }
-    int getLine() const override { return op.line; }
+    static constexpr NodeKind KIND = NodeKind::UNARY_OP;
+    TokenType op;
+    int line;
+    QStringView op_value;
+    ASTNode* right;
+    UnaryOpNode(const Token& o, QStringView ov, ASTNode* r) : ASTNode(KIND), op(o.type), line(o.line), op_value(ov), right(r) {}
+    QString getNodeName() const override { return "Unary Op: " + op_value.toString(); }
+    int getLine() const override { return line; }
 };
 
 struct BinaryOpNode : ASTNode {
-    unique_ptr<ASTNode> left;
-    Token op;
-    unique_ptr<ASTNode> right;
-    BinaryOpNode(unique_ptr<ASTNode> l, Token o, unique_ptr<ASTNode> r)
-        : left(std::move(l)), op(std::move(o)), right(std::move(r)) {}
-    QString getNodeName() const override { return "Bin Op: " + op.value; }
-    int getLine() const override { return op.line; }
+    static constexpr NodeKind KIND = NodeKind::BINARY_OP;
+    ASTNode* left;
+    TokenType op;
+    int line;
+    QStringView op_value; // operatorSpelling(op), not copied into the arena
+    ASTNode* right;
+    BinaryOpNode(ASTNode* l, const Token& o, QStringView ov, ASTNode* r)
+        : ASTNode(KIND), left(l), op(o.type), line(o.line), op_value(ov), right(r) {}
+    QString getNodeName() const override { return "Bin Op: " + op_value.toString(); }
+    int getLine() const override { return line; }
 };
 
 struct AssignmentNode : ASTNode {
-    unique_ptr<IdentifierNode> identifier;
-    unique_ptr<ASTNode> expression;
-    AssignmentNode(unique_ptr<IdentifierNode> id, unique_ptr<ASTNode> expr)
-        : identifier(std::move(id)), expression(std::move(expr)) {}
+    static constexpr NodeKind KIND = NodeKind::ASSIGNMENT;
+    IdentifierNode* identifier;
+    ASTNode* expression;
+    AssignmentNode(IdentifierNode* id, ASTNode* expr)
+        : ASTNode(KIND), identifier(id), expression(expr) {}
     QString getNodeName() const override { return "Assign (=)"; }
     int getLine() const override { return identifier->getLine(); }
 };
 
 struct PrintNode : ASTNode {
-    unique_ptr<ASTNode> expression;
-    explicit PrintNode(unique_ptr<ASTNode> expr) : expression(std::move(expr)) {}
+    static constexpr NodeKind KIND = NodeKind::PRINT;
+    ASTNode* expression;
+    explicit PrintNode(ASTNode* expr) : ASTNode(KIND), expression(expr) {}
     QString getNodeName() const override { return "Print"; }
     int getLine() const override { return expression ? expression->getLine() : 0; }
 };
 
 struct ReturnNode : ASTNode {
-    unique_ptr<ASTNode> expression;
-    explicit ReturnNode(unique_ptr<ASTNode> expr) : expression(std::move(expr)) {}
+    static constexpr NodeKind KIND = NodeKind::RETURN;
+    ASTNode* expression;
+    explicit ReturnNode(ASTNode* expr) : ASTNode(KIND), expression(expr) {}
     QString getNodeName() const override { return "Return"; }
     int getLine() const override { return expression ? expression->getLine() : 0; }
 };
 
 struct FunctionCallNode : ASTNode {
-    unique_ptr<IdentifierNode> name;
-    vector<unique_ptr<ASTNode>> arguments;
-    FunctionCallNode(unique_ptr<IdentifierNode> n, vector<unique_ptr<ASTNode>> args)
-        : name(std::move(n)), arguments(std::move(args)) {}
-    QString getNodeName() const override { return "Call: " + name->token.value; }
+    static constexpr NodeKind KIND = NodeKind::FUNCTION_CALL;
+    IdentifierNode* name;
+    ArenaVector<ASTNode*> arguments;
+    FunctionCallNode(IdentifierNode* n, ArenaVector<ASTNode*> args)
+        : ASTNode(KIND), name(n), arguments(args) {}
+    QString getNodeName() const override { return "Call: " + name->value(); }
     int getLine() const override { return name->getLine(); }
 };
 
 struct BlockNode : ASTNode {
-    vector<unique_ptr<ASTNode>> statements;
+    static constexpr NodeKind KIND = NodeKind::BLOCK;
+    ArenaVector<ASTNode*> statements;
+    explicit BlockNode(Arena& arena) : ASTNode(KIND), statements(arena) {}
     QString getNodeName() const override { return "Block"; }
 };
 
 struct IfNode : ASTNode {
-    unique_ptr<ASTNode> condition;
-    unique_ptr<BlockNode> body;
-    unique_ptr<ASTNode> else_branch; // Can be BlockNode (else) or IfNode (elif)
-    IfNode(unique_ptr<ASTNode> cond, unique_ptr<BlockNode> b)
-        : condition(std::move(cond)), body(std::move(b)), else_branch(nullptr) {}
+    static constexpr NodeKind KIND = NodeKind::IF;
+    ASTNode* condition;
+    BlockNode* body;
+    ASTNode* else_branch; // Can be BlockNode (else) or IfNode (elif)
+    IfNode(ASTNode* cond, BlockNode* b)
+        : ASTNode(KIND), condition(cond), body(b), else_branch(nullptr) {}
     QString getNodeName() const override { return "If"; }
     int getLine() const override { return condition ? condition->getLine() : 0; }
 };
 
 struct WhileNode : ASTNode {
-    unique_ptr<ASTNode> condition;
-    unique_ptr<BlockNode> body;
-    WhileNode(unique_ptr<ASTNode> cond, unique_ptr<BlockNode> b)
-        : condition(std::move(cond)), body(std::move(b)) {}
+    static constexpr NodeKind KIND = NodeKind::WHILE;
+    ASTNode* condition;
+    BlockNode* body;
+    WhileNode(ASTNode* cond, BlockNode* b)
+        : ASTNode(KIND), condition(cond), body(b) {}
     QString getNodeName() const override { return "While"; }
     int getLine() const override { return condition ? condition->getLine() : 0; }
 };
 
 struct FunctionDefNode : ASTNode {
-    unique_ptr<IdentifierNode> name;
-    vector<unique_ptr<IdentifierNode>> parameters;
-    unique_ptr<BlockNode> body;
-    FunctionDefNode(unique_ptr<IdentifierNode> n, vector<unique_ptr<IdentifierNode>> p, unique_ptr<BlockNode> b)
-        : name(std::move(n)), parameters(std::move(p)), body(std::move(b)) {}
-    QString getNodeName() const override { return "Def: " + name->token.value; }
+    static constexpr NodeKind KIND = NodeKind::FUNCTION_DEF;
+    IdentifierNode* name;
+    ArenaVector<IdentifierNode*> parameters;
+    BlockNode* body;
+    // Which check an incremental SemanticAnalyzer kept the types and bindings below
+    // are from, 0 if none or a walk has been through since (see setIncremental())
+    uint64_t checked = 0;
+    FunctionDefNode(IdentifierNode* n, ArenaVector<IdentifierNode*> p, BlockNode* b)
+        : ASTNode(KIND), name(n), parameters(p), body(b) {}
+    QString getNodeName() const override { return "Def: " + name->value(); }
     int getLine() const override { return name->getLine(); }
 };
 
 struct TryExceptNode : ASTNode {
-    unique_ptr<BlockNode> try_body;
-    unique_ptr<BlockNode> except_body;
+    static constexpr NodeKind KIND = NodeKind::TRY_EXCEPT;
+    BlockNode* try_body;
+    BlockNode* except_body;
 
-    TryExceptNode(unique_ptr<BlockNode> tb, unique_ptr<BlockNode> eb)
-        : try_body(std::move(tb)), except_body(std::move(eb)) {}
+    TryExceptNode(BlockNode* tb, BlockNode* eb)
+        : ASTNode(KIND), try_body(tb), except_body(eb) {}
     QString getNodeName() const override { return "Try/Except"; }
 };
 
 struct ForNode : ASTNode {
-    unique_ptr<IdentifierNode> iterator;
+    static constexpr NodeKind KIND = NodeKind::FOR;
+    IdentifierNode* iterator;
 
     // Range Loop Data
-    unique_ptr<ASTNode> start;
-    unique_ptr<ASTNode> stop;
-    unique_ptr<ASTNode> step;
+    ASTNode* start;
+    ASTNode* stop;
+    ASTNode* step;
 
     // Generic Loop Data
-    unique_ptr<ASTNode> iterable;
+    ASTNode* iterable;
 
-    unique_ptr<BlockNode> body;
+    BlockNode* body;
     bool isRange;
 
     // Constructor for Range Loop
-    ForNode(unique_ptr<IdentifierNode> iter, unique_ptr<ASTNode> s, unique_ptr<ASTNode> e, unique_ptr<ASTNode> st, unique_ptr<BlockNode> b)
-        : iterator(std::move(iter)), start(std::move(s)), stop(std::move(e)), step(std::move(st)), iterable(nullptr), body(std::move(b)), isRange(true) {}
+    ForNode(IdentifierNode* iter, ASTNode* s, ASTNode* e, ASTNode* st, BlockNode* b)
+        : ASTNode(KIND), iterator(iter), start(s), stop(e), step(st), iterable(nullptr), body(b), isRange(true) {}
 
     // Constructor for Generic Loop
-    ForNode(unique_ptr<IdentifierNode> iter, unique_ptr<ASTNode> src, unique_ptr<BlockNode> b)
-        : iterator(std::move(iter)), start(nullptr), stop(nullptr), step(nullptr), iterable(std::move(src)), body(std::move(b)), isRange(false) {}
+    ForNode(IdentifierNode* iter, ASTNode* src, BlockNode* b)
+        : ASTNode(KIND), iterator(iter), start(nullptr), stop(nullptr), step(nullptr), iterable(src), body(b), isRange(false) {}
 
     QString getNodeName() const override { return isRange ? "For (Range)" : "For (Generic)"; }
     int getLine() const override { return iterator ? iterator->getLine() : 0; }
 };
 
+// Stands in for a statement that failed to parse when the parser recovers from
+// errors (Parser::setErrorRecovery). If the broken line opened an indented suite,
+// the suite is still parsed, into body; passes other than the tree view skip it.
+struct ErrorNode : ASTNode {
+    static constexpr NodeKind KIND = NodeKind::SYNTAX_ERROR;
+    int line;
+    BlockNode* body = nullptr;
+    explicit ErrorNode(int ln) : ASTNode(KIND), line(ln) {}
+    QString getNodeName() const override { return "Syntax Error"; }
+    int getLine() const override { return line; }
+};
+
+// --- Dispatch on NodeKind ---
+
+// T with the constness of Node, so const trees stay const through a visit
+template <typename T, typename Node>
+using KeepConst = conditional_t<is_const<Node>::value, const T, T>;
+
+// Calls visitor(p) with p cast to the node's concrete type: one switch, one jump.
+// The visitor is usually a generic lambda forwarding to an overload set, where a
+// base-class overload catches the kinds a pass does not care about.
+template <typename Node, typename Visitor>
+decltype(auto) visitNode(Node* node, Visitor&& visitor) {
+    switch (node->kind) {
+    case NodeKind::PROGRAM:       return visitor(static_cast<KeepConst<ProgramNode, Node>*>(node));
+    case NodeKind::NUMBER:        return visitor(static_cast<KeepConst<NumberNode, Node>*>(node));
+    case NodeKind::STRING:        return visitor(static_cast<KeepConst<StringNode, Node>*>(node));
+    case NodeKind::IDENTIFIER:    return visitor(static_cast<KeepConst<IdentifierNode, Node>*>(node));
+    case NodeKind::NONE:          return visitor(static_cast<KeepConst<NoneNode, Node>*>(node));
+    case NodeKind::UNARY_OP:      return visitor(static_cast<KeepConst<UnaryOpNode, Node>*>(node));
+    case NodeKind::BINARY_OP:     return visitor(static_cast<KeepConst<BinaryOpNode, Node>*>(node));
+    case NodeKind::ASSIGNMENT:    return visitor(static_cast<KeepConst<AssignmentNode, Node>*>(node));
+    case NodeKind::PRINT:         return visitor(static_cast<KeepConst<PrintNode, Node>*>(node));
+    case NodeKind::RETURN:        return visitor(static_cast<KeepConst<ReturnNode, Node>*>(node));
+    case NodeKind::FUNCTION_CALL: return visitor(static_cast<KeepConst<FunctionCallNode, Node>*>(node));
+    case NodeKind::BLOCK:         return visitor(static_cast<KeepConst<BlockNode, Node>*>(node));
+    case NodeKind::IF:            return visitor(static_cast<KeepConst<IfNode, Node>*>(node));
+    case NodeKind::WHILE:         return visitor(static_cast<KeepConst<WhileNode, Node>*>(node));
+    case NodeKind::FUNCTION_DEF:  return visitor(static_cast<KeepConst<FunctionDefNode, Node>*>(node));
+    case NodeKind::TRY_EXCEPT:    return visitor(static_cast<KeepConst<TryExceptNode, Node>*>(node));
+    case NodeKind::FOR:           return visitor(static_cast<KeepConst<ForNode, Node>*>(node));
+    case NodeKind::SYNTAX_ERROR:  break;
+    }
+    return visitor(static_cast<KeepConst<ErrorNode, Node>*>(node));
+}
+
+// Checked downcast: nullptr unless the node is a T
+template <typename T, typename Node>
+KeepConst<T, Node>* node_cast(Node* node) {
+    return node && node->kind == T::KIND ? static_cast<KeepConst<T, Node>*>(node) : nullptr;
+}
+
+// Calls fn(child) for every child field of the node in declaration order, null
+// ones included, so callers can keep fixed positions (see FlatAst)
+template <typename Node, typename Fn>
+void forEachChild(Node* node, Fn&& fn) {
+    switch (node->kind) {
+    case NodeKind::PROGRAM:
+        for (auto* stmt : static_cast<KeepConst<ProgramNode, Node>*>(node)->statements) fn(stmt);
+        break;
+    case NodeKind::UNARY_OP:
+        fn(static_cast<KeepConst<UnaryOpNode, Node>*>(node)->right);
+        break;
+    case NodeKind::BINARY_OP: {
+        auto p = static_cast<KeepConst<BinaryOpNode, Node>*>(node);
+        fn(p->left);
+        fn(p->right);
+        break;
+    }
+    case NodeKind::ASSIGNMENT: {
+        auto p = static_cast<KeepConst<AssignmentNode, Node>*>(node);
+        fn(p->identifier);
+        fn(p->expression);
+        break;
+    }
+    case NodeKind::PRINT:
+        fn(static_cast<KeepConst<PrintNode, Node>*>(node)->expression);
+        break;
+    case NodeKind::RETURN:
+        fn(static_cast<KeepConst<ReturnNode, Node>*>(node)->expression);
+        break;
+    case NodeKind::FUNCTION_CALL: {
+        auto p = static_cast<KeepConst<FunctionCallNode, Node>*>(node);
+        fn(p->name);
+        for (auto* arg : p->arguments) fn(arg);
+        break;
+    }
+    case NodeKind::BLOCK:
+        for (auto* stmt : static_cast<KeepConst<BlockNode, Node>*>(node)->statements) fn(stmt);
+        break;
+    case NodeKind::IF: {
+        auto p = static_cast<KeepConst<IfNode, Node>*>(node);
+        fn(p->condition);
+        fn(p->body);
+        fn(p->else_branch);
+        break;
+    }
+    case NodeKind::WHILE: {
+        auto p = static_cast<KeepConst<WhileNode, Node>*>(node);
+        fn(p->condition);
+        fn(p->body);
+        break;
+    }
+    case NodeKind::FUNCTION_DEF: {
+        auto p = static_cast<KeepConst<FunctionDefNode, Node>*>(node);
+        fn(p->name);
+        for (auto* param : p->parameters) fn(param);
+        fn(p->body);
+        break;
+    }
+    case NodeKind::TRY_EXCEPT: {
+        auto p = static_cast<KeepConst<TryExceptNode, Node>*>(node);
+        fn(p->try_body);
+        fn(p->except_body);
+        break;
+    }
+    case NodeKind::FOR: {
+        auto p = static_cast<KeepConst<ForNode, Node>*>(node);
+        fn(p->iterator);
+        fn(p->start);
+        fn(p->stop);
+        fn(p->step);
+        fn(p->iterable);
+        fn(p->body);
+        break;
+    }
+    case NodeKind::SYNTAX_ERROR:
+        fn(static_cast<KeepConst<ErrorNode, Node>*>(node)->body);
+        break;
+    default: // Leaves
+        break;
+    }
+}
+
 #endif // AST_H
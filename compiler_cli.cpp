@@ -0,0 +1,400 @@
+// Console front end: batch translation and the benchmarks. The GUI is built as
+// a Windows application, which has no console to print to.
+#include "keywords.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantic_analyzer.h"
+#include "translator.h"
+#include "source_file.h"
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+static QStringList collectScripts(const QStringList& paths)
+{
+    QStringList scripts;
+    for (const QString& path : paths) {
+        if (QFileInfo(path).isDir()) {
+            QDirIterator it(path, QStringList() << "*.py", QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) scripts << it.next();
+        } else {
+            scripts << path;
+        }
+    }
+    return scripts;
+}
+
+// Batch mode: compiler_cli --translate <file.py | directory>...
+// Writes <name>.cpp next to every script. Files are lexed straight from their
+// mapped UTF-8 bytes, so no QString copy of the source is ever made. Large ones
+// are lexed up front on all cores; the rest stream tokens into the parser. A
+// script with syntax or semantic errors gets all of them listed on stderr and
+// no output.
+static int translateScripts(const QStringList& paths)
+{
+    int failures = 0;
+    for (const QString& script : collectScripts(paths)) {
+        try {
+            SourceFile source(script);
+            Lexer lexer(source.data(), source.size());
+            TokenBuffer tokens;
+            const bool buffered = source.size() >= Lexer::PARALLEL_MIN_UNITS;
+            if (buffered) tokens = lexer.tokenize();
+            Parser parser = buffered ? Parser(tokens, lexer.source()) : Parser(lexer);
+
+            // Report every syntax error in the script, not just the first
+            parser.setErrorRecovery(true);
+            unique_ptr<ProgramNode> astRoot = parser.parse();
+            if (!parser.diagnostics().empty()) {
+                for (const Diagnostic& diagnostic : parser.diagnostics()) {
+                    fprintf(stderr, "%s: %s\n", qPrintable(script), diagnostic.message.c_str());
+                }
+                failures++;
+                continue;
+            }
+
+            SemanticAnalyzer analyzer;
+            if (!analyzer.tryAnalyze(astRoot.get())) {
+                for (const Diagnostic& diagnostic : analyzer.diagnostics()) {
+                    fprintf(stderr, "%s: %s\n", qPrintable(script), diagnostic.message.c_str());
+                }
+                failures++;
+                continue;
+            }
+            Translator translator(analyzer.getSymbolTable());
+            const QByteArray cppCode = translator.translate(FlatAst(astRoot.get())).toUtf8();
+
+            const QFileInfo info(script);
+            QFile output(info.path() + "/" + info.completeBaseName() + ".cpp");
+            if (!output.open(QIODevice::WriteOnly) || output.write(cppCode) != cppCode.size()) {
+                throw runtime_error("Cannot write " + output.fileName().toStdString());
+            }
+        } catch (const exception& e) {
+            fprintf(stderr, "%s: %s\n", qPrintable(script), e.what());
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// compiler_cli --bench-lexer <file.py | directory>...
+// Times both lexer engines on every script, from UTF-16 text and from the mapped
+// UTF-8 bytes, and a whole-file tokenize() (chunked across cores when large enough).
+static int benchmarkLexers(const QStringList& paths)
+{
+    const LexerEngine engines[] = {LexerEngine::HandWritten, LexerEngine::Table};
+    for (const QString& script : collectScripts(paths)) {
+        SourceFile source(script);
+        const QString text = QString::fromUtf8(source.data(), source.size());
+        printf("%s (%d bytes)\n", qPrintable(script), source.size());
+
+        auto report = [&](bool utf8, const char* label, auto lex) {
+            qint64 best = -1;
+            int count = 0;
+            for (int run = 0; run < 7; ++run) {
+                QElapsedTimer timer;
+                timer.start();
+                Lexer lexer = utf8 ? Lexer(source.data(), source.size()) : Lexer(text);
+                count = lex(lexer);
+                const qint64 elapsed = timer.nsecsElapsed();
+                if (best < 0 || elapsed < best) best = elapsed;
+            }
+            printf("  %-6s %-12s %8d tokens %9.3f ms %8.1f MB/s\n", utf8 ? "utf-8" : "utf-16", label, count,
+                   best / 1e6, source.size() / (best / 1e3));
+        };
+
+        for (bool utf8 : {false, true}) {
+            for (LexerEngine engine : engines) {
+                report(utf8, engine == LexerEngine::Table ? "table" : "hand-written", [engine](Lexer& lexer) {
+                    lexer.setEngine(engine);
+                    int count = 0;
+                    while (lexer.next().type != TokenType::END_OF_FILE) count++;
+                    return count;
+                });
+            }
+            report(utf8, "tokenize", [](Lexer& lexer) { return lexer.tokenize().size() - 1; });
+        }
+    }
+    return 0;
+}
+
+// How Lexer::identifier() classified a word before keywords.h: one compare per
+// keyword, in this order ("and" came later, along with the new operators)
+static TokenType keywordByCompareChain(QStringView word)
+{
+    if (word == QLatin1String("def")) return TokenType::DEF;
+    if (word == QLatin1String("if")) return TokenType::IF;
+    if (word == QLatin1String("while")) return TokenType::WHILE;
+    if (word == QLatin1String("else")) return TokenType::ELSE;
+    if (word == QLatin1String("elif")) return TokenType::ELIF;
+    if (word == QLatin1String("return")) return TokenType::RETURN;
+    if (word == QLatin1String("print")) return TokenType::PRINT;
+    if (word == QLatin1String("not")) return TokenType::NOT;
+    if (word == QLatin1String("or")) return TokenType::OR;
+    if (word == QLatin1String("None")) return TokenType::NONE;
+    if (word == QLatin1String("True")) return TokenType::TRUE;
+    if (word == QLatin1String("False")) return TokenType::FALSE;
+    if (word == QLatin1String("try")) return TokenType::TRY;
+    if (word == QLatin1String("except")) return TokenType::EXCEPT;
+    if (word == QLatin1String("for")) return TokenType::FOR;
+    if (word == QLatin1String("in")) return TokenType::IN;
+    if (word == QLatin1String("and")) return TokenType::AND;
+    return TokenType::IDENTIFIER;
+}
+
+// compiler_cli --bench-keywords [file.py | directory]...
+// Times the old compare chain against lookupKeyword() on every word of the
+// scripts (identifiers and keywords, as the lexer sees them), plus each keyword
+// and near misses of it. Both must classify every word the same.
+static int benchmarkKeywords(const QStringList& paths)
+{
+    QString text;
+    for (const Keyword& keyword : KEYWORDS) {
+        const QString word = QString::fromLatin1(keyword.spelling);
+        text += word + " " + word.left(word.size() - 1) + " " + word + "s " + word.toUpper() + " _" + word + " ";
+    }
+    text += "x i n value total_count self __init__\n";
+    for (const QString& script : collectScripts(paths)) {
+        SourceFile source(script);
+        text += QString::fromUtf8(source.data(), source.size()) + "\n";
+    }
+
+    // The words, as spans of the text
+    struct Word {
+        int offset;
+        int length;
+    };
+    vector<Word> words;
+    Lexer lexer(text);
+    const TokenBuffer tokens = lexer.tokenize();
+    for (int i = 0; i + 1 < tokens.size(); ++i) {
+        const QChar first = text[tokens.offset(i)];
+        if (first.isLetter() || first == '_') words.push_back({tokens.offset(i), tokens.length(i)});
+    }
+
+    int keywords = 0;
+    int mismatches = 0;
+    for (const Word& word : words) {
+        const TokenType chained = keywordByCompareChain(QStringView(text).mid(word.offset, word.length));
+        const TokenType hashed = lookupKeyword(text.constData() + word.offset, word.length);
+        if (chained != TokenType::IDENTIFIER) keywords++;
+        if (chained != hashed && mismatches++ < 10) {
+            fprintf(stderr, "'%s': compare chain %d, perfect hash %d\n", qPrintable(text.mid(word.offset, word.length)),
+                    int(chained), int(hashed));
+        }
+    }
+    printf("%d words, %d of them keywords, %d classified differently\n", int(words.size()), keywords, mismatches);
+
+    auto report = [&](const char* label, auto classify) {
+        // Enough passes over the words for the timer to resolve them
+        const int passes = max(1, 2000000 / max(1, int(words.size())));
+        qint64 best = -1;
+        unsigned checksum = 0; // Keeps the classifications from being optimized away
+        for (int run = 0; run < 7; ++run) {
+            QElapsedTimer timer;
+            timer.start();
+            for (int pass = 0; pass < passes; ++pass) {
+                for (const Word& word : words) checksum += unsigned(classify(word));
+            }
+            const qint64 elapsed = timer.nsecsElapsed();
+            if (best < 0 || elapsed < best) best = elapsed;
+        }
+        const double classified = double(passes) * double(words.size());
+        printf("  %-13s %8.2f ns/word %8.1f M identifiers/s  (checksum %u)\n", label, best / classified,
+               classified / (best / 1e3), checksum);
+    };
+    report("compare chain", [&text](const Word& word) {
+        return keywordByCompareChain(QStringView(text).mid(word.offset, word.length));
+    });
+    report("perfect hash", [&text](const Word& word) {
+        return lookupKeyword(text.constData() + word.offset, word.length);
+    });
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Reaches every node the way tree passes do, through the NodeKind switch
+static int visitAll(const ASTNode* root)
+{
+    int visited = 0;
+    vector<const ASTNode*> pending{root};
+    while (!pending.empty()) {
+        const ASTNode* node = pending.back();
+        pending.pop_back();
+        visited++;
+        forEachChild(node, [&](const ASTNode* child) {
+            if (child) pending.push_back(child);
+        });
+    }
+    return visited;
+}
+
+// compiler_cli --bench-parser <file.py | directory>...
+// Times parse() on a borrowed TokenBuffer and streaming from the lexer, and the
+// teardown of the tree, and reports how many nodes and arena bytes it took. In a
+// -DCOUNT_TOKEN_COPIES build it also reports how many Tokens each parse copied.
+// The last line is the cost per node of walking the finished tree.
+static int benchmarkParser(const QStringList& paths)
+{
+    for (const QString& script : collectScripts(paths)) {
+        SourceFile source(script);
+        Lexer bufferLexer(source.data(), source.size());
+        const TokenBuffer tokens = bufferLexer.tokenize();
+        Parser counter(tokens, bufferLexer.source());
+        counter.parse();
+        const int expressions = counter.expressionCount();
+        printf("%s (%d tokens, %d expressions)\n", qPrintable(script), tokens.size() - 1, expressions);
+
+        for (bool streaming : {false, true}) {
+            qint64 best = -1;
+            qint64 bestFree = -1;
+            long long copies = -1;
+            int nodes = 0;
+            size_t arenaUsed = 0;
+            size_t arenaReserved = 0;
+            for (int run = 0; run < 7; ++run) {
+                Lexer lexer(source.data(), source.size());
+#ifdef COUNT_TOKEN_COPIES
+                const long long before = TokenCopyCounter::copies.load();
+#endif
+                QElapsedTimer timer;
+                timer.start();
+                unique_ptr<ProgramNode> astRoot = streaming ? Parser(lexer).parse()
+                                                            : Parser(tokens, bufferLexer.source()).parse();
+                const qint64 elapsed = timer.nsecsElapsed();
+#ifdef COUNT_TOKEN_COPIES
+                copies = TokenCopyCounter::copies.load() - before;
+#endif
+                nodes = astRoot->arena.objects() + 1; // The ProgramNode itself is not in the arena
+                arenaUsed = astRoot->arena.bytesUsed();
+                arenaReserved = astRoot->arena.bytesReserved();
+                timer.restart();
+                astRoot.reset();
+                const qint64 freed = timer.nsecsElapsed();
+                if (best < 0 || elapsed < best) best = elapsed;
+                if (bestFree < 0 || freed < bestFree) bestFree = freed;
+            }
+            const QByteArray copyCount = copies < 0 ? QByteArray("n/a") : QByteArray::number(copies);
+            printf("  %-9s %9.3f ms %8.2f Mtokens/s %8.2f Mexpressions/s  free %7.3f ms  token copies/parse: %s\n",
+                   streaming ? "streaming" : "buffered", best / 1e6, tokens.size() / (best / 1e3),
+                   expressions / (best / 1e3), bestFree / 1e6, copyCount.constData());
+            printf("            %d nodes, arena %.1f KB used / %.1f KB reserved\n", nodes, arenaUsed / 1024.0,
+                   arenaReserved / 1024.0);
+        }
+
+        const unique_ptr<ProgramNode> astRoot = Parser(tokens, bufferLexer.source()).parse();
+        qint64 best = -1;
+        int visited = 0;
+        for (int run = 0; run < 7; ++run) {
+            QElapsedTimer timer;
+            timer.start();
+            visited = visitAll(astRoot.get());
+            const qint64 elapsed = timer.nsecsElapsed();
+            if (best < 0 || elapsed < best) best = elapsed;
+        }
+        printf("  %-9s %9.3f ms %8.2f ns/node\n", "visit", best / 1e6, double(best) / visited);
+    }
+    return 0;
+}
+
+// compiler_cli --bench-depth [depth]
+// Times every pass on generated scripts nested 'depth' levels deep (100000 by
+// default): brackets, unary minus, right-associative '**' and if-blocks. Blocks
+// use one-space indents and a tenth of the depth, since a script's size grows
+// with the square of its block depth. Each script is first parsed with the
+// default limit to show the error, then with the limit raised to fit.
+static int benchmarkDepth(const QStringList& args)
+{
+    const int depth = args.isEmpty() ? 100000 : args.first().toInt();
+    if (depth <= 0) throw runtime_error("Depth must be positive");
+
+    struct Case {
+        const char* name;
+        int depth;
+        QString source;
+    };
+    vector<Case> cases;
+    cases.push_back({"brackets", depth, "x = " + QString(depth, '(') + "1" + QString(depth, ')') + "\n"});
+    cases.push_back({"unary", depth, "x = " + QString(depth, '-') + "1\n"});
+    cases.push_back({"power", depth, "x = " + QString("2 ** ").repeated(depth) + "2\n"});
+    QString blocks = "x = 1\n";
+    const int blockDepth = max(1, depth / 10);
+    for (int level = 0; level < blockDepth; ++level) blocks += QString(level, ' ') + "if x:\n";
+    blocks += QString(blockDepth, ' ') + "x = x + 1\n";
+    cases.push_back({"blocks", blockDepth, blocks});
+
+    for (const Case& c : cases) {
+        printf("%s: depth %d, %lld chars\n", c.name, c.depth, (long long)c.source.size());
+        try {
+            Lexer lexer(c.source);
+            Parser(lexer).parse();
+        } catch (const exception& e) {
+            printf("  default limit: %s\n", e.what());
+        }
+
+        QElapsedTimer timer;
+        auto lap = [&](const char* pass) {
+            printf("  %-9s %9.3f ms\n", pass, timer.nsecsElapsed() / 1e6);
+            timer.start();
+        };
+        timer.start();
+        Lexer lexer(c.source);
+        Parser parser(lexer);
+        parser.setMaxDepth(c.depth + 1);
+        unique_ptr<ProgramNode> astRoot = parser.parse();
+        lap("parse");
+        SemanticAnalyzer analyzer;
+        analyzer.analyze(astRoot.get());
+        lap("analyze");
+        const FlatAst flatAst(astRoot.get());
+        lap("flatten");
+        Translator translator(analyzer.getSymbolTable());
+        const int length = translator.translate(flatAst).size();
+        lap("translate");
+        const int visited = visitAll(astRoot.get());
+        lap("visit");
+        astRoot.reset();
+        lap("free");
+        printf("  %d nodes, %d chars of C++\n", visited, length);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // --lexer=table|handwritten picks the lexer engine for every mode
+    QStringList args;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--lexer=table") == 0) Lexer::setDefaultEngine(LexerEngine::Table);
+        else if (strcmp(argv[i], "--lexer=handwritten") == 0) Lexer::setDefaultEngine(LexerEngine::HandWritten);
+        else args << QString::fromLocal8Bit(argv[i]);
+    }
+
+    if (!args.isEmpty() && args.first() == "--translate") {
+        return translateScripts(args.mid(1));
+    }
+    int (*mode)(const QStringList&) = nullptr;
+    if (!args.isEmpty() && args.first() == "--bench-keywords") mode = benchmarkKeywords;
+    if (!args.isEmpty() && args.first() == "--bench-lexer") mode = benchmarkLexers;
+    if (!args.isEmpty() && args.first() == "--bench-parser") mode = benchmarkParser;
+    if (!args.isEmpty() && args.first() == "--bench-depth") mode = benchmarkDepth;
+    if (!mode) {
+        fprintf(stderr, "usage: compiler_cli [--lexer=table|handwritten] --translate <file.py | directory>...\n"
+                        "       compiler_cli --bench-keywords [file.py | directory]...\n"
+                        "       compiler_cli [--lexer=table|handwritten] --bench-lexer|--bench-parser <file.py | directory>...\n"
+                        "       compiler_cli --bench-depth [depth]\n");
+        return 2;
+    }
+    try {
+        return mode(args.mid(1));
+    } catch (const exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <string>
+#include <utility>
+#include <variant>
+
+using namespace std;
+
+// What kind of problem a Diagnostic reports, so callers can react to it
+// without reading the message
+enum class DiagnosticCode {
+    // Lexer
+    INDENTATION,             // A dedent to a column no enclosing block started at
+    // Parser
+    UNEXPECTED_TOKEN,
+    EXPECTED_TOKEN,
+    EXPECTED_INDENT,         // A compound statement's header without an indented block
+    NESTING_TOO_DEEP,
+    CHAINED_COMPARISON,      // a < b < c, which would not mean what it does in Python
+    // Semantic analysis
+    UNDEFINED_VARIABLE,
+    UNDEFINED_FUNCTION,
+    FUNCTION_REDEFINED,
+    TYPE_MISMATCH,
+    STRING_ARITHMETIC,
+    RANGE_NOT_INTEGER,
+    RETURN_OUTSIDE_FUNCTION,
+    INCONSISTENT_RETURN
+};
+
+// Where a problem is: 1-based line and column, in code units of the source
+// the tokens point into. Column 0 means the line as a whole (the semantic
+// analyzer only knows lines).
+struct SourceSpan {
+    int line = 0;
+    int column = 0;
+    int length = 0;
+};
+
+// One problem found in a script. The message is the full text an exception for
+// it would carry, "at line N" included, so it can be shown as is.
+struct Diagnostic {
+    SourceSpan span;
+    DiagnosticCode code = DiagnosticCode::UNEXPECTED_TOKEN;
+    string message;
+};
+
+// A value, or the Diagnostic that stopped it from being produced. The try*
+// functions return these instead of throwing, for callers such as the live
+// checker that expect to fail on most calls.
+template <typename T>
+class Result {
+public:
+    Result(const T& value) : m_value(value) {}
+    Result(T&& value) : m_value(std::move(value)) {}
+    Result(Diagnostic error) : m_value(std::move(error)) {}
+
+    bool ok() const { return m_value.index() == 0; }
+    explicit operator bool() const { return ok(); }
+
+    T& value() { return get<0>(m_value); }
+    const T& value() const { return get<0>(m_value); }
+    const Diagnostic& error() const { return get<1>(m_value); }
+
+private:
+    variant<T, Diagnostic> m_value;
+};
+
+template <>
+class Result<void> {
+public:
+    Result() = default;
+    Result(Diagnostic error) : m_error(std::move(error)), m_failed(true) {}
+
+    bool ok() const { return !m_failed; }
+    explicit operator bool() const { return ok(); }
+
+    const Diagnostic& error() const { return m_error; }
+
+private:
+    Diagnostic m_error;
+    bool m_failed = false;
+};
+
+#endif // DIAGNOSTIC_H
@@ -0,0 +1,127 @@
+#include "flat_ast.h"
+#include <algorithm>
+
+using namespace std;
+
+FlatAst::FlatAst(const ProgramNode* program) {
+    if (!program) return;
+    // Everything below the program was made in its arena, so the node count is known
+    m_nodes.reserve(size_t(program->arena.objects()) + 1);
+    m_children.reserve(size_t(program->arena.objects()) + 1);
+
+    // Pre-order with an explicit stack, so depth costs heap rather than C++ stack.
+    // Each entry is a node still to add and the child slot that will point at it.
+    struct Pending {
+        const ASTNode* node;
+        uint32_t slot;
+    };
+    vector<Pending> stack{{program, NONE}};
+    while (!stack.empty()) {
+        const Pending next = stack.back();
+        stack.pop_back();
+        const uint32_t index = add(next.node);
+        if (next.slot != NONE) m_children[next.slot] = index;
+
+        // Children go on last-first so they come off in slot order
+        const size_t top = stack.size();
+        uint32_t slot = m_nodes[index].first;
+        forEachChild(next.node, [&](const ASTNode* child) {
+            if (child) stack.push_back({child, slot});
+            slot++;
+        });
+        reverse(stack.begin() + top, stack.end());
+    }
+
+    // A subtree ends where its last child's does; children follow their parent,
+    // so one backward pass sees every child before the parent
+    for (uint32_t i = uint32_t(m_nodes.size()); i-- > 0;) {
+        Node& node = m_nodes[i];
+        node.end = i + 1;
+        for (uint32_t slot = node.count; slot-- > 0;) {
+            const uint32_t last = m_children[node.first + slot];
+            if (last != NONE) {
+                node.end = m_nodes[last].end;
+                break;
+            }
+        }
+    }
+}
+
+void FlatAst::setText(Node& node, QStringView text) {
+    node.value = uint32_t(m_text.size());
+    node.length = uint32_t(text.size());
+    m_text.append(text.data(), text.size());
+}
+
+// Appends the node itself with one NONE slot per child field (see forEachChild);
+// the constructor fills the slots as the children are added
+uint32_t FlatAst::add(const ASTNode* node) {
+    Node flat;
+    flat.kind = node->kind;
+    flat.determined_type = node->determined_type;
+    flat.line = node->getLine();
+
+    switch (node->kind) {
+    case NodeKind::NUMBER:
+        setText(flat, static_cast<const NumberNode*>(node)->value);
+        break;
+    case NodeKind::STRING:
+        setText(flat, static_cast<const StringNode*>(node)->value);
+        break;
+    case NodeKind::IDENTIFIER: {
+        auto p = static_cast<const IdentifierNode*>(node);
+        flat.value = p->symbol;
+        flat.binding = p->binding;
+        break;
+    }
+    case NodeKind::UNARY_OP: {
+        auto p = static_cast<const UnaryOpNode*>(node);
+        flat.op = p->op;
+        setText(flat, p->op_value);
+        break;
+    }
+    case NodeKind::BINARY_OP: {
+        auto p = static_cast<const BinaryOpNode*>(node);
+        flat.op = p->op;
+        setText(flat, p->op_value);
+        break;
+    }
+    case NodeKind::FOR:
+        flat.isRange = static_cast<const ForNode*>(node)->isRange;
+        break;
+    default:
+        break;
+    }
+
+    forEachChild(node, [&](const ASTNode*) { flat.count++; });
+    flat.first = uint32_t(m_children.size());
+    m_children.resize(m_children.size() + flat.count, NONE);
+
+    m_nodes.push_back(flat);
+    return uint32_t(m_nodes.size() - 1);
+}
+
+QString FlatAst::label(uint32_t index) const {
+    const Node& n = m_nodes[index];
+    switch (n.kind) {
+    case NodeKind::PROGRAM:       return "Program";
+    case NodeKind::NUMBER:        return "Num: " + text(index).toString();
+    case NodeKind::STRING:        return "Str: \"" + text(index).toString() + "\"";
+    case NodeKind::IDENTIFIER:    return "ID: " + name(index);
+    case NodeKind::NONE:          return "None";
+    case NodeKind::UNARY_OP:      return "Unary Op: " + text(index).toString();
+    case NodeKind::BINARY_OP:     return "Bin Op: " + text(index).toString();
+    case NodeKind::ASSIGNMENT:    return "Assign (=)";
+    case NodeKind::PRINT:         return "Print";
+    case NodeKind::RETURN:        return "Return";
+    case NodeKind::FUNCTION_CALL: return "Call: " + name(child(index, 0));
+    case NodeKind::BLOCK:         return "Block";
+    case NodeKind::IF:            return "If";
+    case NodeKind::WHILE:         return "While";
+    case NodeKind::FUNCTION_DEF:  return "Def: " + name(child(index, 0));
+    case NodeKind::TRY_EXCEPT:    return "Try/Except";
+    case NodeKind::FOR:           return n.isRange ? "For (Range)" : "For (Generic)";
+    case NodeKind::SYNTAX_ERROR:  return "Syntax Error";
+    }
+    return QString();
+}
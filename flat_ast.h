@@ -0,0 +1,76 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include "ast.h"
+#include <QString>
+#include <QStringView>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// The tree as three contiguous pools: nodes in pre-order, their child slots as
+// 32-bit node indices, and the literal/operator text. No pointers, so it copies
+// and serializes as plain data and passes over it walk memory in order.
+//
+// Built from an analyzed ProgramNode (determined types are carried over). The
+// child slots of each kind mirror the fields of its ASTNode, NONE where a field
+// is null:
+//   Program, Block      statements...
+//   Assignment          identifier, expression
+//   BinaryOp            left, right
+//   UnaryOp             right
+//   Print, Return       expression
+//   FunctionCall        name, arguments...
+//   If                  condition, body, else_branch
+//   While               condition, body
+//   FunctionDef         name, parameters..., body
+//   TryExcept           try_body, except_body
+//   For                 iterator, start, stop, step, iterable, body
+//   SyntaxError         body
+class FlatAst {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Node {
+        NodeKind kind = NodeKind::NONE;
+        bool isRange = false; // For
+        TokenType op = TokenType::ILLEGAL; // UnaryOp, BinaryOp
+        DataType determined_type = DataType::UNDEFINED;
+        int line = 0;
+        uint32_t first = 0;  // First child slot
+        uint32_t count = 0;  // Number of child slots
+        uint32_t end = 0;    // One past the last node of this subtree
+        uint32_t value = 0;  // SymbolId for Identifier; text offset for Number, String and operators
+        uint32_t length = 0; // Text length
+        BindingId binding = NO_BINDING; // Identifier (see IdentifierNode)
+    };
+
+    FlatAst() = default;
+    explicit FlatAst(const ProgramNode* program);
+
+    int size() const { return int(m_nodes.size()); }
+    bool empty() const { return m_nodes.empty(); }
+    uint32_t root() const { return 0; }
+
+    const Node& operator[](uint32_t index) const { return m_nodes[index]; }
+    uint32_t child(uint32_t index, int slot) const { return m_children[m_nodes[index].first + slot]; }
+
+    QStringView text(uint32_t index) const {
+        return QStringView(m_text).mid(m_nodes[index].value, m_nodes[index].length);
+    }
+    const QString& name(uint32_t index) const { return Interner::global().name(m_nodes[index].value); }
+
+    // Same text as ASTNode::getNodeName()
+    QString label(uint32_t index) const;
+
+private:
+    vector<Node> m_nodes;
+    vector<uint32_t> m_children;
+    QString m_text;
+
+    uint32_t add(const ASTNode* node);
+    void setText(Node& node, QStringView text);
+};
+
+#endif // FLAT_AST_H
@@ -0,0 +1,180 @@
+#include "incremental_lexer.h"
+#include <algorithm>
+
+using namespace std;
+
+void IncrementalLexer::noteEdit(int position, int charsRemoved, int charsAdded) {
+    if (!m_has_edit) {
+        m_has_edit = true;
+        m_edit_start = position;
+        m_edit_new_end = position + charsAdded;
+        m_edit_delta = charsAdded - charsRemoved;
+        return;
+    }
+
+    // Merge with the pending range: move its end into the new text, then widen
+    int end = m_edit_new_end;
+    if (end > position) {
+        end = (end >= position + charsRemoved) ? end + charsAdded - charsRemoved : position + charsAdded;
+    }
+    m_edit_start = min(m_edit_start, position);
+    m_edit_new_end = max(end, position + charsAdded);
+    m_edit_delta += charsAdded - charsRemoved;
+}
+
+Result<const TokenBuffer*> IncrementalLexer::update(const QString& source) {
+    const bool hasEdit = m_has_edit;
+    m_has_edit = false;
+
+    if (m_valid && !hasEdit && source == m_source) {
+        m_last_relexed = 0;
+        return &m_tokens;
+    }
+
+    const int oldLength = m_source.length();
+    m_source = source;
+
+    // Only trust the edit range if it is consistent with both texts; QTextDocument
+    // may report the implicit trailing paragraph separator, for example.
+    // The indent pool only grows between full lexes, so those also compact it.
+    if (m_valid && hasEdit && m_indent_pool.size() < 8 * m_lines.size() + 4096) {
+        const int added = m_edit_new_end - m_edit_start;
+        const int removed = added - m_edit_delta;
+        if (m_edit_start >= 0 && removed >= 0 && added >= 0 &&
+            m_edit_start + removed <= oldLength && m_edit_start + added <= source.length() &&
+            oldLength + m_edit_delta == source.length()) {
+            if (relexRange(m_edit_start, removed, added)) return result();
+        }
+    }
+
+    relexAll();
+    return result();
+}
+
+Result<const TokenBuffer*> IncrementalLexer::result() const {
+    if (!m_valid) return m_error;
+    return &m_tokens;
+}
+
+void IncrementalLexer::relexAll() {
+    m_valid = false;
+    m_tokens.clear();
+    m_fresh_lines.clear();
+    m_indent_pool.clear();
+    m_old_lines = nullptr;
+    m_sync_line = -1;
+    m_emitted = 0;
+
+    Lexer lexer(m_source);
+    lexer.setLineStartListener(this);
+    Token token;
+    do {
+        token = lexer.next();
+        m_tokens.push_back(token);
+        m_emitted++;
+    } while (token.type != TokenType::END_OF_FILE);
+    if (const Diagnostic* error = lexer.error()) {
+        m_error = *error;
+        return;
+    }
+
+    m_lines.swap(m_fresh_lines);
+    m_fresh_lines.clear();
+    m_last_relexed = m_tokens.size();
+    m_valid = true;
+}
+
+bool IncrementalLexer::relexRange(int start, int removed, int added) {
+    // Restart at the last line start at or before the edit: nothing before it changed
+    auto after = upper_bound(m_lines.begin(), m_lines.end(), start,
+                             [](int pos, const LineSnapshot& line) { return pos < line.pos; });
+    if (after == m_lines.begin()) return false;
+    const size_t restart = (after - m_lines.begin()) - 1;
+    const LineSnapshot from = m_lines[restart];
+
+    m_valid = false; // Until the splice below is complete
+    m_fresh_lines.clear();
+    m_old_lines = &m_lines;
+    m_damage_end = start + added;
+    m_delta = added - removed;
+    m_emitted = from.firstToken;
+    m_sync_line = -1;
+
+    vector<int> indents(m_indent_pool.begin() + from.indentStart,
+                        m_indent_pool.begin() + from.indentStart + from.indentDepth);
+    Lexer lexer(m_source, from.pos, from.line, indents);
+    lexer.setLineStartListener(this);
+
+    TokenBuffer fresh;
+    while (true) {
+        Token token = lexer.next();
+        if (m_sync_line >= 0) break; // This token is already in the old tail
+        fresh.push_back(token);
+        m_emitted++;
+        if (token.type == TokenType::END_OF_FILE) break;
+    }
+    m_old_lines = nullptr;
+    if (const Diagnostic* error = lexer.error()) {
+        m_error = *error; // Still invalid: the next update() starts over
+        return true;
+    }
+
+    int tailToken = m_tokens.size();
+    int tailLine = m_lines.size();
+    const int lineDelta = m_sync_line >= 0 ? m_sync_line_delta : 0;
+    if (m_sync_line >= 0) {
+        const LineSnapshot& sync = m_lines[m_sync_line];
+        const int tokenDelta = fresh.size() - (sync.firstToken - from.firstToken);
+
+        tailToken = sync.firstToken;
+        tailLine = m_sync_line;
+        for (size_t i = tailLine; i < m_lines.size(); ++i) {
+            m_lines[i].pos += m_delta;
+            m_lines[i].line += lineDelta;
+            m_lines[i].firstToken += tokenDelta;
+        }
+    }
+
+    // Splice: [kept head][fresh][shifted tail]
+    m_tokens.splice(from.firstToken, tailToken, fresh, m_delta, lineDelta);
+    m_lines.erase(m_lines.begin() + restart, m_lines.begin() + tailLine);
+    m_lines.insert(m_lines.begin() + restart, m_fresh_lines.begin(), m_fresh_lines.end());
+    m_fresh_lines.clear();
+
+    m_last_relexed = fresh.size();
+    m_valid = true;
+    return true;
+}
+
+void IncrementalLexer::lineStart(int pos, int line, const vector<int>& indents) {
+    if (m_sync_line >= 0) return; // Already re-joined the old stream
+
+    // Past the edit the text is unchanged, so equal lexer state means equal tokens
+    if (m_old_lines && pos >= m_damage_end) {
+        const int oldPos = pos - m_delta;
+        auto it = lower_bound(m_old_lines->begin(), m_old_lines->end(), oldPos,
+                              [](const LineSnapshot& l, int p) { return l.pos < p; });
+        if (it != m_old_lines->end() && it->pos == oldPos && sameIndents(*it, indents)) {
+            m_sync_line = it - m_old_lines->begin();
+            m_sync_line_delta = line - it->line;
+            return;
+        }
+    }
+
+    m_fresh_lines.push_back({pos, line, m_emitted, storeIndents(indents), int(indents.size())});
+}
+
+bool IncrementalLexer::sameIndents(const LineSnapshot& line, const vector<int>& indents) const {
+    if (line.indentDepth != int(indents.size())) return false;
+    return equal(indents.begin(), indents.end(), m_indent_pool.begin() + line.indentStart);
+}
+
+int IncrementalLexer::storeIndents(const vector<int>& indents) {
+    // Most lines keep the stack of the line before
+    if (!m_fresh_lines.empty() && sameIndents(m_fresh_lines.back(), indents)) {
+        return m_fresh_lines.back().indentStart;
+    }
+    const int start = m_indent_pool.size();
+    m_indent_pool.insert(m_indent_pool.end(), indents.begin(), indents.end());
+    return start;
+}
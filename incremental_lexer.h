@@ -0,0 +1,74 @@
+#ifndef INCREMENTAL_LEXER_H
+#define INCREMENTAL_LEXER_H
+
+#include "lexer.h"
+#include <QString>
+#include <vector>
+
+using namespace std;
+
+// Keeps the token array of the editor contents between live checks.
+// Every line start is snapshotted with its indent stack and first token index.
+// After an edit, lexing restarts at the last snapshot before the damage and stops
+// as soon as it reaches an old line start (past the damage) in the same indent
+// state; the untouched tail of the old array is shifted and reused.
+class IncrementalLexer : private LineStartListener {
+public:
+    // Record a QTextDocument::contentsChange; edits are merged until update()
+    void noteEdit(int position, int charsRemoved, int charsAdded);
+
+    // Bring the cached tokens in line with 'source' (full lex on first use or
+    // when no usable edit range is known). A lexer error is returned, not thrown,
+    // and the next update() then lexes everything again.
+    Result<const TokenBuffer*> update(const QString& source);
+
+    const TokenBuffer& tokens() const { return m_tokens; }
+    const QString& source() const { return m_source; }
+
+    // Tokens produced by the last update() (for the status bar / profiling)
+    int lastRelexedTokens() const { return m_last_relexed; }
+
+    void invalidate() { m_valid = false; }
+
+private:
+    struct LineSnapshot {
+        int pos;
+        int line;
+        int firstToken;  // Index of the first token lexed after this line start
+        int indentStart; // Indent stack lives in m_indent_pool[indentStart, +indentDepth)
+        int indentDepth;
+    };
+
+    QString m_source;
+    TokenBuffer m_tokens;
+    vector<LineSnapshot> m_lines; // Sorted by pos
+    vector<int> m_indent_pool;    // Consecutive lines with the same stack share one entry
+    bool m_valid = false;
+    Diagnostic m_error; // Why the last update() left the tokens invalid
+    int m_last_relexed = 0;
+
+    // Pending damage, in coordinates of the current document text
+    bool m_has_edit = false;
+    int m_edit_start = 0;
+    int m_edit_new_end = 0;
+    int m_edit_delta = 0; // Total chars added - removed
+
+    // State used while re-lexing a damaged region
+    vector<LineSnapshot> m_fresh_lines;
+    const vector<LineSnapshot>* m_old_lines = nullptr;
+    int m_damage_end = 0;  // End of the edited text (new coordinates)
+    int m_delta = 0;
+    int m_emitted = 0;     // Index the next lexed token will get
+    int m_sync_line = -1;  // Old snapshot where the streams re-joined
+    int m_sync_line_delta = 0;
+
+    Result<const TokenBuffer*> result() const;
+    void relexAll();
+    bool relexRange(int start, int removed, int added);
+
+    void lineStart(int pos, int line, const vector<int>& indents) override;
+    bool sameIndents(const LineSnapshot& line, const vector<int>& indents) const;
+    int storeIndents(const vector<int>& indents);
+};
+
+#endif // INCREMENTAL_LEXER_H
@@ -0,0 +1,201 @@
+#include "incremental_parser.h"
+#include <QHashFunctions>
+#include <algorithm>
+
+using namespace std;
+
+void IncrementalParser::invalidate() {
+    m_program.reset();
+    m_cache.clear();
+    m_index.clear();
+}
+
+ProgramNode* IncrementalParser::update(const TokenBuffer& tokens, SourceView source) {
+    if (m_program && m_program->arena.bytesUsed() > 2 * m_fresh_bytes + COMPACT_SLACK) invalidate();
+    const bool fresh = !m_program;
+    if (fresh) m_program = make_unique<ProgramNode>();
+    else m_program->statements.clear(); // The cache holds the old statements it still wants
+
+    m_tokens = &tokens;
+    m_source = source;
+    m_kept.clear();
+    m_last_reused = 0;
+    m_cursor = 0;
+    m_line_hint = -1;
+    m_open = -1;
+    findUnits();
+
+    Parser parser(tokens, source);
+    parser.setErrorRecovery(true);
+    if (!m_units.empty()) parser.setStatementCache(this);
+    parser.parseInto(*m_program);
+    m_diagnostics = parser.diagnostics();
+
+    m_cache.swap(m_kept);
+    buildIndex();
+    if (fresh) m_fresh_bytes = m_program->arena.bytesUsed();
+    m_tokens = nullptr;
+    return m_program.get();
+}
+
+// A unit starts at the first token of a line the lexer left at indentation 0,
+// i.e. with as many DEDENTs before it as there were INDENTs. Those belong to the
+// unit they close, whose text reaches up to the next unit's line.
+void IncrementalParser::findUnits() {
+    m_units.clear();
+    const TokenBuffer& tokens = *m_tokens;
+    if (tokens.empty() || tokens.kind(tokens.size() - 1) != TokenType::END_OF_FILE) return;
+
+    const vector<TokenBuffer::LineRun>& runs = tokens.lineRuns();
+    int depth = 0;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const int end = r + 1 < runs.size() ? int(runs[r + 1].firstToken) : tokens.size();
+        int i = int(runs[r].firstToken);
+        for (; i < end; ++i) {
+            const TokenType kind = tokens.kind(i);
+            if (kind == TokenType::INDENT) depth++;
+            else if (kind == TokenType::DEDENT) depth--;
+            else break;
+        }
+        if (i == end || depth != 0) continue;
+        const TokenType kind = tokens.kind(i);
+        // These continue the statement above them
+        if (kind == TokenType::ELIF || kind == TokenType::ELSE || kind == TokenType::EXCEPT ||
+            kind == TokenType::END_OF_FILE) continue;
+        // The token may start past the line start (a string's span skips the quote)
+        const int offset = tokens.offset(i);
+        m_units.push_back({i, offset - m_source.columnOf(offset) + 1});
+    }
+    m_units.push_back({tokens.size() - 1, m_source.length});
+}
+
+// The unit's source as bytes (two per code unit in a UTF-16 source)
+string_view IncrementalParser::textOf(int unit) const {
+    const int start = m_units[unit].offset;
+    const size_t length = size_t(m_units[unit + 1].offset - start);
+    if (m_source.isUtf8()) return string_view(m_source.utf8 + start, length);
+    return string_view(reinterpret_cast<const char*>(m_source.utf16 + start), length * sizeof(char16_t));
+}
+
+// Kind of the token 'skip' places past the end of the unit
+TokenType IncrementalParser::kindAfter(int unit, int skip) const {
+    const int index = m_units[unit + 1].first + skip;
+    return index < m_tokens->size() ? m_tokens->kind(index) : TokenType::END_OF_FILE;
+}
+
+// Text alone fixes a unit's tokens, as the lexer is at indentation 0 where it
+// starts. Its parse can also peek at two tokens past its end, so those kinds
+// and the token count seed the hash.
+size_t IncrementalParser::keyOf(int unit) const {
+    const string_view text = textOf(unit);
+    const size_t seed = (size_t(m_units[unit + 1].first - m_units[unit].first) << 16) ^
+                        (size_t(kindAfter(unit, 0)) << 8) ^ size_t(kindAfter(unit, 1));
+    return qHashBits(text.data(), text.size(), seed);
+}
+
+// The entry for 'key' if it is the same text as 'unit' and still unused
+IncrementalParser::CachedUnit* IncrementalParser::find(size_t key, int unit) {
+    if (m_index.empty()) return nullptr;
+    const size_t mask = m_index.size() - 1;
+    for (size_t slot = key & mask; m_index[slot]; slot = (slot + 1) & mask) {
+        CachedUnit& cached = m_cache[m_index[slot] - 1];
+        if (cached.key != key) continue;
+        const bool same = cached.tokens == m_units[unit + 1].first - m_units[unit].first &&
+                          cached.next == kindAfter(unit, 0) && cached.after == kindAfter(unit, 1) &&
+                          cached.text == textOf(unit);
+        // Each subtree can appear once per tree, so a repeated unit is parsed again
+        return same && !cached.reused ? &cached : nullptr;
+    }
+    return nullptr;
+}
+
+// The same text twice in one script: the first copy is the one found
+void IncrementalParser::buildIndex() {
+    size_t size = 16;
+    while (size < 2 * m_cache.size()) size *= 2;
+    m_index.assign(size, 0);
+    const size_t mask = size - 1;
+    for (size_t i = 0; i < m_cache.size(); ++i) {
+        const size_t key = m_cache[i].key;
+        size_t slot = key & mask;
+        while (m_index[slot] && m_cache[m_index[slot] - 1].key != key) slot = (slot + 1) & mask;
+        if (!m_index[slot]) m_index[slot] = int(i) + 1;
+    }
+}
+
+// The parser got from the start of unit 'unit' to the next one without an error
+void IncrementalParser::store(int unit, ProgramNode& program) {
+    CachedUnit cached;
+    cached.key = m_open_key;
+    cached.count = program.statements.size() - m_open_statements;
+    cached.statements = static_cast<ASTNode**>(
+        program.arena.allocate(sizeof(ASTNode*) * size_t(cached.count), alignof(ASTNode*)));
+    copy(program.statements.begin() + m_open_statements, program.statements.end(), cached.statements);
+    cached.line = m_tokens->line(m_units[unit].first, &m_line_hint);
+    cached.text = string(textOf(unit));
+    cached.tokens = m_units[unit + 1].first - m_units[unit].first;
+    cached.next = kindAfter(unit, 0);
+    cached.after = kindAfter(unit, 1);
+    cached.reused = false;
+    m_kept.push_back(std::move(cached));
+}
+
+int IncrementalParser::statementStart(int first, ProgramNode& program, int errors) {
+    if (m_open >= 0 && first >= m_units[m_open + 1].first) {
+        if (first == m_units[m_open + 1].first && errors == m_open_errors) store(m_open, program);
+        m_open = -1;
+    }
+
+    const int last = int(m_units.size()) - 1;
+    while (m_cursor < last && m_units[m_cursor].first < first) m_cursor++;
+    if (m_cursor == last || m_units[m_cursor].first != first) return first; // Not a unit start
+
+    const int unit = m_cursor;
+    const size_t key = keyOf(unit);
+    if (CachedUnit* cached = find(key, unit)) {
+        const int line = m_tokens->line(first, &m_line_hint);
+        if (line != cached->line) {
+            shiftLines(*cached, line - cached->line);
+            cached->line = line;
+        }
+        for (int i = 0; i < cached->count; ++i) program.statements.push_back(cached->statements[i]);
+        cached->reused = true;
+        m_kept.push_back(std::move(*cached));
+        m_kept.back().reused = false;
+        m_last_reused++;
+        m_cursor++;
+        return m_units[unit + 1].first;
+    }
+
+    m_open = unit;
+    m_open_key = key;
+    m_open_errors = errors;
+    m_open_statements = program.statements.size();
+    return first;
+}
+
+// Nodes the parser made up (the 0 a one-argument range() starts at) have line 0
+// and keep it
+void IncrementalParser::shiftLines(CachedUnit& cached, int delta) {
+    if (cached.lines.empty()) {
+        m_walk.assign(cached.statements, cached.statements + cached.count);
+        while (!m_walk.empty()) {
+            ASTNode* node = m_walk.back();
+            m_walk.pop_back();
+            int* line = nullptr;
+            switch (node->kind) {
+            case NodeKind::NUMBER:     line = &static_cast<NumberNode*>(node)->line; break;
+            case NodeKind::STRING:     line = &static_cast<StringNode*>(node)->line; break;
+            case NodeKind::IDENTIFIER: line = &static_cast<IdentifierNode*>(node)->line; break;
+            case NodeKind::UNARY_OP:   line = &static_cast<UnaryOpNode*>(node)->line; break;
+            case NodeKind::BINARY_OP:  line = &static_cast<BinaryOpNode*>(node)->line; break;
+            default: break; // Cached units have no ErrorNodes
+            }
+            if (line && *line != 0) cached.lines.push_back(line);
+            forEachChild(node, [this](ASTNode* child) {
+                if (child) m_walk.push_back(child);
+            });
+        }
+    }
+    for (int* line : cached.lines) *line += delta;
+}
@@ -0,0 +1,97 @@
+#ifndef INCREMENTAL_PARSER_H
+#define INCREMENTAL_PARSER_H
+
+#include "parser.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Keeps the tree of the editor contents between live checks. The tokens are cut
+// into units at every line that starts outside all blocks (other than an elif,
+// else or except line), so a unit is a def or another compound statement with
+// all its blocks, or a top-level simple statement. Each unit is keyed by a hash
+// of its text plus the two tokens after it, which is all its parse can look at.
+// A unit whose key, text and next two tokens the last tree had gets its old
+// subtrees back (their lines moved if the unit did); the parser only runs
+// between those, i.e. over the units the edit damaged.
+class IncrementalParser : private StatementCache {
+public:
+    // Parse with error recovery (see Parser::setErrorRecovery). The tree stays
+    // valid until the next update(). Reused nodes keep the determined_type the
+    // analyzer last gave them; it sets a node's type before reading it.
+    ProgramNode* update(const TokenBuffer& tokens, SourceView source);
+    const vector<Diagnostic>& diagnostics() const { return m_diagnostics; }
+
+    // Units the last update() took from the cache / had parsed (for profiling)
+    int lastReusedUnits() const { return m_last_reused; }
+    int lastParsedUnits() const { return m_units.empty() ? 0 : int(m_units.size()) - 1 - m_last_reused; }
+
+    // The next update() parses everything into a fresh tree
+    void invalidate();
+
+private:
+    struct Unit {
+        int first;  // Token index
+        int offset; // Start of its first line in the source
+    };
+    struct CachedUnit {
+        size_t key;
+        ASTNode** statements; // In the program's arena
+        int count;
+        int line;   // Of the unit's first token now
+        // Checked on a key match, so a hash collision costs a parse, never a
+        // wrong subtree: the unit's source bytes, its token count and the
+        // kinds of the two tokens after it
+        string text;
+        int tokens;
+        TokenType next;
+        TokenType after;
+        bool reused; // Taken by the current update()
+        vector<int*> lines; // Line fields of every node below, found the first time the unit moves
+    };
+
+    // Replaced subtrees are left in the program's arena; once it holds twice what
+    // a fresh parse used (plus this much), the next update() starts over
+    static constexpr size_t COMPACT_SLACK = 256 * 1024;
+
+    unique_ptr<ProgramNode> m_program;
+    size_t m_fresh_bytes = 0;
+    // The units of the last tree in text order, so lookups for an unchanged
+    // script walk them in order, and an open-addressing index over their keys
+    // (entry + 1 per slot, 0 = empty). Rebuilt by every update() from the units
+    // it kept, so units that left the text are dropped.
+    vector<CachedUnit> m_cache;
+    vector<CachedUnit> m_kept;
+    vector<int> m_index;
+    vector<Diagnostic> m_diagnostics;
+    int m_last_reused = 0;
+
+    // State of the current update()
+    const TokenBuffer* m_tokens = nullptr;
+    SourceView m_source;
+    vector<Unit> m_units; // Then the END_OF_FILE token and the source length
+    int m_cursor = 0; // First unit not behind the parser
+    int m_line_hint = -1;
+    int m_open = -1;  // Unit being parsed, cached if it ends cleanly at the next one
+    size_t m_open_key = 0;
+    int m_open_errors = 0;
+    int m_open_statements = 0;
+    vector<ASTNode*> m_walk;
+
+    void findUnits();
+    string_view textOf(int unit) const;
+    TokenType kindAfter(int unit, int skip) const;
+    size_t keyOf(int unit) const;
+    CachedUnit* find(size_t key, int unit);
+    void buildIndex();
+    void store(int unit, ProgramNode& program);
+    void shiftLines(CachedUnit& cached, int delta);
+
+    int statementStart(int first, ProgramNode& program, int errors) override;
+};
+
+#endif // INCREMENTAL_PARSER_H
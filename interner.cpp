@@ -0,0 +1,182 @@
+#include "interner.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// FNV-1a over code points, so both encodings of a name hash alike
+constexpr uint32_t FNV_BASIS = 2166136261u;
+constexpr uint32_t FNV_PRIME = 16777619u;
+
+struct Utf16Key {
+    const char16_t* units;
+    int length;
+
+    uint32_t hash() const {
+        uint32_t h = FNV_BASIS;
+        for (int i = 0; i < length; ++i) {
+            char32_t c = units[i];
+            if (c >= 0xD800 && c < 0xDC00 && i + 1 < length && units[i + 1] >= 0xDC00 && units[i + 1] < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (units[++i] - 0xDC00);
+            }
+            h = (h ^ c) * FNV_PRIME;
+        }
+        return h;
+    }
+    bool equals(const QString& name) const {
+        return name.size() == length && memcmp(name.constData(), units, size_t(length) * sizeof(char16_t)) == 0;
+    }
+    QString toString() const { return QString(reinterpret_cast<const QChar*>(units), length); }
+};
+
+struct Utf8Key {
+    const unsigned char* bytes;
+    int size;
+    mutable bool ascii = true; // Found out by hash(), which always runs first
+
+    // Malformed sequences decode to U+FFFD one byte at a time
+    char32_t decode(int* i) const {
+        const char32_t lead = bytes[(*i)++];
+        int extra;
+        char32_t c;
+        if (lead < 0x80) return lead;
+        if (lead >= 0xF8 || lead < 0xC2) return 0xFFFD;
+        if (lead >= 0xF0) { extra = 3; c = lead & 0x07; }
+        else if (lead >= 0xE0) { extra = 2; c = lead & 0x0F; }
+        else { extra = 1; c = lead & 0x1F; }
+        if (*i + extra > size) return 0xFFFD;
+        for (int k = 0; k < extra; ++k) {
+            if ((bytes[*i + k] & 0xC0) != 0x80) return 0xFFFD;
+            c = (c << 6) | (bytes[*i + k] & 0x3F);
+        }
+        *i += extra;
+        return c;
+    }
+    uint32_t hash() const {
+        uint32_t h = FNV_BASIS;
+        for (int i = 0; i < size;) {
+            const char32_t c = decode(&i);
+            if (c >= 0x80) ascii = false;
+            h = (h ^ c) * FNV_PRIME;
+        }
+        return h;
+    }
+    bool equals(const QString& name) const {
+        const char16_t* units = reinterpret_cast<const char16_t*>(name.constData());
+        const int length = int(name.size());
+        if (ascii) {
+            if (length != size) return false;
+            for (int i = 0; i < size; ++i) {
+                if (units[i] != bytes[i]) return false;
+            }
+            return true;
+        }
+        int u = 0;
+        for (int i = 0; i < size;) {
+            char32_t c = decode(&i);
+            if (c >= 0x10000) {
+                c -= 0x10000;
+                if (u + 1 >= length || units[u] != 0xD800 + (c >> 10) || units[u + 1] != 0xDC00 + (c & 0x3FF)) return false;
+                u += 2;
+            } else if (u >= length || units[u++] != c) {
+                return false;
+            }
+        }
+        return u == length;
+    }
+    QString toString() const {
+        const char* data = reinterpret_cast<const char*>(bytes);
+        return ascii ? QString::fromLatin1(data, size) : QString::fromUtf8(data, size);
+    }
+};
+
+} // namespace
+
+Interner::Interner() {
+    for (Shard& shard : m_shards) shard.slots.assign(64, 0);
+    for (atomic<Entry*>& page : m_pages) page.store(nullptr, memory_order_relaxed);
+    add(QString(), FNV_BASIS); // SymbolId 0
+}
+
+Interner::~Interner() {
+    for (atomic<Entry*>& page : m_pages) delete[] page.load(memory_order_relaxed);
+}
+
+Interner& Interner::global() {
+    static Interner interner;
+    return interner;
+}
+
+SymbolId Interner::intern(const char16_t* units, int length, Cache* cache) {
+    if (length <= 0) return 0;
+    const Utf16Key key{units, length};
+    return find(key, key.hash(), cache);
+}
+
+SymbolId Interner::intern(const char* utf8, int size, Cache* cache) {
+    if (size <= 0) return 0;
+    const Utf8Key key{reinterpret_cast<const unsigned char*>(utf8), size};
+    return find(key, key.hash(), cache);
+}
+
+template <typename Key>
+SymbolId Interner::find(const Key& key, uint32_t hash, Cache* cache) {
+    Cache::Slot* slot = cache ? &cache->slots[hash & 255] : nullptr;
+    if (slot && slot->id != 0 && slot->hash == hash && key.equals(name(slot->id))) return slot->id;
+
+    Shard& shard = m_shards[hash >> (32 - SHARD_BITS)];
+    SymbolId id = 0;
+    {
+        lock_guard<mutex> guard(shard.lock);
+        size_t mask = shard.slots.size() - 1;
+        size_t i = hash & mask;
+        for (; shard.slots[i] != 0; i = (i + 1) & mask) {
+            const Entry& e = entry(shard.slots[i]);
+            if (e.hash == hash && key.equals(e.name)) {
+                id = shard.slots[i];
+                break;
+            }
+        }
+
+        if (id == 0) {
+            id = add(key.toString(), hash);
+            shard.slots[i] = id;
+            if (++shard.used * 2 > int(shard.slots.size())) {
+                // Keep the load under one half; entries carry their hash, so no rehashing
+                vector<SymbolId> slots(shard.slots.size() * 2, 0);
+                mask = slots.size() - 1;
+                for (SymbolId old : shard.slots) {
+                    if (old == 0) continue;
+                    size_t j = entry(old).hash & mask;
+                    while (slots[j] != 0) j = (j + 1) & mask;
+                    slots[j] = old;
+                }
+                shard.slots.swap(slots);
+            }
+        }
+    }
+    if (slot) *slot = {hash, id};
+    return id;
+}
+
+SymbolId Interner::add(QString name, uint32_t hash) {
+    const SymbolId id = m_count.fetch_add(1, memory_order_acq_rel);
+    if (id >= uint32_t(PAGES) << PAGE_BITS) {
+        throw runtime_error("Too many distinct identifiers");
+    }
+
+    atomic<Entry*>& page = m_pages[id >> PAGE_BITS];
+    Entry* entries = page.load(memory_order_acquire);
+    if (!entries) {
+        lock_guard<mutex> guard(m_page_lock);
+        entries = page.load(memory_order_acquire);
+        if (!entries) {
+            entries = new Entry[1 << PAGE_BITS];
+            page.store(entries, memory_order_release);
+        }
+    }
+    entries[id & ((1 << PAGE_BITS) - 1)] = {std::move(name), hash};
+    return id;
+}
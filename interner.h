@@ -0,0 +1,86 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <QLatin1String>
+#include <QString>
+#include <QStringView>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// Dense ID of an interned identifier. 0 is the empty name, which doubles as
+// "no symbol" for tokens that are not identifiers.
+using SymbolId = uint32_t;
+
+// Maps every identifier spelling to a SymbolId, so the stages after the lexer
+// compare and hash integers instead of strings. A name gets the same ID whether
+// it was lexed from UTF-16 text or from UTF-8 bytes (the hash runs over code points).
+//
+// Safe to share between threads: interning locks one of SHARDS tables, picked
+// by hash, and name() takes no lock at all since entries never move once written.
+// Names are never removed; a session only ever sees a bounded set of them.
+class Interner {
+public:
+    // Per-lexer front cache: repeated names are found without taking a lock
+    struct Cache {
+        struct Slot {
+            uint32_t hash = 0;
+            SymbolId id = 0;
+        };
+        Slot slots[256];
+    };
+
+    Interner();
+    ~Interner();
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    // The one table every stage shares; IDs from it are valid process-wide
+    static Interner& global();
+
+    SymbolId intern(const char16_t* units, int length, Cache* cache = nullptr);
+    SymbolId intern(const char* utf8, int size, Cache* cache = nullptr);
+    SymbolId intern(QStringView name) { return intern(reinterpret_cast<const char16_t*>(name.data()), int(name.size())); }
+    SymbolId intern(QLatin1String asciiName) { return intern(asciiName.data(), int(asciiName.size())); }
+
+    const QString& name(SymbolId id) const { return entry(id).name; }
+    int size() const { return int(m_count.load(memory_order_acquire)); }
+
+private:
+    struct Entry {
+        QString name;
+        uint32_t hash;
+    };
+    struct Shard {
+        mutex lock;
+        vector<SymbolId> slots; // Open addressing, 0 = empty
+        int used = 0;
+    };
+
+    static constexpr int SHARD_BITS = 6;
+    static constexpr int SHARDS = 1 << SHARD_BITS;
+    static constexpr int PAGE_BITS = 12;
+    static constexpr int PAGES = 1 << 12; // At most PAGES << PAGE_BITS names
+
+    Shard m_shards[SHARDS];
+    atomic<Entry*> m_pages[PAGES];
+    atomic<uint32_t> m_count{0};
+    mutex m_page_lock;
+
+    const Entry& entry(SymbolId id) const {
+        return m_pages[id >> PAGE_BITS].load(memory_order_acquire)[id & ((1 << PAGE_BITS) - 1)];
+    }
+    template <typename Key> SymbolId find(const Key& key, uint32_t hash, Cache* cache);
+    SymbolId add(QString name, uint32_t hash);
+};
+
+// Names the compiler itself refers to (built-ins, the "range" form of for).
+// Interning a name that already exists just finds it.
+inline SymbolId symbolOf(const char* asciiName) {
+    return Interner::global().intern(QLatin1String(asciiName));
+}
+
+#endif // INTERNER_H
@@ -0,0 +1,74 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include "token.h"
+#include <QChar>
+
+// Reserved words of the source language, classified with a perfect hash.
+// The slot function below is collision-free for this exact set (checked by the
+// static_assert), so recognizing a word costs one table probe and at most one
+// short compare instead of a chain of string comparisons.
+
+struct Keyword {
+    const char* spelling;
+    int length;
+    TokenType type;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"def", 3, TokenType::DEF},       {"if", 2, TokenType::IF},
+    {"while", 5, TokenType::WHILE},   {"else", 4, TokenType::ELSE},
+    {"elif", 4, TokenType::ELIF},     {"return", 6, TokenType::RETURN},
+    {"print", 5, TokenType::PRINT},   {"not", 3, TokenType::NOT},
+    {"or", 2, TokenType::OR},         {"None", 4, TokenType::NONE},
+    {"True", 4, TokenType::TRUE},     {"False", 5, TokenType::FALSE},
+    {"try", 3, TokenType::TRY},       {"except", 6, TokenType::EXCEPT},
+    {"for", 3, TokenType::FOR},       {"in", 2, TokenType::IN},
+    {"and", 3, TokenType::AND},
+};
+
+constexpr int KEYWORD_MIN_LENGTH = 2;
+constexpr int KEYWORD_MAX_LENGTH = 6;
+constexpr int KEYWORD_SLOTS = 32;
+
+// Keyed on length plus first and last character ("else"/"elif" share the first two)
+constexpr int keywordSlot(int length, char16_t first, char16_t last) {
+    return (length * 11 + first * 2 + last) & (KEYWORD_SLOTS - 1);
+}
+
+struct KeywordTable {
+    Keyword slots[KEYWORD_SLOTS] = {};
+    bool perfect = true;
+};
+
+constexpr KeywordTable buildKeywordTable() {
+    KeywordTable table;
+    for (const Keyword& k : KEYWORDS) {
+        Keyword& slot = table.slots[keywordSlot(k.length, k.spelling[0], k.spelling[k.length - 1])];
+        if (slot.length != 0) table.perfect = false;
+        slot = k;
+    }
+    return table;
+}
+
+constexpr KeywordTable KEYWORD_TABLE = buildKeywordTable();
+static_assert(KEYWORD_TABLE.perfect, "Keyword hash has a collision, pick new slot constants");
+
+inline char16_t codeUnit(QChar c) { return c.unicode(); }
+inline char16_t codeUnit(char16_t c) { return c; }
+inline char16_t codeUnit(char c) { return static_cast<unsigned char>(c); }
+
+// Returns the keyword type for the word, or IDENTIFIER if it is not reserved
+template <typename Char>
+inline TokenType lookupKeyword(const Char* word, int length) {
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) return TokenType::IDENTIFIER;
+
+    const Keyword& k = KEYWORD_TABLE.slots[keywordSlot(length, codeUnit(word[0]), codeUnit(word[length - 1]))];
+    if (k.length != length) return TokenType::IDENTIFIER;
+    for (int i = 0; i < length; ++i) {
+        if (codeUnit(word[i]) != codeUnit(k.spelling[i])) return TokenType::IDENTIFIER;
+    }
+    return k.type;
+}
+
+#endif // KEYWORDS_H
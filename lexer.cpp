@@ -1,64 +1,304 @@
 #include "lexer.h"
+#include "keywords.h"
+#include "lexer_dfa.h"
 #include <QChar>
+#include <algorithm>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
 using namespace std;
 
-Lexer::Lexer(const QString& source) : m_source(source) {
-    m_indent_stack.push(0);
+static LexerEngine s_default_engine = LexerEngine::Table;
+
+void Lexer::setDefaultEngine(LexerEngine engine) {
+    s_default_engine = engine;
+}
+
+LexerEngine Lexer::defaultEngine() {
+    return s_default_engine;
+}
+
+Lexer::Lexer(const QString& source)
+    : m_source(source), m_units(reinterpret_cast<const char16_t*>(m_source.constData())),
+      m_length(m_source.length()), m_scan(scanKernels()), m_engine(s_default_engine) {
+    m_indent_stack.push_back(0);
+}
+
+Lexer::Lexer(const QString& source, int pos, int line, const vector<int>& indents)
+    : m_source(source), m_units(reinterpret_cast<const char16_t*>(m_source.constData())),
+      m_length(m_source.length()), m_pos(pos), m_line(line), m_indent_stack(indents),
+      m_scan(scanKernels()), m_engine(s_default_engine) {
+}
+
+Lexer::Lexer(const char* utf8, int size)
+    : m_bytes(utf8), m_length(size), m_scan(scanKernels()), m_engine(s_default_engine) {
+    m_indent_stack.push_back(0);
 }
 
-vector<Token> Lexer::tokenize() {
-    vector<Token> tokens;
-    bool at_start_of_line = true; // Flag to track if we need to check indentation
+SourceView Lexer::source() const {
+    if (m_bytes) return SourceView(m_bytes, m_length);
+    return SourceView(m_source);
+}
+
+// Runs task(i) for every i < count on its own thread; the caller takes i = 0
+template <typename Task>
+static void runInParallel(int count, Task task) {
+    vector<thread> workers;
+    for (int i = 1; i < count; ++i) workers.emplace_back(task, i);
+    task(0);
+    for (thread& worker : workers) worker.join();
+}
+
+TokenBuffer Lexer::tokenize(int threads) {
+    Result<TokenBuffer> tokens = tryTokenize(threads);
+    if (!tokens) throw runtime_error(tokens.error().message);
+    return std::move(tokens.value());
+}
+
+Result<TokenBuffer> Lexer::tryTokenize(int threads) {
+    if (threads <= 0) threads = max(1, int(thread::hardware_concurrency()));
+    const int chunkCount = min(threads, m_length / (PARALLEL_MIN_UNITS / 2));
+    const bool fresh = m_pos == 0 && m_at_line_start && m_indent_stack.size() == 1 && !m_listener;
+
+    if (chunkCount < 2 || !fresh) {
+        TokenBuffer tokens;
+        tokens.reserve(m_length / 4); // Typical scripts average a few units per token
+        Token token;
+        do {
+            token = next();
+            tokens.push_back(token);
+        } while (token.type != TokenType::END_OF_FILE);
+        if (m_failed) return m_error;
+        return tokens;
+    }
+
+    // Cut just after a newline near each 1/n of the source. Whether that is really
+    // a line start (and not inside a string) is only known once the previous chunk
+    // is lexed; resolveLayout() checks it.
+    vector<Chunk> chunks(chunkCount);
+    int start = 0;
+    for (int i = 0; i < chunkCount; ++i) {
+        int stop = m_length;
+        if (i + 1 < chunkCount) {
+            const int target = max(start, int(qint64(m_length) * (i + 1) / chunkCount));
+            stop = m_bytes ? m_scan.newline8(m_bytes, target, m_length) : m_scan.newline(m_units, target, m_length);
+            stop = min(stop + 1, m_length);
+        }
+        chunks[i].start = start;
+        chunks[i].stop = stop;
+        start = stop;
+    }
+
+    runInParallel(chunkCount, [this, &chunks](int i) { lexChunk(chunks[i]); });
+    TokenBuffer tail;
+    resolveLayout(chunks, tail);
+    if (m_failed) return m_error;
+
+    // Every chunk now knows its final size, so each writes its own slice of the
+    // result; only the (much shorter) line tables are joined afterwards
+    vector<int> first(chunkCount + 1, 0);
+    for (int i = 0; i < chunkCount; ++i) first[i + 1] = first[i] + chunks[i].tokens.size() + chunks[i].layout.size();
+    TokenBuffer tokens;
+    tokens.reserve(first[chunkCount] + tail.size());
+    tokens.m_kinds.resize(first[chunkCount]);
+    tokens.m_offsets.resize(first[chunkCount]);
+    tokens.m_lengths.resize(first[chunkCount]);
+    tokens.m_symbols.resize(first[chunkCount]);
+    vector<vector<TokenBuffer::LineRun>> runs(chunkCount);
+    runInParallel(chunkCount, [&](int i) { writeChunk(chunks[i], tokens, first[i], runs[i]); });
+
+    for (const vector<TokenBuffer::LineRun>& part : runs) {
+        for (const TokenBuffer::LineRun& run : part) TokenBuffer::appendRun(tokens.m_lines, run.firstToken, run.line);
+    }
+    for (int i = 0; i < tail.size(); ++i) tokens.push_back(tail[i]);
+    return tokens;
+}
+
+void Lexer::lexChunk(Chunk& chunk) const {
+    Lexer lexer(*this);
+    lexer.m_pos = chunk.start;
+    lexer.m_line = 1;
+    lexer.m_indent_stack.assign(1, 0);
+    lexer.m_at_line_start = true;
+    lexer.m_pending_dedents = 0;
+    lexer.m_listener = nullptr;
+    lexer.m_marks = &chunk.marks;
+    lexer.m_stop = chunk.stop;
+
+    chunk.tokens.clear();
+    chunk.tokens.reserve((chunk.stop - chunk.start) / 4);
+    chunk.marks.clear();
+    size_t marked = 0;
+    for (Token token = lexer.next(); token.type != TokenType::END_OF_FILE; token = lexer.next()) {
+        for (; marked < chunk.marks.size(); ++marked) chunk.marks[marked].token = chunk.tokens.size();
+        chunk.tokens.push_back(token);
+    }
+    for (; marked < chunk.marks.size(); ++marked) chunk.marks[marked].token = chunk.tokens.size();
+    chunk.end = lexer.m_pos;
+    chunk.endLine = lexer.m_line;
+}
+
+// The sequential part of tokenize(): checks every cut, then runs the indent stack
+// over the line marks in source order. Layout tokens keep chunk-relative lines
+// like the rest of the chunk; 'tail' gets the closing DEDENTs and END_OF_FILE.
+void Lexer::resolveLayout(vector<Chunk>& chunks, TokenBuffer& tail) {
+    vector<int> indents(1, 0);
+    int pos = 0;
+    int lineBase = 0;
+    for (Chunk& chunk : chunks) {
+        if (chunk.start != pos) {
+            // A token of the previous chunk (a string spanning lines) ran past the
+            // cut, so this chunk began mid-token. Redo it from the real line start.
+            if (pos >= chunk.stop) {
+                chunk.tokens.clear();
+                continue;
+            }
+            chunk.start = pos;
+            lexChunk(chunk);
+        }
+        chunk.lineBase = lineBase;
+
+        for (const LineMark& mark : chunk.marks) {
+            if (mark.indent > indents.back()) {
+                indents.push_back(mark.indent);
+                chunk.layout.push_back({mark.token, {TokenType::INDENT, mark.pos, 0, mark.line}});
+            } else if (mark.indent < indents.back()) {
+                while (mark.indent < indents.back() && indents.size() > 1) {
+                    indents.pop_back();
+                    chunk.layout.push_back({mark.token, {TokenType::DEDENT, mark.pos, 0, mark.line}});
+                }
+                if (mark.indent != indents.back()) {
+                    indentationError(mark.pos, lineBase + mark.line);
+                    return;
+                }
+            }
+        }
+        pos = chunk.end;
+        lineBase += chunk.endLine - 1;
+    }
+
+    // Leave this lexer exhausted, as the sequential loop would
+    m_pos = pos;
+    m_line = lineBase + 1;
+    m_at_line_start = false;
+    m_indent_stack.assign(1, 0);
+    for (size_t i = 1; i < indents.size(); ++i) tail.push_back({TokenType::DEDENT, m_pos, 0, m_line});
+    tail.push_back({TokenType::END_OF_FILE, m_pos, 0, m_line});
+}
+
+// Copies a chunk's tokens to out[first...] with its layout tokens in between,
+// collecting the line runs of that slice in absolute lines
+void Lexer::writeChunk(const Chunk& chunk, TokenBuffer& out, int first, vector<TokenBuffer::LineRun>& runs) {
+    const TokenBuffer& in = chunk.tokens;
+    const vector<TokenBuffer::LineRun>& inRuns = in.m_lines;
+    runs.reserve(inRuns.size() + chunk.layout.size());
+    size_t run = 0; // Line run of in[copied]
+    int copied = 0;
+    int at = first;
+
+    auto copyUpTo = [&](int last) {
+        if (copied >= last) return;
+        copy(in.m_kinds.begin() + copied, in.m_kinds.begin() + last, out.m_kinds.begin() + at);
+        copy(in.m_offsets.begin() + copied, in.m_offsets.begin() + last, out.m_offsets.begin() + at);
+        copy(in.m_lengths.begin() + copied, in.m_lengths.begin() + last, out.m_lengths.begin() + at);
+        copy(in.m_symbols.begin() + copied, in.m_symbols.begin() + last, out.m_symbols.begin() + at);
+        while (run + 1 < inRuns.size() && int(inRuns[run + 1].firstToken) <= copied) run++;
+        TokenBuffer::appendRun(runs, at, inRuns[run].line + chunk.lineBase);
+        for (; run + 1 < inRuns.size() && int(inRuns[run + 1].firstToken) < last; ++run) {
+            TokenBuffer::appendRun(runs, at + inRuns[run + 1].firstToken - copied, inRuns[run + 1].line + chunk.lineBase);
+        }
+        at += last - copied;
+        copied = last;
+    };
+
+    for (const auto& [index, token] : chunk.layout) {
+        copyUpTo(index);
+        out.m_kinds[at] = uint8_t(token.type);
+        out.m_offsets[at] = uint32_t(token.offset);
+        out.m_lengths[at] = 0;
+        out.m_symbols[at] = 0;
+        TokenBuffer::appendRun(runs, at, token.line + chunk.lineBase);
+        at++;
+    }
+    copyUpTo(in.size());
+}
+
+// Records the error and leaves the lexer exhausted, so next() goes on with END_OF_FILE
+void Lexer::indentationError(int pos, int line) {
+    m_failed = true;
+    m_error = {{line, source().columnOf(pos), 0}, DiagnosticCode::INDENTATION,
+               "Indentation error at line " + to_string(line)};
+    m_pos = m_length;
+    m_line = line;
+    m_at_line_start = false;
+    m_pending_dedents = 0;
+    m_indent_stack.assign(1, 0);
+}
+
+Token Lexer::next() {
+    while (true) {
+        // DEDENTs decided at the start of a line are handed out one per call
+        if (m_pending_dedents > 0) {
+            m_pending_dedents--;
+            return {TokenType::DEDENT, m_pos, 0, m_line};
+        }
+
+        if (m_pos >= m_length) break;
 
-    while (m_pos < m_source.length()) {
         // --- 1. Indentation Handling  ---
         // We only check indentation at the very beginning of a line.
-        if (at_start_of_line) {
-            at_start_of_line = false; // We are now inside the line
+        if (m_at_line_start) {
+            if (m_marks && m_pos >= m_stop) break; // End of a chunk (see tokenize())
+            if (m_listener) m_listener->lineStart(m_pos, m_line, m_indent_stack);
+            m_at_line_start = false; // We are now inside the line
             int current_indent = getCurrentIndent();
 
             // Ignore blank lines (pure whitespace or just newlines)
-            if (m_pos >= m_source.length() || currentChar() == '\n') {
+            if (m_pos >= m_length || currentChar() == '\n') {
                 if (currentChar() == '\n') {
                     m_line++;
                     advance();
-                    at_start_of_line = true; // Next char starts a new line
+                    m_at_line_start = true; // Next char starts a new line
                 }
                 continue;
             }
 
+            // Chunk lexers leave both cases to resolveLayout()
+            if (m_marks) {
+                m_marks->push_back({0, m_pos, m_line, current_indent});
+            }
             // Case A: Indentation Increased (Opening a Block)
             // Example: 'if x:' -> next line has more spaces
-            if (current_indent > m_indent_stack.top()) {
-                m_indent_stack.push(current_indent);
-                tokens.push_back({TokenType::INDENT, "INDENT", m_line});
+            else if (current_indent > m_indent_stack.back()) {
+                m_indent_stack.push_back(current_indent);
+                return {TokenType::INDENT, m_pos, 0, m_line};
             }
             // Case B: Indentation Decreased (Closing Block(s))
             // Example: End of 'if' block, going back to main scope
-            else if (current_indent < m_indent_stack.top()) {
+            else if (current_indent < m_indent_stack.back()) {
                 // We might be closing multiple nested blocks at once, so we loop/pop
-                while (current_indent < m_indent_stack.top() && m_indent_stack.size() > 1) {
-                    m_indent_stack.pop();
-                    tokens.push_back({TokenType::DEDENT, "DEDENT", m_line});
+                while (current_indent < m_indent_stack.back() && m_indent_stack.size() > 1) {
+                    m_indent_stack.pop_back();
+                    m_pending_dedents++;
                 }
 
                 // Validation: The new indent level MUST match a previous level in the stack
-                if (current_indent != m_indent_stack.top()) {
-                    throw runtime_error("Indentation error at line " + to_string(m_line));
+                if (current_indent != m_indent_stack.back()) {
+                    indentationError(m_pos, m_line);
+                    break;
                 }
+                continue;
             }
         }
 
         // --- 2. Standard Tokenization ---
         skipWhitespace(); // Ignore spaces between tokens (e.g., x = 5)
-        if (m_pos >= m_source.length()) break;
+        if (m_pos >= m_length) break;
 
         // Handle Newlines (Reset the line flag)
         if (currentChar() == '\n') {
-            at_start_of_line = true;
+            m_at_line_start = true;
             m_line++;
             advance();
             continue;
@@ -71,24 +311,33 @@ vector<Token> Lexer::tokenize() {
         }
 
         // Identify the next token (Identifier, Number, Symbol, etc.)
-        tokens.push_back(getNextTokenFromSource());
+        return m_engine == LexerEngine::Table ? tableToken() : getNextTokenFromSource();
     }
 
-
     // Implicitly close any blocks that are still open at EOF
-    while (m_indent_stack.top() > 0) {
-        m_indent_stack.pop();
-        tokens.push_back({TokenType::DEDENT, "DEDENT", m_line});
+    if (m_indent_stack.back() > 0) {
+        m_indent_stack.pop_back();
+        return {TokenType::DEDENT, m_pos, 0, m_line};
     }
 
-    tokens.push_back({TokenType::END_OF_FILE, "EOF", m_line});
-    return tokens;
+    // Once the input is exhausted every further call keeps returning EOF
+    return {TokenType::END_OF_FILE, m_pos, 0, m_line};
 }
 
 Token Lexer::getNextTokenFromSource() {
-    if (m_pos >= m_source.length()) return {TokenType::END_OF_FILE, "", m_line};
+    if (m_pos >= m_length) return {TokenType::END_OF_FILE, m_pos, 0, m_line};
 
+    const int start = m_pos;
     QChar current = currentChar();
+    if (current.unicode() >= 0x80) {
+        // Outside ASCII the whole code point decides (one unit in UTF-16 mode)
+        int units = 1;
+        const char32_t c = codePoint(&units);
+        if (QChar::isLetter(c)) return identifier();
+        if (QChar::isDigit(c)) return number();
+        m_pos += units;
+        return makeToken(TokenType::ILLEGAL, start);
+    }
     if (current.isLetter() || current == '_') return identifier();
     if (current.isDigit()) return number();
     if (current == '"' || current == '\'') return string();
@@ -97,74 +346,94 @@ Token Lexer::getNextTokenFromSource() {
     case '=':
         if (peek() == '=') {
             advance(); advance();
-            return {TokenType::DOUBLE_EQUAL, "==", m_line};
+            return makeToken(TokenType::DOUBLE_EQUAL, start);
         }
         advance();
-        return {TokenType::EQUAL, "=", m_line};
+        return makeToken(TokenType::EQUAL, start);
+
+    case '!':
+        if (peek() == '=') {
+            advance(); advance();
+            return makeToken(TokenType::NOT_EQUAL, start);
+        }
+        advance();
+        return makeToken(TokenType::ILLEGAL, start);
 
     case '>':
         if (peek() == '=') {
             advance(); advance();
-            return {TokenType::GREATER, ">=", m_line};
+            return makeToken(TokenType::GREATER_EQUAL, start);
         }
         advance();
-        return {TokenType::GREATER, ">", m_line};
+        return makeToken(TokenType::GREATER, start);
 
     case '<':
         if (peek() == '=') {
             advance(); advance();
-            return {TokenType::LESS_EQUAL, "<=", m_line};
+            return makeToken(TokenType::LESS_EQUAL, start);
         }
         advance();
-        return {TokenType::LESS_EQUAL, "<", m_line};
+        return makeToken(TokenType::LESS, start);
 
     case '+':
         advance();
-        return {TokenType::PLUS, "+", m_line};
+        return makeToken(TokenType::PLUS, start);
 
     case '-':
         advance();
-        return {TokenType::MINUS, "-", m_line};
+        return makeToken(TokenType::MINUS, start);
 
     case '*':
+        if (peek() == '*') {
+            advance(); advance();
+            return makeToken(TokenType::DOUBLE_STAR, start);
+        }
         advance();
-        return {TokenType::STAR, "*", m_line};
+        return makeToken(TokenType::STAR, start);
 
     case '/':
+        if (peek() == '/') {
+            advance(); advance();
+            return makeToken(TokenType::DOUBLE_SLASH, start);
+        }
         advance();
-        return {TokenType::SLASH, "/", m_line};
+        return makeToken(TokenType::SLASH, start);
+
+    case '%':
+        advance();
+        return makeToken(TokenType::PERCENT, start);
 
     case '(':
         advance();
-        return {TokenType::LPAREN, "(", m_line};
+        return makeToken(TokenType::LPAREN, start);
 
     case ')':
         advance();
-        return {TokenType::RPAREN, ")", m_line};
+        return makeToken(TokenType::RPAREN, start);
 
     case '{':
         advance();
-        return {TokenType::LBRACE, "{", m_line};
+        return makeToken(TokenType::LBRACE, start);
 
     case '}':
         advance();
-        return {TokenType::RBRACE, "}", m_line};
+        return makeToken(TokenType::RBRACE, start);
 
     case ':':
         advance();
-        return {TokenType::COLON, ":", m_line};
+        return makeToken(TokenType::COLON, start);
 
     case ',':
         advance();
-        return {TokenType::COMMA, ",", m_line};
+        return makeToken(TokenType::COMMA, start);
 
     case ';':
         advance();
-        return {TokenType::SEMICOLON, ";", m_line};
+        return makeToken(TokenType::SEMICOLON, start);
 
     case '.':
         advance();
-        return {TokenType::DOT, ".", m_line};
+        return makeToken(TokenType::DOT, start);
 
     case '#':
         skipComment();
@@ -172,64 +441,127 @@ Token Lexer::getNextTokenFromSource() {
 
     default:
         advance();
-        return {TokenType::ILLEGAL, QString(current), m_line};
+        return makeToken(TokenType::ILLEGAL, start);
     }
 }
 
-int Lexer::getCurrentIndent() {
-    int indent = 0;
-    while (m_pos < m_source.length() && (currentChar() == ' ' || currentChar() == '\t')) {
-        if (currentChar() == ' ') {
-            indent++;
-        } else if (currentChar() == '\t') {
-            indent += 4;
-        }
-        advance();
+// Runs the generated DFA from its start state until the next transition is dead.
+// One table load per unit and a single exit test: the spec is checked at compile
+// time to never need backing up to an earlier accepting state.
+template <typename Char>
+static int runLexerDfa(const Char* s, int pos, int end, int* state) {
+    int q = 0;
+    while (pos < end) {
+        const unsigned c = s[pos];
+        const int next = LEXER_DFA.next[q][LEXER_DFA.classOf[c < 0x80 ? c : lexer_dfa::NON_ASCII]];
+        if (next == LEXER_DFA.dead) break;
+        q = next;
+        pos++;
+    }
+    *state = q;
+    return pos;
+}
+
+Token Lexer::tableToken() {
+    const int start = m_pos;
+    int state = 0;
+    const int end = m_bytes ? runLexerDfa(reinterpret_cast<const unsigned char*>(m_bytes), m_pos, m_length, &state)
+                            : runLexerDfa(m_units, m_pos, m_length, &state);
+
+    // The table only knows ASCII: stopping on a non-ASCII unit may mean a Unicode
+    // letter or digit continues the token, so the hand-written code decides. The
+    // same goes for units no rule starts with (it produces ILLEGAL for those).
+    const int rule = LEXER_DFA.accept[state];
+    if (rule < 0 || (end < m_length && unit(end) >= 0x80)) return getNextTokenFromSource();
+
+    m_pos = end;
+    const TokenRule& spec = TOKEN_SPEC[rule];
+    TokenType type = spec.type;
+    SymbolId symbol = 0;
+    if (type == TokenType::IDENTIFIER) {
+        type = m_bytes ? lookupKeyword(m_bytes + start, end - start) : lookupKeyword(m_units + start, end - start);
+        if (type == TokenType::IDENTIFIER) symbol = intern(start, end - start);
     }
+    return {type, start + spec.trimStart, end - start - spec.trimStart - spec.trimEnd, m_line, symbol};
+}
+
+// The skip/scan helpers below hand whole runs to the vectorized kernels in
+// scanner.cpp instead of stepping through currentChar()/advance() one QChar at a time.
+
+int Lexer::getCurrentIndent() {
+    int indent = 0; // spaces count 1, tabs count 4
+    m_pos = m_bytes ? m_scan.indent8(m_bytes, m_pos, m_length, &indent)
+                    : m_scan.indent(m_units, m_pos, m_length, &indent);
     return indent;
 }
 
 void Lexer::skipComment() {
-    while (m_pos < m_source.length() && currentChar() != '\n') {
-        advance();
+    m_pos = m_bytes ? m_scan.newline8(m_bytes, m_pos, m_length)
+                    : m_scan.newline(m_units, m_pos, m_length);
+}
+
+// In UTF-8 mode currentChar() yields single bytes, so anything >= 0x80 has to be
+// decoded here before it can be classified. Malformed bytes come back as U+FFFD.
+char32_t Lexer::codePoint(int* units) const {
+    const char32_t lead = unit(m_pos);
+    *units = 1;
+    if (!m_bytes || lead < 0x80) return lead;
+
+    int extra = 0;
+    char32_t c = 0;
+    if (lead >= 0xF8)      return 0xFFFD;
+    else if (lead >= 0xF0) { extra = 3; c = lead & 0x07; }
+    else if (lead >= 0xE0) { extra = 2; c = lead & 0x0F; }
+    else if (lead >= 0xC2) { extra = 1; c = lead & 0x1F; }
+    else                   return 0xFFFD; // Stray continuation byte or overlong lead
+    if (m_pos + extra >= m_length) return 0xFFFD;
+
+    for (int i = 1; i <= extra; ++i) {
+        const char32_t next = unit(m_pos + i);
+        if ((next & 0xC0) != 0x80) return 0xFFFD;
+        c = (c << 6) | (next & 0x3F);
     }
+    *units = 1 + extra;
+    return c;
 }
 
 QChar Lexer::currentChar() {
-    if (m_pos >= m_source.length()) return '\0';
-    return m_source[m_pos];
+    if (m_pos >= m_length) return '\0';
+    return QChar(unit(m_pos));
 }
 
 QChar Lexer::peek() {
-    if (m_pos + 1 >= m_source.length()) return '\0';
-    return m_source[m_pos + 1];
+    if (m_pos + 1 >= m_length) return '\0';
+    return QChar(unit(m_pos + 1));
 }
 
 void Lexer::advance() {
-    if (m_pos < m_source.length()) m_pos++;
+    if (m_pos < m_length) m_pos++;
 }
 
 void Lexer::skipWhitespace() {
-    while (m_pos < m_source.length() && (currentChar() == ' ' || currentChar() == '\t' || currentChar() == '\r')) {
-        advance();
-    }
+    m_pos = m_bytes ? m_scan.blanks8(m_bytes, m_pos, m_length)
+                    : m_scan.blanks(m_units, m_pos, m_length);
 }
 
 
+Token Lexer::makeToken(TokenType type, int start) const {
+    return {type, start, m_pos - start, m_line};
+}
+
 Token Lexer::number() {
-    QString result;
+    const int start = m_pos;
     bool dot_seen = false; // Track if we've seen a decimal point
 
-    while (m_pos < m_source.length()) {
-        QChar c = currentChar();
+    while (m_pos < m_length) {
+        int units = 1;
+        const char32_t c = codePoint(&units);
 
-        if (c.isDigit()) {
-            result += c;
-            advance();
+        if (QChar::isDigit(c)) {
+            m_pos += units;
         } else if (c == '.') {
             if (dot_seen) break; // We already saw a dot, so 1.2.3 -> stop at second dot
             dot_seen = true;
-            result += c;
             advance();
         } else {
             break;
@@ -238,57 +570,56 @@ Token Lexer::number() {
 
     // Note: We still return TokenType::NUMBER.
     // We will distinguish Int vs Float in the Semantic Analyzer based on the presence of '.'
-    return {TokenType::NUMBER, result, m_line};
+    return makeToken(TokenType::NUMBER, start);
 }
 
 Token Lexer::string() {
-    QString result;
     QChar quote = currentChar();
     advance();
 
-    while (m_pos < m_source.length() && currentChar() != quote) {
+    // The span excludes the quotes; escapes are resolved later by Token::value()
+    const int start = m_pos;
+    while (m_pos < m_length && currentChar() != quote) {
         if (currentChar() == '\\') {
             advance();
-            if (m_pos < m_source.length()) {
-                result += currentChar();
-                advance();
-            }
-        } else {
-            result += currentChar();
-            advance();
         }
+        advance();
     }
+    Token token = makeToken(TokenType::STRING, start);
 
     if (currentChar() == quote) {
         advance();
     }
 
-    return {TokenType::STRING, result, m_line};
+    return token;
 }
 
 Token Lexer::identifier() {
-    QString result;
-    while (m_pos < m_source.length() && (currentChar().isLetterOrNumber() || currentChar() == '_')) {
-        result += currentChar();
-        advance();
+    const int start = m_pos;
+    const int end = m_length;
+    while (true) {
+        // ASCII runs go through the vector kernel; anything else is classified by QChar
+        m_pos = m_bytes ? m_scan.identifier8(m_bytes, m_pos, end) : m_scan.identifier(m_units, m_pos, end);
+        if (m_pos < end && unit(m_pos) >= 0x80) {
+            int units = 1;
+            if (QChar::isLetterOrNumber(codePoint(&units))) {
+                m_pos += units;
+                continue;
+            }
+        }
+        break;
     }
 
-    if (result == "def") return {TokenType::DEF, result, m_line};
-    if (result == "if") return {TokenType::IF, result, m_line};
-    if (result == "while") return {TokenType::WHILE, result, m_line};
-    if (result == "else") return {TokenType::ELSE, result, m_line};
-    if (result == "elif") return {TokenType::ELIF, result, m_line};
-    if (result == "return") return {TokenType::RETURN, result, m_line};
-    if (result == "print") return {TokenType::PRINT, result, m_line};
-    if (result == "not") return {TokenType::NOT, result, m_line};
-    if (result == "or") return {TokenType::OR, result, m_line};
-    if (result == "None") return {TokenType::NONE, result, m_line};
-    if (result == "True") return {TokenType::TRUE, result, m_line};
-    if (result == "False") return {TokenType::FALSE, result, m_line};
-    if (result == "try") return {TokenType::TRY, result, m_line};
-    if (result == "except") return {TokenType::EXCEPT, result, m_line};
-    if (result == "for")   return {TokenType::FOR, result, m_line};
-    if (result == "in")    return {TokenType::IN, result, m_line};
-
-    return {TokenType::IDENTIFIER, result, m_line};
+    // One perfect-hash probe decides keyword vs identifier (see keywords.h)
+    const TokenType type = m_bytes ? lookupKeyword(m_bytes + start, m_pos - start)
+                                   : lookupKeyword(m_units + start, m_pos - start);
+    Token token = makeToken(type, start);
+    if (type == TokenType::IDENTIFIER) token.symbol = intern(start, m_pos - start);
+    return token;
+}
+
+SymbolId Lexer::intern(int start, int length) {
+    Interner& names = Interner::global();
+    return m_bytes ? names.intern(m_bytes + start, length, &m_symbol_cache)
+                   : names.intern(m_units + start, length, &m_symbol_cache);
 }
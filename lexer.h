@@ -2,24 +2,111 @@
 #define LEXER_H
 
 #include "token.h"
+#include "token_buffer.h"
+#include "scanner.h"
+#include "diagnostic.h"
 #include <QString>
 #include <vector>
-#include <stack>
 
 using namespace std;
 
+// Notified every time the lexer reaches the start of a line, with the state
+// it would need to resume from there (see IncrementalLexer)
+class LineStartListener {
+public:
+    virtual ~LineStartListener() = default;
+    virtual void lineStart(int pos, int line, const vector<int>& indents) = 0;
+};
+
+// How tokens inside a line are recognized; layout (indentation, blanks, comments) is shared
+enum class LexerEngine {
+    HandWritten, // switch in getNextTokenFromSource() plus the SIMD scans
+    Table        // DFA generated at compile time from token_spec.h (lexer_dfa.h)
+};
+
 class Lexer {
 public:
     Lexer(const QString& source);
-    vector<Token> tokenize();
+    // Resume at a line start previously reported to a LineStartListener
+    Lexer(const QString& source, int pos, int line, const vector<int>& indents);
+    // Lex UTF-8 bytes in place (e.g. a SourceFile mapping); they must outlive the lexer.
+    // Token offsets are then byte offsets, and nothing is decoded until Token::value().
+    Lexer(const char* utf8, int size);
+
+    // Lex the whole source at once (used for the Tokens tab). Sources of at least
+    // PARALLEL_MIN_UNITS are cut at line starts and the pieces lexed on up to
+    // 'threads' threads (0 = one per core); the tokens are the same either way.
+    // Throws runtime_error on an indentation error; tryTokenize() returns it instead.
+    TokenBuffer tokenize(int threads = 0);
+    Result<TokenBuffer> tryTokenize(int threads = 0);
+    static constexpr int PARALLEL_MIN_UNITS = 1 << 19;
+
+    // Pull interface: returns one token per call, END_OF_FILE once exhausted.
+    // Only the indent stack is kept between calls, so memory does not grow with the script.
+    // It never throws: an indentation error is kept in error() and ends the input.
+    Token next();
+    const Diagnostic* error() const { return m_failed ? &m_error : nullptr; }
+
+    void setLineStartListener(LineStartListener* listener) { m_listener = listener; }
+
+    // Both engines produce identical tokens; the default is whichever benchmarks faster
+    void setEngine(LexerEngine engine) { m_engine = engine; }
+    static void setDefaultEngine(LexerEngine engine);
+    static LexerEngine defaultEngine();
+
+    // Tokens only carry spans; this is the buffer they point into
+    SourceView source() const;
 
 private:
-    QString m_source;
+    QString m_source;               // Keeps UTF-16 input alive (empty in UTF-8 mode)
+    const char16_t* m_units = nullptr;
+    const char* m_bytes = nullptr;  // Set only in UTF-8 mode
+    int m_length = 0;               // In code units of whichever buffer is used
     int m_pos = 0;
     int m_line = 1;
-    stack<int> m_indent_stack;
+    vector<int> m_indent_stack;
+    bool m_at_line_start = true; // Indentation is only measured at the start of a line
+    int m_pending_dedents = 0;   // A dedent can close several blocks at once
+    LineStartListener* m_listener = nullptr;
+    const ScanKernels& m_scan; // SIMD or scalar, picked once per process
+    LexerEngine m_engine;
+    Interner::Cache m_symbol_cache; // Identifiers are interned as they are lexed
+    bool m_failed = false;
+    Diagnostic m_error;
+
+    // Chunked lexing: a chunk lexer stops at the first line start at or after
+    // m_stop and, instead of keeping an indent stack, marks every line start
+    // where INDENT/DEDENT tokens may belong. resolveLayout() then decides them
+    // in one sequential pass over the marks.
+    struct LineMark {
+        int token;  // Index in the chunk's tokens of the first token after the mark
+        int pos;
+        int line;   // Relative to the chunk, whose first line is 1
+        int indent;
+    };
+    struct Chunk {
+        int start = 0;
+        int stop = 0;
+        int end = 0;      // Line start where the chunk lexer actually stopped
+        int endLine = 1;
+        int lineBase = 0; // Absolute line = lineBase + chunk line
+        TokenBuffer tokens;
+        vector<LineMark> marks;
+        vector<pair<int, Token>> layout; // INDENT/DEDENT to insert before a chunk token
+    };
+    vector<LineMark>* m_marks = nullptr;
+    int m_stop = 0;
+
+    void lexChunk(Chunk& chunk) const;
+    void resolveLayout(vector<Chunk>& chunks, TokenBuffer& tail);
+    static void writeChunk(const Chunk& chunk, TokenBuffer& out, int first, vector<TokenBuffer::LineRun>& runs);
 
+    Q_DECL_COLD_FUNCTION void indentationError(int pos, int line);
     Token getNextTokenFromSource();
+    Token tableToken();
+    Token makeToken(TokenType type, int start) const;
+    char16_t unit(int pos) const { return m_bytes ? static_cast<unsigned char>(m_bytes[pos]) : m_units[pos]; }
+    char32_t codePoint(int* units) const;
     void advance();
     QChar currentChar();
     QChar peek();
@@ -28,6 +115,7 @@ private:
     Token number();
     Token string();
     Token identifier();
+    SymbolId intern(int start, int length);
     int getCurrentIndent();
 };
 
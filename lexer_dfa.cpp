@@ -0,0 +1,66 @@
+#include "lexer_dfa.h"
+#include <QStringList>
+
+using namespace lexer_dfa;
+
+static QString symbolName(int c) {
+    if (c == NON_ASCII) return "non-ASCII";
+    if (c == '\n') return "\\n";
+    if (c == '\t') return "\\t";
+    if (c == '\r') return "\\r";
+    if (c == ' ') return "' '";
+    if (c < 0x20 || c == 0x7F) return QString("\\x%1").arg(c, 2, 16, QChar('0'));
+    return QString(QChar(c));
+}
+
+// Members of a class, with runs of consecutive units collapsed to ranges
+static QString classMembers(int k) {
+    QStringList parts;
+    for (int c = 0; c < SYMBOLS; ++c) {
+        if (LEXER_DFA.classOf[c] != k) continue;
+        int last = c;
+        while (last + 1 < NON_ASCII && LEXER_DFA.classOf[last + 1] == k) last++;
+        parts << (last > c + 1 ? symbolName(c) + "-" + symbolName(last) : symbolName(c));
+        if (last == c + 1) parts << symbolName(last);
+        c = last;
+    }
+    return parts.join(" ");
+}
+
+QString describeLexerDfa() {
+    QString text;
+    text += "==============================================================================\n";
+    text += "LEXICAL AUTOMATON (generated from token_spec.h at compile time)\n";
+    text += "==============================================================================\n\n";
+
+    text += "[ Token Rules ]  (longest match; on a tie the earlier rule wins)\n";
+    for (int r = 0; r < TOKEN_RULE_COUNT; ++r) {
+        text += QString("   r%1  %2\n").arg(r, -3).arg(TOKEN_SPEC[r].pattern);
+    }
+    text += "   Keywords are IDENTIFIER matches looked up in keywords.h.\n\n";
+
+    text += QString("[ Byte Equivalence Classes ]  (%1 classes)\n").arg(LEXER_DFA.classCount);
+    for (int k = 0; k < LEXER_DFA.classCount; ++k) {
+        text += QString("   c%1 = { %2 }\n").arg(k, -3).arg(classMembers(k));
+    }
+
+    text += QString("\n[ Minimized Transition Table ]  (%1 states, start q0, '.' = no transition)\n")
+                .arg(LEXER_DFA.stateCount);
+    text += "         ";
+    for (int k = 0; k < LEXER_DFA.classCount; ++k) text += QString("c%1").arg(k, -4);
+    text += "\n";
+    for (int q = 0; q < LEXER_DFA.stateCount; ++q) {
+        text += QString("   q%1").arg(q, -6);
+        for (int k = 0; k < LEXER_DFA.classCount; ++k) {
+            const int next = LEXER_DFA.next[q][k];
+            text += next == LEXER_DFA.dead ? QString(".").leftJustified(5) : QString("q%1").arg(next, -4);
+        }
+        text += "\n";
+    }
+
+    text += "\n[ Accepting States ]\n";
+    for (int q = 0; q < LEXER_DFA.stateCount; ++q) {
+        if (LEXER_DFA.accept[q] >= 0) text += QString("   q%1 -> r%2\n").arg(q, -3).arg(int(LEXER_DFA.accept[q]));
+    }
+    return text;
+}
@@ -0,0 +1,369 @@
+#ifndef LEXER_DFA_H
+#define LEXER_DFA_H
+
+#include "token_spec.h"
+#include <QString>
+#include <cstdint>
+#include <stdexcept>
+
+// Compile-time lexer generator: TOKEN_SPEC -> Thompson NFA -> subset construction
+// -> Moore minimization. The alphabet is the 128 ASCII units plus one symbol that
+// stands for every non-ASCII unit; units that no pattern tells apart share a class,
+// so a row of the transition table has one entry per class, not per unit.
+
+namespace lexer_dfa {
+
+constexpr int SYMBOLS = 129;
+constexpr int NON_ASCII = 128;
+constexpr int MAX_NFA_STATES = 320;
+constexpr int MAX_SYMBOL_SETS = 96;
+constexpr int MAX_STATES = 64;  // Including the dead state
+constexpr int MAX_CLASSES = 32; // Row stride of the table
+
+struct SymbolSet {
+    uint64_t bits[3] = {0, 0, 0};
+
+    constexpr void add(int c) { bits[c >> 6] |= uint64_t(1) << (c & 63); }
+    constexpr bool has(int c) const { return (bits[c >> 6] >> (c & 63)) & 1; }
+    constexpr void invert() {
+        bits[0] = ~bits[0];
+        bits[1] = ~bits[1];
+        bits[2] = ~bits[2] & 1; // Only NON_ASCII lives in the last word
+    }
+};
+
+constexpr int NFA_WORDS = (MAX_NFA_STATES + 63) / 64;
+
+struct NfaSet {
+    uint64_t bits[NFA_WORDS] = {};
+
+    constexpr void add(int s) { bits[s >> 6] |= uint64_t(1) << (s & 63); }
+    constexpr bool has(int s) const { return (bits[s >> 6] >> (s & 63)) & 1; }
+    constexpr bool operator==(const NfaSet& other) const {
+        for (int i = 0; i < NFA_WORDS; ++i) {
+            if (bits[i] != other.bits[i]) return false;
+        }
+        return true;
+    }
+};
+
+// Every state has at most two epsilon edges or one symbol-set edge
+struct Nfa {
+    int count = 0;
+    int epsilon[MAX_NFA_STATES][2] = {};
+    int edgeSet[MAX_NFA_STATES] = {};
+    int edgeTarget[MAX_NFA_STATES] = {};
+    int accept[MAX_NFA_STATES] = {}; // Rule index or -1
+    SymbolSet sets[MAX_SYMBOL_SETS] = {};
+    int setCount = 0;
+
+    constexpr int newState() {
+        if (count == MAX_NFA_STATES) throw std::logic_error("Token spec: raise MAX_NFA_STATES");
+        epsilon[count][0] = epsilon[count][1] = -1;
+        edgeSet[count] = edgeTarget[count] = accept[count] = -1;
+        return count++;
+    }
+
+    constexpr void addEpsilon(int from, int to) {
+        epsilon[from][epsilon[from][0] < 0 ? 0 : 1] = to;
+    }
+};
+
+struct Fragment {
+    int start;
+    int end;
+};
+
+// Recursive descent over one pattern:
+//   alternation := sequence ('|' sequence)*
+//   sequence    := repeat*
+//   repeat      := atom ('*' | '+' | '?')*
+//   atom        := '(' alternation ')' | '[' class ']' | '.' | '\' unit | unit
+class RegexCompiler {
+public:
+    constexpr RegexCompiler(Nfa& nfa, const char* pattern) : m_nfa(nfa), m_p(pattern) {}
+
+    constexpr Fragment compile() {
+        Fragment f = alternation();
+        if (*m_p != '\0') throw std::logic_error("Token spec: unbalanced ')'");
+        return f;
+    }
+
+private:
+    Nfa& m_nfa;
+    const char* m_p;
+
+    constexpr Fragment edge(const SymbolSet& set) {
+        if (m_nfa.setCount == MAX_SYMBOL_SETS) throw std::logic_error("Token spec: raise MAX_SYMBOL_SETS");
+        m_nfa.sets[m_nfa.setCount] = set;
+        const int a = m_nfa.newState();
+        const int b = m_nfa.newState();
+        m_nfa.edgeSet[a] = m_nfa.setCount++;
+        m_nfa.edgeTarget[a] = b;
+        return {a, b};
+    }
+
+    constexpr int unit() {
+        if (*m_p == '\\') ++m_p;
+        if (*m_p == '\0' || static_cast<unsigned char>(*m_p) >= 0x80) throw std::logic_error("Token spec: bad escape");
+        return *m_p++;
+    }
+
+    constexpr Fragment alternation() {
+        Fragment f = sequence();
+        while (*m_p == '|') {
+            ++m_p;
+            const Fragment g = sequence();
+            const int s = m_nfa.newState();
+            const int e = m_nfa.newState();
+            m_nfa.addEpsilon(s, f.start);
+            m_nfa.addEpsilon(s, g.start);
+            m_nfa.addEpsilon(f.end, e);
+            m_nfa.addEpsilon(g.end, e);
+            f = {s, e};
+        }
+        return f;
+    }
+
+    constexpr Fragment sequence() {
+        const int s = m_nfa.newState();
+        Fragment f = {s, s};
+        while (*m_p != '\0' && *m_p != '|' && *m_p != ')') {
+            const Fragment g = repeat();
+            m_nfa.addEpsilon(f.end, g.start);
+            f.end = g.end;
+        }
+        return f;
+    }
+
+    constexpr Fragment repeat() {
+        Fragment f = atom();
+        while (*m_p == '*' || *m_p == '+' || *m_p == '?') {
+            const char op = *m_p++;
+            const int s = m_nfa.newState();
+            const int e = m_nfa.newState();
+            m_nfa.addEpsilon(s, f.start);
+            if (op != '+') m_nfa.addEpsilon(s, e);
+            if (op != '?') m_nfa.addEpsilon(f.end, f.start);
+            m_nfa.addEpsilon(f.end, e);
+            f = {s, e};
+        }
+        return f;
+    }
+
+    constexpr Fragment atom() {
+        SymbolSet set;
+        switch (*m_p) {
+        case '(': {
+            ++m_p;
+            const Fragment f = alternation();
+            if (*m_p++ != ')') throw std::logic_error("Token spec: missing ')'");
+            return f;
+        }
+        case '.':
+            ++m_p;
+            set.invert();
+            return edge(set);
+        case '[': {
+            ++m_p;
+            const bool negate = *m_p == '^';
+            if (negate) ++m_p;
+            while (*m_p != ']') {
+                if (*m_p == '\0') throw std::logic_error("Token spec: missing ']'");
+                const int lo = unit();
+                int hi = lo;
+                if (*m_p == '-' && m_p[1] != ']') {
+                    ++m_p;
+                    hi = unit();
+                }
+                for (int c = lo; c <= hi; ++c) set.add(c);
+            }
+            ++m_p;
+            if (negate) set.invert();
+            return edge(set);
+        }
+        default:
+            set.add(unit());
+            return edge(set);
+        }
+    }
+};
+
+struct LexerDfa {
+    uint8_t classOf[SYMBOLS] = {};  // Unit (NON_ASCII for >= 0x80) -> class
+    int classCount = 0;
+    int stateCount = 0;             // Live states; 0 is the start state
+    int dead = 0;                   // == stateCount; every row of it loops to itself
+    uint8_t next[MAX_STATES][MAX_CLASSES] = {};
+    int8_t accept[MAX_STATES] = {}; // Index into TOKEN_SPEC, or -1
+    bool backtracks = false;        // A live non-start state that accepts nothing
+};
+
+constexpr void closure(const Nfa& nfa, NfaSet& set) {
+    int stack[MAX_NFA_STATES] = {};
+    int top = 0;
+    for (int s = 0; s < nfa.count; ++s) {
+        if (set.has(s)) stack[top++] = s;
+    }
+    while (top > 0) {
+        const int s = stack[--top];
+        for (int i = 0; i < 2; ++i) {
+            const int t = nfa.epsilon[s][i];
+            if (t >= 0 && !set.has(t)) {
+                set.add(t);
+                stack[top++] = t;
+            }
+        }
+    }
+}
+
+// Rules that produce the same token the same way may share an accepting state
+constexpr int acceptGroup(int rule) {
+    if (rule < 0) return -1;
+    for (int r = 0; r < rule; ++r) {
+        if (TOKEN_SPEC[r].type == TOKEN_SPEC[rule].type && TOKEN_SPEC[r].trimStart == TOKEN_SPEC[rule].trimStart &&
+            TOKEN_SPEC[r].trimEnd == TOKEN_SPEC[rule].trimEnd) {
+            return r;
+        }
+    }
+    return rule;
+}
+
+constexpr LexerDfa buildLexerDfa() {
+    // 1. One NFA for all rules, reached from the start state through a chain of
+    //    epsilon forks (a state only has two epsilon slots)
+    Nfa nfa;
+    const int start = nfa.newState();
+    int fork = start;
+    for (int r = 0; r < TOKEN_RULE_COUNT; ++r) {
+        const Fragment f = RegexCompiler(nfa, TOKEN_SPEC[r].pattern).compile();
+        nfa.accept[f.end] = r;
+        nfa.addEpsilon(fork, f.start);
+        if (r + 1 < TOKEN_RULE_COUNT) {
+            const int next = nfa.newState();
+            nfa.addEpsilon(fork, next);
+            fork = next;
+        }
+    }
+
+    // 2. Byte equivalence classes: units that belong to exactly the same edge sets
+    LexerDfa dfa;
+    int representative[MAX_CLASSES] = {};
+    for (int c = 0; c < SYMBOLS; ++c) {
+        int found = -1;
+        for (int k = 0; k < dfa.classCount && found < 0; ++k) {
+            bool same = true;
+            for (int i = 0; i < nfa.setCount && same; ++i) {
+                same = nfa.sets[i].has(c) == nfa.sets[i].has(representative[k]);
+            }
+            if (same) found = k;
+        }
+        if (found < 0) {
+            if (dfa.classCount == MAX_CLASSES) throw std::logic_error("Token spec: raise MAX_CLASSES");
+            found = dfa.classCount;
+            representative[dfa.classCount++] = c;
+        }
+        dfa.classOf[c] = uint8_t(found);
+    }
+
+    // 3. Subset construction. Index 0 is the empty set (dead), 1 the start closure.
+    NfaSet sets[MAX_STATES] = {};
+    int raw[MAX_STATES][MAX_CLASSES] = {};
+    int rawAccept[MAX_STATES] = {};
+    int rawCount = 2;
+    sets[1].add(start);
+    closure(nfa, sets[1]);
+    for (int d = 0; d < rawCount; ++d) {
+        rawAccept[d] = -1;
+        for (int s = 0; s < nfa.count; ++s) {
+            if (sets[d].has(s) && nfa.accept[s] >= 0 && (rawAccept[d] < 0 || nfa.accept[s] < rawAccept[d])) {
+                rawAccept[d] = nfa.accept[s];
+            }
+        }
+        for (int k = 0; k < dfa.classCount; ++k) {
+            NfaSet moved;
+            for (int s = 0; s < nfa.count; ++s) {
+                if (sets[d].has(s) && nfa.edgeSet[s] >= 0 && nfa.sets[nfa.edgeSet[s]].has(representative[k])) {
+                    moved.add(nfa.edgeTarget[s]);
+                }
+            }
+            closure(nfa, moved);
+            int target = -1;
+            for (int e = 0; e < rawCount && target < 0; ++e) {
+                if (sets[e] == moved) target = e;
+            }
+            if (target < 0) {
+                if (rawCount == MAX_STATES) throw std::logic_error("Token spec: raise MAX_STATES");
+                target = rawCount;
+                sets[rawCount++] = moved;
+            }
+            raw[d][k] = target;
+        }
+    }
+
+    // 4. Moore minimization: split blocks until successors agree
+    int block[MAX_STATES] = {};
+    int blockCount = 0;
+    for (int d = 0; d < rawCount; ++d) {
+        const int key = d == 0 ? -2 : acceptGroup(rawAccept[d]);
+        block[d] = -1;
+        for (int e = 0; e < d && block[d] < 0; ++e) {
+            if ((e == 0 ? -2 : acceptGroup(rawAccept[e])) == key) block[d] = block[e];
+        }
+        if (block[d] < 0) block[d] = blockCount++;
+    }
+    while (true) {
+        int refined[MAX_STATES] = {};
+        int refinedCount = 0;
+        for (int d = 0; d < rawCount; ++d) {
+            refined[d] = -1;
+            for (int e = 0; e < d && refined[d] < 0; ++e) {
+                bool same = block[e] == block[d];
+                for (int k = 0; k < dfa.classCount && same; ++k) {
+                    same = block[raw[e][k]] == block[raw[d][k]];
+                }
+                if (same) refined[d] = refined[e];
+            }
+            if (refined[d] < 0) refined[d] = refinedCount++;
+        }
+        for (int d = 0; d < rawCount; ++d) block[d] = refined[d];
+        if (refinedCount == blockCount) break;
+        blockCount = refinedCount;
+    }
+
+    // 5. Number the blocks: start first, dead last
+    int order[MAX_STATES] = {};
+    for (int b = 0; b < blockCount; ++b) order[b] = -1;
+    int numbered = 0;
+    order[block[1]] = numbered++;
+    for (int d = 2; d < rawCount; ++d) {
+        if (order[block[d]] < 0 && block[d] != block[0]) order[block[d]] = numbered++;
+    }
+    order[block[0]] = numbered;
+    dfa.stateCount = numbered;
+    dfa.dead = numbered;
+
+    for (int d = 0; d < rawCount; ++d) {
+        const int q = order[block[d]];
+        dfa.accept[q] = int8_t(acceptGroup(rawAccept[d]));
+        for (int k = 0; k < dfa.classCount; ++k) dfa.next[q][k] = uint8_t(order[block[raw[d][k]]]);
+    }
+    for (int q = 1; q < dfa.stateCount; ++q) {
+        if (dfa.accept[q] < 0) dfa.backtracks = true;
+    }
+    return dfa;
+}
+
+} // namespace lexer_dfa
+
+constexpr lexer_dfa::LexerDfa LEXER_DFA = lexer_dfa::buildLexerDfa();
+
+// The driver in Lexer stops at the first dead transition and takes that state's
+// token, which is only the longest match if no live state sits between two accepts.
+static_assert(!LEXER_DFA.backtracks, "Token spec needs backtracking, which the table driver does not do");
+static_assert(LEXER_DFA.accept[0] < 0, "Token spec matches the empty string");
+
+// Plain-text dump of the spec, the classes and the minimized table (Formal Design tab)
+QString describeLexerDfa();
+
+#endif // LEXER_DFA_H
@@ -0,0 +1,123 @@
+// Checks of the lexer paths that must come out as a plain tokenize() does:
+// IncrementalLexer after random edits, and sources big enough to be lexed in
+// parallel chunks. Run by ctest; prints the first difference found and fails.
+#include "incremental_lexer.h"
+#include "lexer.h"
+#include <cstdio>
+#include <random>
+#include <string>
+
+using namespace std;
+
+// Every field of every token, or the error that stopped the lexer
+static string describe(const Diagnostic& error) {
+    return "error " + to_string(error.span.line) + ":" + to_string(error.span.column) + " " + error.message;
+}
+
+static string describe(const Result<const TokenBuffer*>& result) {
+    if (!result) return describe(result.error());
+    const TokenBuffer& tokens = *result.value();
+    string text;
+    for (int i = 0; i < tokens.size(); ++i) {
+        const Token token = tokens[i];
+        text += to_string(int(token.type)) + ":" + to_string(token.offset) + "+" + to_string(token.length) + "@" +
+                to_string(token.line) + "#" + to_string(token.symbol) + " ";
+    }
+    return text;
+}
+
+static string tokenize(Lexer&& lexer, int threads) {
+    const Result<TokenBuffer> tokens = lexer.tryTokenize(threads);
+    if (!tokens) return describe(tokens.error());
+    return describe(&tokens.value());
+}
+
+static string tokenize(const QString& source, int threads = 1) { return tokenize(Lexer(source), threads); }
+
+// Random edits of random scripts, some merged before the next update(), cover
+// indentation changes, unterminated strings, line continuations and dedents to
+// no enclosing column
+static bool testIncremental() {
+    const char* pieces[] = {"\n",  "    ", "\t",  "x", "if a:", "= 1", "#c", "\"s\n", "'", " ", "def f():\n    ",
+                            "\n\n", "return 2", "+", "==", "9.5", "\\", "  \n", "  y"};
+    mt19937 random(11);
+    auto pick = [&](int count) { return int(random() % unsigned(count)); };
+    auto piece = [&]() { return QString(pieces[pick(int(size(pieces)))]); };
+    for (int script = 0; script < 2000; ++script) {
+        QString source;
+        for (int i = pick(40); i > 0; --i) source += piece();
+        IncrementalLexer lexer;
+        lexer.update(source);
+        for (int edit = 0; edit < 20; ++edit) {
+            for (int merged = pick(3) == 0 ? 2 : 1; merged > 0; --merged) {
+                const int position = pick(source.size() + 1);
+                const int removed = pick(min(6, int(source.size()) - position + 1));
+                QString added;
+                for (int i = pick(3); i > 0; --i) added += piece();
+                source = source.left(position) + added + source.mid(position + removed);
+                lexer.noteEdit(position, removed, added.size());
+            }
+            if (describe(lexer.update(source)) == tokenize(source)) continue;
+            fprintf(stderr, "script %d edit %d differs from a full lex:\n%s\n", script, edit,
+                    source.toStdString().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Chunk cuts land near every k/n of the source. Between twelve equal parts go
+// strings of many lines, some indented like code, so that every cut for 2, 3,
+// 4 and 6 chunks falls inside one, and inside a def's block. The bad dedents
+// then end the parts past a cut, and the first one.
+static bool testChunks() {
+    mt19937 random(5);
+    auto pick = [&](int count) { return int(random() % unsigned(count)); };
+    const char* lines[] = {"    t = t + base * 2  # note\n", "    if t > 1:\n        t = t - 1\n", "    s = \"text\"\n",
+                           "    for k in range(t):\n        t = t + k\n\n", "    u = t >= 2.5 and not t\n"};
+    auto part = [&](int length) {
+        QString text;
+        while (text.size() < length) {
+            text += "def f" + QString::number(pick(100)) + "(t):\n";
+            for (int i = 1 + pick(8); i > 0; --i) text += lines[pick(int(size(lines)))];
+            text += "    return t\n\n";
+        }
+        return text;
+    };
+    QString spanning = "def g():\n    s = '";
+    for (int i = 0; i < 400; ++i) spanning += i % 3 ? "        x = 1\n" : "  else:\n";
+    spanning += "'\n    return s\n";
+
+    const int parts = 12;
+    const int partSize = 6 * Lexer::PARALLEL_MIN_UNITS / 2 / parts;
+    vector<QString> texts;
+    for (int i = 0; i < parts; ++i) texts.push_back(part(partSize));
+    for (const int badPart : {-1, 0, 4, 7, 11}) {
+        QString source;
+        for (int i = 0; i < parts; ++i) {
+            if (i > 0) source += spanning;
+            source += texts[size_t(i)];
+            if (i == badPart) source += "def h():\n        x = 1\n    y = 2\n";
+        }
+        const string serial = tokenize(source);
+        const QByteArray utf8 = source.toUtf8();
+        const string serialUtf8 = tokenize(Lexer(utf8.constData(), utf8.size()), 1);
+        for (const int threads : {2, 3, 4, 6}) {
+            if (tokenize(source, threads) == serial &&
+                tokenize(Lexer(utf8.constData(), utf8.size()), threads) == serialUtf8) {
+                continue;
+            }
+            fprintf(stderr, "the source with bad part %d differs on %d threads\n", badPart, threads);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool passed = true;
+    passed = testIncremental() && passed;
+    passed = testChunks() && passed;
+    printf("%s\n", passed ? "passed" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -1,6 +1,7 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "lexer.h"
+#include "lexer_dfa.h"
 #include "parser.h"
 #include "translator.h"
 #include "semantic_analyzer.h"
@@ -25,7 +26,7 @@
 #include <QFile>
 #include <QTextStream>
 #include <QScrollBar>
-#include <QRegularExpression>
+#include <algorithm>
 #include <map>
 #include <set>
 #include <cmath>
@@ -187,6 +188,13 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     liveCheckTimer = new QTimer(this);
     liveCheckTimer->setSingleShot(true);
     connect(liveCheckTimer, &QTimer::timeout, this, &MainWindow::liveCheck);
+    liveAnalyzer.setIncremental(true);
+
+    // Record edit ranges so live checks only re-lex the damaged lines
+    connect(sourceCodeEdit->document(), &QTextDocument::contentsChange,
+            [this](int position, int charsRemoved, int charsAdded) {
+        liveLexer.noteEdit(position, charsRemoved, charsAdded);
+    });
 
     // Trigger check when text changes
     connect(sourceCodeEdit, &CodeEditor::textChanged, [this]() {
@@ -222,47 +230,55 @@ void MainWindow::liveCheck() {
     if (sourceCode.trimmed().isEmpty()) return;
 
     QLabel* statusLabel = findChild<QLabel*>("statusLabel");
-
-    try {
-        // 1. Lexer
-        Lexer lexer(sourceCode);
-        vector<Token> tokens = lexer.tokenize();
-
-        // 2. Parser
-        Parser parser(tokens);
-        unique_ptr<ProgramNode> astRoot = parser.parse();
-
-        if (astRoot) {
-            // 3. Semantic Analysis
-            SemanticAnalyzer analyzer;
-            analyzer.analyze(astRoot.get());
-
-            // If we get here, no errors found
-            highlighter->clearError();
-            sourceCodeEdit->clearError();
-            statusLabel->setStyleSheet("background-color: #276749; color: white; padding: 8px;");
-            statusLabel->setText("Status: No errors detected.");
-        }
-    } catch (const exception& e) {
-        // Parse error message for line number
-        QString errorMsg = QString(e.what());
-        int line = -1;
-
-        // Attempt to find "line X" in the error string
-        QRegularExpression re("line\\s+(\\d+)");
-        QRegularExpressionMatch match = re.match(errorMsg);
-        if (match.hasMatch()) {
-            line = match.captured(1).toInt();
+    vector<Diagnostic> diagnostics;
+
+    // Half-typed code fails most checks, so no stage throws here: errors come
+    // back as Diagnostics that already know their line and column.
+    // 1. Lexer (tokens are kept between checks; only edited lines are re-lexed)
+    Result<const TokenBuffer*> tokens = liveLexer.update(sourceCode);
+    if (!tokens) {
+        diagnostics.push_back(tokens.error());
+    } else {
+        // 2. Parser: reports every syntax error at once and still builds a tree of the
+        // rest. Top-level statements whose text did not change come from the last check.
+        ProgramNode* astRoot = liveParser.update(*tokens.value(), liveLexer.source());
+        diagnostics = liveParser.diagnostics();
+
+        // 3. Semantic Analysis, on the statements that did parse; it too reports every error.
+        // Defs that did not change, nor did what they call, keep their last check.
+        if (!liveAnalyzer.tryAnalyze(astRoot)) {
+            diagnostics.insert(diagnostics.end(), liveAnalyzer.diagnostics().begin(), liveAnalyzer.diagnostics().end());
         }
+    }
 
-        if (line != -1) {
-            highlighter->setErrorLine(line);
-            sourceCodeEdit->setError(line, errorMsg);
-        }
+    if (diagnostics.empty()) {
+        // If we get here, no errors found
+        highlighter->clearError();
+        sourceCodeEdit->clearError();
+        statusLabel->setStyleSheet("background-color: #276749; color: white; padding: 8px;");
+        statusLabel->setText("Status: No errors detected.");
+        return;
+    }
 
-        statusLabel->setStyleSheet("background-color: #9b2c2c; color: white; padding: 8px; font-weight: bold;");
-        statusLabel->setText(QString("Live Error: ") + errorMsg);
+    QMap<int, int> columns;
+    QMap<int, QString> messages;
+    for (const Diagnostic& diagnostic : diagnostics) {
+        const SourceSpan& span = diagnostic.span;
+        if (span.line <= 0) continue;
+        auto column = columns.find(span.line);
+        if (column == columns.end()) columns.insert(span.line, span.column);
+        else *column = min(*column, span.column);
+        QString& text = messages[span.line];
+        if (!text.isEmpty()) text += "\n";
+        text += QString::fromStdString(diagnostic.message);
     }
+    highlighter->setErrorColumns(columns);
+    sourceCodeEdit->setErrors(messages);
+
+    QString status = QString("Live Error: ") + QString::fromStdString(diagnostics.front().message);
+    if (diagnostics.size() > 1) status += QString(" (+%1 more)").arg(diagnostics.size() - 1);
+    statusLabel->setStyleSheet("background-color: #9b2c2c; color: white; padding: 8px; font-weight: bold;");
+    statusLabel->setText(status);
 }
 
 void MainWindow::onAnalyzeClicked() {
@@ -279,18 +295,20 @@ void MainWindow::onAnalyzeClicked() {
     try {
         // 1. Lexer
         Lexer lexer(sourceCode);
-        vector<Token> tokens = lexer.tokenize();
+        TokenBuffer tokens = lexer.tokenize();
         QString tokensString;
-        for (const auto& token : tokens) {
+        int lineHint = 0;
+        for (int i = 0; i < tokens.size(); ++i) {
+            const Token token = tokens.at(i, &lineHint);
             tokensString += QString("Line %1: Type: %2, Value: '%3'\n")
             .arg(token.line)
                 .arg(getTokenName(token.type))
-                .arg(token.value);
+                .arg(token.value(sourceCode));
         }
         tokensEdit->setPlainText(tokensString);
 
         // 2. Parser
-        Parser parser(tokens);
+        Parser parser(tokens, sourceCode, ParserTrace::COUNTS); // The automaton view only needs distinct transitions
         unique_ptr<ProgramNode> astRoot = parser.parse();
 
         if (astRoot) {
@@ -298,13 +316,16 @@ void MainWindow::onAnalyzeClicked() {
             SemanticAnalyzer analyzer;
             analyzer.analyze(astRoot.get());
 
+            // Tree view and translator read the analyzed tree as flat pools
+            const FlatAst flatAst(astRoot.get());
+
             // 4. Visualizations
             drawTrueAutomaton(parser);
-            drawParseTree(astRoot.get(), QPointF(treeScene->width() / 2, 50));
+            drawParseTree(flatAst, QPointF(treeScene->width() / 2, 50));
 
             // 5. Translation
             Translator translator(analyzer.getSymbolTable());
-            QString cppCode = translator.translate(astRoot.get());
+            QString cppCode = translator.translate(flatAst);
             targetCodeEdit->setPlainText(cppCode);
 
             statusLabel->setText("Success: Code analyzed and translated successfully.");
@@ -376,97 +397,84 @@ void MainWindow::onExecutionFinished(int exitCode, QProcess::ExitStatus exitStat
 // Visualization Logic
 // ============================================================================
 
-void MainWindow::drawParseTree(const ASTNode* node, QPointF pos, QPointF parentPos, int depth) {
-    if (!node) return;
-
+void MainWindow::drawParseTree(const FlatAst& ast, QPointF rootPos) {
     const QColor NODE_COLOR(38, 115, 83), LINE_COLOR(160, 147, 147), TEXT_COLOR(247, 250, 252);
     const QBrush NODE_BRUSH(QColor(26, 58, 42));
     QPen nodePen(NODE_COLOR, 2), linePen(LINE_COLOR, 1.5);
 
-    QGraphicsEllipseItem *ellipse = treeScene->addEllipse(0, 0, 160, 50, nodePen, NODE_BRUSH);
-    ellipse->setPos(pos - QPointF(80, 25));
-
-    // Label Logic: Show Name AND Type if determined
-    QString labelText = node->getNodeName();
-    if (node->determined_type != DataType::UNDEFINED &&
-        node->determined_type != DataType::NONE &&
-        !dynamic_cast<const ProgramNode*>(node) &&
-        !dynamic_cast<const BlockNode*>(node)) {
-        labelText += "\n[" + DataTypeToString(node->determined_type) + "]";
-    }
-
-    QGraphicsTextItem *textItem = treeScene->addText(labelText);
-    textItem->setDefaultTextColor(TEXT_COLOR);
-    textItem->setFont(QFont("Arial", 9, QFont::Bold));
-    QRectF textRect = textItem->boundingRect();
-    textItem->setPos(
-        pos.x() - textRect.width() / 2,
-        pos.y() - textRect.height() / 2
-        );
+    // Pre-order from an explicit stack, so deep trees cannot overflow the C++ stack
+    struct Placement {
+        uint32_t node;
+        QPointF pos;
+        QPointF parentPos;
+        int depth;
+    };
+    vector<Placement> pending{{ast.root(), rootPos, QPointF(), 0}};
+    vector<uint32_t> children;
+
+    while (!pending.empty()) {
+        const Placement next = pending.back();
+        pending.pop_back();
+        const uint32_t node = next.node;
+        const QPointF pos = next.pos, parentPos = next.parentPos;
+        if (node == FlatAst::NONE) continue;
+        const FlatAst::Node& n = ast[node];
+
+        QGraphicsEllipseItem *ellipse = treeScene->addEllipse(0, 0, 160, 50, nodePen, NODE_BRUSH);
+        ellipse->setPos(pos - QPointF(80, 25));
+
+        // Label Logic: Show Name AND Type if determined
+        QString labelText = ast.label(node);
+        if (n.determined_type != DataType::UNDEFINED &&
+            n.determined_type != DataType::NONE &&
+            n.kind != NodeKind::PROGRAM &&
+            n.kind != NodeKind::BLOCK) {
+            labelText += "\n[" + DataTypeToString(n.determined_type) + "]";
+        }
 
-    if (!parentPos.isNull()) {
-        QPainterPath path;
-        path.moveTo(parentPos);
-        QPointF controlPoint1(parentPos.x(), parentPos.y() + 60);
-        QPointF controlPoint2(pos.x(), pos.y() - 60);
-        path.cubicTo(controlPoint1, controlPoint2, pos);
-        treeScene->addPath(path, linePen);
-    }
+        QGraphicsTextItem *textItem = treeScene->addText(labelText);
+        textItem->setDefaultTextColor(TEXT_COLOR);
+        textItem->setFont(QFont("Arial", 9, QFont::Bold));
+        QRectF textRect = textItem->boundingRect();
+        textItem->setPos(
+            pos.x() - textRect.width() / 2,
+            pos.y() - textRect.height() / 2
+            );
+
+        if (!parentPos.isNull()) {
+            QPainterPath path;
+            path.moveTo(parentPos);
+            QPointF controlPoint1(parentPos.x(), parentPos.y() + 60);
+            QPointF controlPoint2(pos.x(), pos.y() - 60);
+            path.cubicTo(controlPoint1, controlPoint2, pos);
+            treeScene->addPath(path, linePen);
+        }
 
-    vector<const ASTNode*> children;
-    if (auto p = dynamic_cast<const ProgramNode*>(node)) {
-        for(const auto& stmt : p->statements) children.push_back(stmt.get());
-    } else if (auto p = dynamic_cast<const AssignmentNode*>(node)) {
-        children.push_back(p->identifier.get());
-        children.push_back(p->expression.get());
-    } else if (auto p = dynamic_cast<const BinaryOpNode*>(node)) {
-        children.push_back(p->left.get());
-        children.push_back(p->right.get());
-    } else if (auto p = dynamic_cast<const UnaryOpNode*>(node)) {
-        children.push_back(p->right.get());
-    } else if (auto p = dynamic_cast<const PrintNode*>(node)) {
-        children.push_back(p->expression.get());
-    } else if (auto p = dynamic_cast<const ReturnNode*>(node)) {
-        if(p->expression) children.push_back(p->expression.get());
-    } else if (auto p = dynamic_cast<const FunctionCallNode*>(node)) {
-        children.push_back(p->name.get());
-        for(const auto& arg : p->arguments) children.push_back(arg.get());
-    } else if (auto p = dynamic_cast<const IfNode*>(node)) {
-        children.push_back(p->condition.get());
-        children.push_back(p->body.get());
-        if(p->else_branch) children.push_back(p->else_branch.get());
-    } else if (auto p = dynamic_cast<const WhileNode*>(node)) {
-        children.push_back(p->condition.get());
-        children.push_back(p->body.get());
-    } else if (auto p = dynamic_cast<const BlockNode*>(node)) {
-        for(const auto& stmt : p->statements) children.push_back(stmt.get());
-    } else if (auto p = dynamic_cast<const FunctionDefNode*>(node)) {
-        children.push_back(p->name.get());
-        for(const auto& param : p->parameters) children.push_back(param.get());
-        children.push_back(p->body.get());
-    } else if (auto p = dynamic_cast<const TryExceptNode*>(node)) {
-        children.push_back(p->try_body.get());
-    }
-    // --- FOR LOOP VISUALIZATION ---
-    else if (auto p = dynamic_cast<const ForNode*>(node)) {
-        children.push_back(p->iterator.get());
-        children.push_back(p->start.get());
-        children.push_back(p->stop.get());
-        children.push_back(p->step.get());
-        children.push_back(p->body.get());
-    }
+        children.clear();
+        if (n.kind == NodeKind::FOR) {
+            // Range slots keep their places even when empty; the iterable is not drawn
+            for (int slot : {0, 1, 2, 3, 5}) children.push_back(ast.child(node, slot));
+        } else if (n.kind == NodeKind::TRY_EXCEPT) {
+            children.push_back(ast.child(node, 0));
+        } else {
+            for (uint32_t slot = 0; slot < n.count; ++slot) {
+                if (ast.child(node, slot) != FlatAst::NONE) children.push_back(ast.child(node, slot));
+            }
+        }
 
-    if (!children.empty()) {
-        qreal yOffset = 150;
-        qreal totalWidth = children.size() * 250;
-        if (depth < 2) totalWidth = children.size() * 400;
+        if (!children.empty()) {
+            qreal yOffset = 150;
+            qreal totalWidth = children.size() * 250;
+            if (next.depth < 2) totalWidth = children.size() * 400;
 
-        qreal startX = pos.x() - totalWidth / 2;
-        qreal xSpacing = totalWidth / children.size();
+            qreal startX = pos.x() - totalWidth / 2;
+            qreal xSpacing = totalWidth / children.size();
 
-        for (size_t i = 0; i < children.size(); ++i) {
-            QPointF childPos(startX + i * xSpacing + xSpacing / 2, pos.y() + yOffset);
-            drawParseTree(children[i], childPos, pos, depth + 1);
+            // Last child first, so the first comes off the stack next
+            for (size_t i = children.size(); i-- > 0;) {
+                QPointF childPos(startX + i * xSpacing + xSpacing / 2, pos.y() + yOffset);
+                pending.push_back({children[i], childPos, pos, next.depth + 1});
+            }
         }
     }
 }
@@ -488,10 +496,17 @@ void MainWindow::drawTrueAutomaton(const Parser& parser) {
     transitionPen.setCosmetic(true);
 
     // --- 1. DYNAMIC FILTERING (Identify used states) ---
-    vector<pair<ParserState, Token>> history = parser.getStateHistory();
+    // Every transition that fired at least once, in (from, to, trigger) order
+    vector<AutomatonTransition> fired;
     set<ParserState> activeStates;
-    for (const auto& item : history) {
-        activeStates.insert(item.first);
+    for (int from = 0; from < Parser::STATE_COUNT; ++from) {
+        for (int to = 0; to < Parser::STATE_COUNT; ++to) {
+            for (int t = 0; t < Parser::TOKEN_TYPE_COUNT; ++t) {
+                if (!parser.transitionCount(ParserState(from), ParserState(to), TokenType(t))) continue;
+                fired.push_back(AutomatonTransition(ParserState(from), ParserState(to), TokenType(t)));
+                activeStates.insert(ParserState(to));
+            }
+        }
     }
     // Always keep structural anchors active
     activeStates.insert(ParserState::START);
@@ -562,24 +577,16 @@ void MainWindow::drawTrueAutomaton(const Parser& parser) {
     }
 
     // --- 4. DRAW DYNAMIC TRANSITIONS ---
-    struct TransKey { ParserState a, b; TokenType t;
-        bool operator<(const TransKey& o) const { return std::tie(a, b, t) < std::tie(o.a, o.b, o.t); }
-    };
-    std::set<TransKey> drawn;
-
-    for (size_t i = 1; i < history.size(); ++i) {
-        ParserState from = history[i-1].first;
-        ParserState to = history[i].first;
-        Token tok = history[i].second;
+    // The counts are already deduplicated: one arc per distinct transition
+    for (const AutomatonTransition& transition : fired) {
+        ParserState from = transition.fromState;
+        ParserState to = transition.toState;
+        TokenType trigger = transition.triggerToken;
 
         // Skip transitions involving filtered states
         if (layoutMap.find(from) == layoutMap.end() || layoutMap.find(to) == layoutMap.end()) continue;
         if (activeStates.find(from) == activeStates.end() || activeStates.find(to) == activeStates.end()) continue;
 
-        // Deduplication
-        if (drawn.count({from, to, tok.type})) continue;
-        drawn.insert({from, to, tok.type});
-
         QPointF p1 = layoutMap[from];
         QPointF p2 = layoutMap[to];
 
@@ -613,7 +620,7 @@ void MainWindow::drawTrueAutomaton(const Parser& parser) {
 
             // Token Label on Line
             QPointF labelPos = (mid + control) / 2;
-            QGraphicsTextItem* tag = automatonScene->addText(getTokenName(tok.type));
+            QGraphicsTextItem* tag = automatonScene->addText(getTokenName(trigger));
             tag->setDefaultTextColor(TRANSITION_COLOR);
             tag->setFont(QFont("Arial", 7));
             QRectF tr = tag->boundingRect();
@@ -623,12 +630,10 @@ void MainWindow::drawTrueAutomaton(const Parser& parser) {
     }
 
     // --- 5. HIGHLIGHT CURRENT STATE ---
-    if (!history.empty()) {
-        ParserState last = history.back().first;
-        if (layoutMap.count(last) && activeStates.count(last)) {
-            QGraphicsEllipseItem* cur = automatonScene->addEllipse(-40, -40, 80, 80, QPen(ACTIVE_HIGHLIGHT, 4), Qt::NoBrush);
-            cur->setPos(layoutMap[last]);
-        }
+    ParserState last = parser.currentState();
+    if (layoutMap.count(last) && activeStates.count(last)) {
+        QGraphicsEllipseItem* cur = automatonScene->addEllipse(-40, -40, 80, 80, QPen(ACTIVE_HIGHLIGHT, 4), Qt::NoBrush);
+        cur->setPos(layoutMap[last]);
     }
 }
 
@@ -667,6 +672,7 @@ QString MainWindow::getTokenName(TokenType token) {
     case TokenType::COLON: return ":"; case TokenType::RETURN: return "RETURN";
     case TokenType::PRINT: return "PRINT"; case TokenType::TRY: return "TRY";
     case TokenType::EXCEPT: return "EXCEPT"; case TokenType::OR: return "OR";
+    case TokenType::AND: return "AND";
     case TokenType::NOT: return "NOT"; case TokenType::NUMBER: return "NUM";
     case TokenType::STRING: return "STR"; default: return "TOK";
     }
@@ -818,12 +824,12 @@ ArgTail      -> ',' Expression ArgTail | ε
     treeView->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     tabWidget->addTab(treeView, "Parse Tree");
 
-    // --- TAB 5: Formal Design (ONLY Semantic Logic) ---
+    // --- TAB 5: Formal Design (Semantic Logic + the generated lexer DFA) ---
     // Uses getDesignDocumentText() which returns Plain Text, no HTML.
     designEdit = new QTextEdit();
     designEdit->setReadOnly(true);
     designEdit->setStyleSheet(QString("background-color: %1; color: %2; font-family: 'Courier New'; font-size: 13px; border: none; padding: 15px;").arg(COLOR_BACKGROUND_DARK, COLOR_TEXT_PRIMARY));
-    designEdit->setPlainText(getDesignDocumentText());
+    designEdit->setPlainText(getDesignDocumentText() + "\n" + describeLexerDfa());
     tabWidget->addTab(designEdit, "Formal Design");
 
     // --- TAB 6: Profiler ---
@@ -10,6 +10,10 @@
 #include <QToolTip>
 #include <QTimer>
 #include "parser.h"
+#include "flat_ast.h"
+#include "incremental_lexer.h"
+#include "incremental_parser.h"
+#include "semantic_analyzer.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -21,29 +25,34 @@ class ErrorHighlighter : public QSyntaxHighlighter {
 public:
     ErrorHighlighter(QTextDocument *parent = nullptr) : QSyntaxHighlighter(parent) {}
 
-    void setErrorLine(int line) {
-        m_errorLine = line;
+    // First error column by line (1-based; 0 underlines the whole line)
+    void setErrorColumns(const QMap<int, int> &columns) {
+        m_errorColumns = columns;
         rehighlight();
     }
 
     void clearError() {
-        m_errorLine = -1;
+        m_errorColumns.clear();
         rehighlight();
     }
 
 protected:
     void highlightBlock(const QString &text) override {
         int currentLine = currentBlock().blockNumber() + 1;
-        if (currentLine == m_errorLine) {
+        auto error = m_errorColumns.constFind(currentLine);
+        if (error != m_errorColumns.constEnd()) {
             QTextCharFormat fmt;
             fmt.setUnderlineColor(Qt::red);
             fmt.setUnderlineStyle(QTextCharFormat::WaveUnderline);
-            setFormat(0, text.length(), fmt);
+            // From the error to the end of the line; an error past the last character marks all of it
+            int start = error.value() > 0 ? error.value() - 1 : 0;
+            if (start >= text.length()) start = 0;
+            setFormat(start, text.length() - start, fmt);
         }
     }
 
 private:
-    int m_errorLine = -1;
+    QMap<int, int> m_errorColumns;
 };
 
 // --- CUSTOM CODE EDITOR CLASS ---
@@ -55,36 +64,34 @@ public:
         setMouseTracking(true); // Enable mouse tracking for hover
     }
 
-    void setError(int line, const QString &msg) {
-        m_errorLine = line;
-        m_errorMessage = msg;
+    // Messages by line; several on one line are shown together
+    void setErrors(const QMap<int, QString> &errors) {
+        m_errors = errors;
     }
 
     void clearError() {
-        m_errorLine = -1;
-        m_errorMessage.clear();
+        m_errors.clear();
     }
 
 protected:
     void mouseMoveEvent(QMouseEvent *e) override {
         QTextEdit::mouseMoveEvent(e);
 
-        if (m_errorLine == -1) return;
+        if (m_errors.isEmpty()) return;
 
         // Map mouse position to text cursor to get the line number
         QTextCursor cursor = cursorForPosition(e->pos());
         int line = cursor.blockNumber() + 1;
 
-        if (line == m_errorLine) {
-            QToolTip::showText(e->globalPos(), m_errorMessage, this);
+        if (m_errors.contains(line)) {
+            QToolTip::showText(e->globalPos(), m_errors.value(line), this);
         } else {
             QToolTip::hideText();
         }
     }
 
 private:
-    int m_errorLine = -1;
-    QString m_errorMessage;
+    QMap<int, QString> m_errors;
 };
 
 class MainWindow : public QMainWindow
@@ -120,6 +127,9 @@ private:
     // Error Highlighting
     ErrorHighlighter *highlighter;
     QTimer *liveCheckTimer;
+    IncrementalLexer liveLexer; // Token cache for live checks, fed by document edits
+    IncrementalParser liveParser; // Tree cache for live checks, reparses what the edits damaged
+    SemanticAnalyzer liveAnalyzer; // Rechecks the defs whose text or callees changed
 
     // Process for Profiler
     QProcess *compilerProcess;
@@ -127,7 +137,7 @@ private:
 
     // Helper Functions
     void setupUI();
-    void drawParseTree(const ASTNode* node, QPointF pos, QPointF parentPos = QPointF(), int depth = 0);
+    void drawParseTree(const FlatAst& ast, QPointF rootPos);
     void drawTrueAutomaton(const Parser& parser);
 
     // Helpers
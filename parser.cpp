@@ -5,111 +5,312 @@
 
 using namespace std;
 
-Parser::Parser(const vector<Token>& tokens) : m_tokens(tokens) {
-    m_state_history.push_back({m_current_state, Token{TokenType::END_OF_FILE, "START"}});
+Parser::Parser(Lexer& lexer, ParserTrace trace) : m_lexer(&lexer), m_source(lexer.source()), m_trace(trace) {
+    startTrace();
 }
 
-void Parser::changeState(ParserState newState, Token triggerToken, const QString& description) {
-    m_transitions.push_back(AutomatonTransition(m_current_state, newState, triggerToken.type));
-    m_current_state = newState;
-    m_state_history.push_back({m_current_state, triggerToken});
+Parser::Parser(const TokenBuffer& tokens, SourceView source, ParserTrace trace)
+    : m_tokens(&tokens), m_kinds(tokens.kinds()), m_count(tokens.size()), m_source(source), m_trace(trace) {
+    // The lexer ends every buffer with EOF; reuse it so the sentinel has the right line
+    if (m_count > 0 && tokens.kind(m_count - 1) == TokenType::END_OF_FILE) m_eof = tokens.back();
+    startTrace();
 }
 
-Token Parser::currentToken() {
-    if (m_pos >= m_tokens.size()) return {TokenType::END_OF_FILE, ""};
-    return m_tokens[m_pos];
+void Parser::startTrace() {
+    if (m_trace == ParserTrace::OFF) return;
+    m_transition_counts.assign(size_t(STATE_COUNT) * STATE_COUNT * TOKEN_TYPE_COUNT, 0);
+    if (m_trace == ParserTrace::FULL) m_state_history.push_back({m_current_state, TokenType::END_OF_FILE});
 }
 
-Token Parser::peekToken(int offset) {
-    if (m_pos + offset >= m_tokens.size()) return {TokenType::END_OF_FILE, ""};
-    return m_tokens[m_pos + offset];
+void Parser::recordTransition(ParserState newState, TokenType trigger) {
+    m_transition_counts[countIndex(m_current_state, newState, trigger)]++;
+    if (m_trace == ParserTrace::FULL) {
+        m_transitions.push_back(AutomatonTransition(m_current_state, newState, trigger));
+        m_state_history.push_back({newState, trigger});
+    }
+}
+
+QString Parser::text(const Token& token) const {
+    return token.value(m_source);
+}
+
+QStringView Parser::arenaText(const Token& token) {
+    // A UTF-16 lexeme with nothing to unescape goes straight from the source to the arena
+    if (!m_source.isUtf8() && token.length > 0) {
+        const QStringView raw(reinterpret_cast<const QChar*>(m_source.utf16) + token.offset, token.length);
+        if (token.type != TokenType::STRING || !raw.contains(u'\\')) return m_arena->copy(raw);
+    }
+    return m_arena->copy(text(token));
+}
+
+Token Parser::pull() {
+    if (m_tokens) return m_tokens->at(m_next + m_filled, &m_line_hint);
+    return pullFromLexer();
+}
+
+// Out of line so the buffered path of pull() stays small enough to inline
+Token Parser::pullFromLexer() {
+    Token token = m_lexer->next();
+    // The lexer ends the input at an indentation error; the parse ends there too
+    if (token.type == TokenType::END_OF_FILE && m_lexer->error() && !m_fatal) {
+        m_failed = true;
+        m_fatal = true;
+        m_error = *m_lexer->error();
+    }
+    return token;
+}
+
+const Token& Parser::lookahead(int offset) {
+    while (m_filled <= offset) {
+        m_ring[(m_head + m_filled) & (LOOKAHEAD - 1)] = pull();
+        m_filled++;
+    }
+    return m_ring[(m_head + offset) & (LOOKAHEAD - 1)];
+}
+
+// With a borrowed buffer the kinds are read in place; a Token is only assembled
+// (into the lookahead window) when a node or an error message needs its fields.
+// After an error everything reads as END_OF_FILE (see fail()).
+
+TokenType Parser::peekType(int offset) {
+    if (m_failed) return TokenType::END_OF_FILE;
+    if (m_kinds) {
+        const int index = m_next + offset;
+        return index < m_count ? TokenType(m_kinds[index]) : TokenType::END_OF_FILE;
+    }
+    return lookahead(offset).type;
+}
+
+const Token& Parser::peekToken(int offset) {
+    if (m_failed || (m_kinds && m_next + offset >= m_count)) return m_eof;
+    return lookahead(offset);
 }
 
 void Parser::advance() {
-    if (m_pos < m_tokens.size()) m_pos++;
+    // Past the end both sources keep producing END_OF_FILE
+    if (currentType() == TokenType::END_OF_FILE) return;
+    if (m_kinds) m_next++;
+    if (m_filled > 0) {
+        m_head = (m_head + 1) & (LOOKAHEAD - 1);
+        m_filled--;
+    }
 }
 
 void Parser::expect(TokenType type) {
-    if (currentToken().type == type) {
+    if (currentType() == type) {
         advance();
     } else {
-        // CHANGED: Throw exception to trigger error detection
-        Token cur = currentToken();
-        QString msg = "Syntax Error: Expected token type " + QString::number((int)type) +
-                      " but found '" + cur.value + "' at line " + QString::number(cur.line);
-        throw runtime_error(msg.toStdString());
+        fail(DiagnosticCode::EXPECTED_TOKEN, type);
+    }
+}
+
+// Errors are not thrown: the parsing functions return as usual, with every
+// token from here on reading as END_OF_FILE, so each finishes with whatever it
+// has and the statement loop in parseInto() drops the result. Only the first
+// error of a statement is kept; the rest are its echoes.
+void Parser::fail(DiagnosticCode code, TokenType expected) {
+    if (m_failed) return;
+    const Token& at = currentToken();
+    string message;
+    switch (code) {
+    case DiagnosticCode::EXPECTED_TOKEN:
+        message = ("Syntax Error: Expected token type " + QString::number((int)expected) +
+                   " but found '" + text(at) + "' at line " + QString::number(at.line)).toStdString();
+        break;
+    case DiagnosticCode::EXPECTED_INDENT:
+        message = "Indentation Error: Expected INDENT at line " + to_string(at.line);
+        break;
+    case DiagnosticCode::NESTING_TOO_DEEP:
+        message = "Nesting Error: Blocks and expressions nested deeper than " + to_string(m_max_depth) +
+                  " levels at line " + to_string(at.line);
+        break;
+    case DiagnosticCode::CHAINED_COMPARISON:
+        message = "Syntax Error: Chained comparison at '" + text(at).toStdString() + "' at line " +
+                  to_string(at.line) + ". Join the comparisons with 'and'.";
+        break;
+    default:
+        message = "Syntax Error: Unexpected token '" + text(at).toStdString() + "' at line " + to_string(at.line);
+        break;
     }
+    m_error = {{at.line, m_source.columnOf(at.offset), at.length}, code, message};
+    m_failed = true;
 }
 
 unique_ptr<ProgramNode> Parser::parse() {
+    Result<unique_ptr<ProgramNode>> program = tryParse();
+    if (!program) throw SyntaxError(program.error());
+    return std::move(program.value());
+}
+
+Result<unique_ptr<ProgramNode>> Parser::tryParse() {
     auto programNode = make_unique<ProgramNode>();
+    parseInto(*programNode);
+    if (!m_recover && !m_diagnostics.empty()) return m_diagnostics.front();
+    return programNode;
+}
 
-    while (currentToken().type != TokenType::END_OF_FILE) {
-        if (currentToken().type == TokenType::DEDENT || currentToken().type == TokenType::INDENT) {
-            advance();
-            continue;
+void Parser::parseInto(ProgramNode& program) {
+    m_arena = &program.arena;
+    m_open_blocks.clear();
+    m_pending.clear();
+    m_diagnostics.clear();
+    m_failed = false;
+    m_fatal = false;
+
+    // A compound statement's header opens its block (openBlock) and this loop
+    // fills whichever block is innermost, so nesting never deepens the C++ stack
+    bool inStatement = false; // A top-level statement has started and not yet finished
+    for (;;) {
+        if (m_open_blocks.empty()) {
+            if (currentType() == TokenType::DEDENT || currentType() == TokenType::INDENT) {
+                advance();
+            } else if (m_cache && reuseStatements(program)) {
+                // Appended from the cache; the next statement starts after them
+            } else if (currentType() == TokenType::END_OF_FILE) {
+                break;
+            } else {
+                changeState(ParserState::EXPECT_STATEMENT, currentType(), "Start parsing statement");
+                inStatement = true;
+                startStatement();
+                auto stmt = parseStatement();
+                if (stmt && !m_failed) {
+                    program.statements.push_back(stmt);
+                }
+            }
+        } else if (currentType() == TokenType::INDENT) {
+            advance(); // skip extra indent
+        } else if (currentType() == TokenType::DEDENT || currentType() == TokenType::END_OF_FILE) {
+            if (currentType() == TokenType::DEDENT) advance();
+            startStatement(); // An elif, else or except header may follow
+            closeBlock();
+        } else {
+            BlockNode* block = m_open_blocks.back().block; // parseStatement() may open another
+            changeState(ParserState::EXPECT_STATEMENT, currentType(), "Block statement");
+            startStatement();
+            auto stmt = parseStatement();
+            if (stmt && !m_failed) block->statements.push_back(stmt);
+        }
+
+        if (m_failed) {
+            m_diagnostics.push_back(m_error);
+            if (!m_recover || m_fatal) break;
+            m_failed = false;
+
+            // The broken statement becomes an ErrorNode where it would have gone
+            auto error = make<ErrorNode>(m_error.span.line);
+            if (m_open_blocks.empty()) program.statements.push_back(error);
+            else m_open_blocks.back().block->statements.push_back(error);
+            recover(error);
+            if (m_failed) { // The depth check in openBlock(), or the lexer
+                m_diagnostics.push_back(m_error);
+                break;
+            }
         }
 
-        changeState(ParserState::EXPECT_STATEMENT, currentToken(), "Start parsing statement");
-        auto stmt = parseStatement();
-        if (stmt) {
-            programNode->statements.push_back(std::move(stmt));
+        if (inStatement && m_open_blocks.empty()) {
+            changeState(ParserState::END_STATEMENT, currentType(), "Finished statement");
+            inStatement = false;
         }
-        changeState(ParserState::END_STATEMENT, currentToken(), "Finished statement");
     }
-    return programNode;
 }
 
-unique_ptr<BlockNode> Parser::parseBlock() {
-    auto block = make_unique<BlockNode>();
+// The cache appended the statements up to some later token (see StatementCache).
+// The lookahead window only held tokens before that one.
+bool Parser::reuseStatements(ProgramNode& program) {
+    const int end = m_cache->statementStart(m_next, program, int(m_diagnostics.size()));
+    if (end == m_next) return false;
+    m_next = end;
+    m_filled = 0;
+    m_line_hint = -1; // Look the next line up rather than walk to it
+    return true;
+}
 
-    if (currentToken().type == TokenType::INDENT) {
+// Panic mode: drop the rest of the broken statement, which ends with its line
+// (a token on a later line already starts the next one). An indented suite after
+// it is still parsed, as the ErrorNode's body, so its own errors are found and
+// its DEDENT does not close the enclosing block.
+void Parser::recover(ErrorNode* error) {
+    m_pending.clear();
+    for (;;) {
+        const TokenType type = currentType();
+        if (type == TokenType::END_OF_FILE || type == TokenType::DEDENT) return;
+        if (type == TokenType::INDENT) {
+            error->body = openBlock(error);
+            return;
+        }
+        if (currentToken().line > m_statement_line) return;
         advance();
-    } else {
-        // Explicit check for indentation start
-        Token t = currentToken();
-        throw runtime_error("Indentation Error: Expected INDENT at line " + to_string(t.line));
     }
+}
 
-    while (currentToken().type != TokenType::DEDENT && currentToken().type != TokenType::END_OF_FILE) {
-        if (currentToken().type == TokenType::INDENT) {
-            advance(); // skip extra indent
-            continue;
-        }
-
-        changeState(ParserState::EXPECT_STATEMENT, currentToken(), "Block statement");
-        auto stmt = parseStatement();
-        if (stmt) block->statements.push_back(std::move(stmt));
-    }
+void Parser::checkDepth() {
+    if (int(m_open_blocks.size() + m_pending.size()) <= m_max_depth || m_failed) return;
+    m_fatal = true;
+    fail(DiagnosticCode::NESTING_TOO_DEEP);
+}
 
-    if (currentToken().type == TokenType::DEDENT) {
+// nullptr, with nothing opened, if the header is not followed by an indented block
+BlockNode* Parser::openBlock(ASTNode* owner, bool alternative) {
+    if (currentType() == TokenType::INDENT) {
         advance();
+    } else {
+        // Explicit check for indentation start
+        fail(DiagnosticCode::EXPECTED_INDENT);
+        return nullptr;
     }
 
+    auto block = make<BlockNode>(*m_arena);
+    m_open_blocks.push_back({owner, block, alternative});
+    checkDepth();
     return block;
 }
 
-unique_ptr<ASTNode> Parser::parseStatement() {
+// The innermost block has ended: an if may continue with elif/else, a try with except
+void Parser::closeBlock() {
+    const OpenBlock closed = m_open_blocks.back();
+    m_open_blocks.pop_back();
+    if (closed.alternative) return;
+
+    if (auto ifNode = node_cast<IfNode>(closed.owner)) {
+        if (currentType() == TokenType::ELIF) {
+            auto elif = parseIfStatement();
+            if (!m_failed) ifNode->else_branch = elif;
+        } else if (currentType() == TokenType::ELSE) {
+            advance();
+            expect(TokenType::COLON);
+            ifNode->else_branch = openBlock(ifNode, true);
+        }
+    } else if (auto tryNode = node_cast<TryExceptNode>(closed.owner)) {
+        if (currentType() == TokenType::EXCEPT) {
+            changeState(ParserState::IN_EXCEPT_BLOCK, currentType(), "Except Block");
+            advance();
+            expect(TokenType::COLON);
+            tryNode->except_body = openBlock(tryNode, true);
+        }
+    }
+}
+
+ASTNode* Parser::parseStatement() {
     // Clean up any leading indentation tokens
-    while (currentToken().type == TokenType::INDENT || currentToken().type == TokenType::DEDENT) {
+    while (currentType() == TokenType::INDENT || currentType() == TokenType::DEDENT) {
         advance();
     }
-    if (currentToken().type == TokenType::END_OF_FILE) return nullptr;
+    if (currentType() == TokenType::END_OF_FILE) return nullptr;
 
-    switch(currentToken().type) {
+    switch(currentType()) {
     case TokenType::DEF:    return parseFunctionDefinition();
     case TokenType::IF:     return parseIfStatement();
     case TokenType::WHILE:  return parseWhileStatement();
     case TokenType::FOR:    return parseForStatement();
     case TokenType::TRY:    return parseTryExceptStatement();
     case TokenType::RETURN:
-        changeState(ParserState::IN_EXPRESSION, currentToken(), "Return");
+        changeState(ParserState::IN_EXPRESSION, currentType(), "Return");
         advance();
-        return make_unique<ReturnNode>(parseExpression());
+        return make<ReturnNode>(parseExpression());
     case TokenType::PRINT:
-        changeState(ParserState::IN_EXPRESSION, currentToken(), "Print");
+        changeState(ParserState::IN_EXPRESSION, currentType(), "Print");
         advance();
-        return make_unique<PrintNode>(parseExpression());
+        return make<PrintNode>(parseExpression());
     case TokenType::IDENTIFIER:
         return parseAssignmentOrExpression();
     default:
@@ -117,298 +318,340 @@ unique_ptr<ASTNode> Parser::parseStatement() {
     }
 }
 
-unique_ptr<ASTNode> Parser::parseAssignmentOrExpression() {
-    Token idToken = currentToken();
-    Token next1 = peekToken(1);
-    Token next2 = peekToken(2);
+ASTNode* Parser::parseAssignmentOrExpression() {
+    const Token& idToken = currentToken(); // Only read before the first advance()
+    TokenType next1 = peekType(1);
+    TokenType next2 = peekType(2);
 
     // Case 1: Standard Assignment (x = 5)
-    if (next1.type == TokenType::EQUAL) {
-        changeState(ParserState::IN_ASSIGNMENT, currentToken(), "Standard Assignment");
-        auto idNode = make_unique<IdentifierNode>(idToken);
+    if (next1 == TokenType::EQUAL) {
+        changeState(ParserState::IN_ASSIGNMENT, currentType(), "Standard Assignment");
+        auto idNode = make<IdentifierNode>(idToken);
         advance(); // consume ID
         advance(); // consume =
         auto expr = parseExpression();
-        return make_unique<AssignmentNode>(std::move(idNode), std::move(expr));
+        return make<AssignmentNode>(idNode, expr);
     }
 
     // Case 2: Complex Assignment via Desugaring (x += 5 -> x = x + 5)
     bool isComplex = false;
-    Token opToken; // Placeholder for initialization
 
-    if (next2.type == TokenType::EQUAL) {
-        if (next1.type == TokenType::PLUS) { isComplex = true; }
-        else if (next1.type == TokenType::MINUS) { isComplex = true; }
-        else if (next1.type == TokenType::STAR) { isComplex = true; }
-        else if (next1.type == TokenType::SLASH) { isComplex = true; }
+    if (next2 == TokenType::EQUAL) {
+        if (next1 == TokenType::PLUS) { isComplex = true; }
+        else if (next1 == TokenType::MINUS) { isComplex = true; }
+        else if (next1 == TokenType::STAR) { isComplex = true; }
+        else if (next1 == TokenType::SLASH) { isComplex = true; }
+        else if (next1 == TokenType::DOUBLE_SLASH) { isComplex = true; }
+        else if (next1 == TokenType::PERCENT) { isComplex = true; }
+        else if (next1 == TokenType::DOUBLE_STAR) { isComplex = true; }
     }
 
     if (isComplex) {
-        changeState(ParserState::IN_ASSIGNMENT, currentToken(), "Complex Assignment");
+        changeState(ParserState::IN_ASSIGNMENT, currentType(), "Complex Assignment");
         // Construct: ID = ID op Expr
-        auto leftId = make_unique<IdentifierNode>(idToken); // For LHS
-        auto rightId = make_unique<IdentifierNode>(idToken); // For RHS inside binary op
+        auto leftId = make<IdentifierNode>(idToken); // For LHS
+        auto rightId = make<IdentifierNode>(idToken); // For RHS inside binary op
 
         advance(); // consume ID
-        opToken = currentToken(); // The +, -, *, /
+        // The arithmetic operator; the right operand is filled in once it is parsed
+        auto binaryOpNode = make<BinaryOpNode>(rightId, currentToken(), operatorSpelling(currentType()), nullptr);
         advance(); // consume Op
         advance(); // consume =
 
-        auto rightExpr = parseExpression();
-
-        auto binaryOpNode = make_unique<BinaryOpNode>(std::move(rightId), opToken, std::move(rightExpr));
-        return make_unique<AssignmentNode>(std::move(leftId), std::move(binaryOpNode));
+        binaryOpNode->right = parseExpression();
+        return make<AssignmentNode>(leftId, binaryOpNode);
     }
 
     // Case 3: Expression / Function Call
-    auto idNode = make_unique<IdentifierNode>(idToken);
+    auto idNode = make<IdentifierNode>(idToken);
     advance(); // consume ID
 
-    if (currentToken().type == TokenType::LPAREN) {
-        changeState(ParserState::IN_FUNCTION_CALL, currentToken(), "Function Call");
+    if (currentType() == TokenType::LPAREN) {
+        changeState(ParserState::IN_FUNCTION_CALL, currentType(), "Function Call");
         advance(); // (
-        vector<unique_ptr<ASTNode>> args;
-        if (currentToken().type != TokenType::RPAREN) {
+        ArenaVector<ASTNode*> args(*m_arena);
+        if (currentType() != TokenType::RPAREN) {
             args.push_back(parseExpression());
-            while (currentToken().type == TokenType::COMMA) {
+            while (currentType() == TokenType::COMMA) {
                 advance();
                 args.push_back(parseExpression());
             }
         }
         expect(TokenType::RPAREN);
-        return make_unique<FunctionCallNode>(std::move(idNode), std::move(args));
+        return make<FunctionCallNode>(idNode, args);
     }
 
     return idNode;
 }
 
-unique_ptr<ASTNode> Parser::parseFunctionDefinition() {
-    changeState(ParserState::IN_FUNCTION_DEF, currentToken(), "Func Def");
+ASTNode* Parser::parseFunctionDefinition() {
+    changeState(ParserState::IN_FUNCTION_DEF, currentType(), "Func Def");
     expect(TokenType::DEF);
-    auto name = make_unique<IdentifierNode>(currentToken());
+    auto name = make<IdentifierNode>(currentToken());
     expect(TokenType::IDENTIFIER);
 
-    changeState(ParserState::IN_FUNCTION_PARAMS, currentToken(), "Func Params");
+    changeState(ParserState::IN_FUNCTION_PARAMS, currentType(), "Func Params");
     expect(TokenType::LPAREN);
-    vector<unique_ptr<IdentifierNode>> params;
+    ArenaVector<IdentifierNode*> params(*m_arena);
 
-    if (currentToken().type != TokenType::RPAREN) {
-        params.push_back(make_unique<IdentifierNode>(currentToken()));
+    if (currentType() != TokenType::RPAREN) {
+        params.push_back(make<IdentifierNode>(currentToken()));
         expect(TokenType::IDENTIFIER);
-        while (currentToken().type == TokenType::COMMA) {
+        while (currentType() == TokenType::COMMA) {
             advance();
-            params.push_back(make_unique<IdentifierNode>(currentToken()));
+            params.push_back(make<IdentifierNode>(currentToken()));
             expect(TokenType::IDENTIFIER);
         }
     }
     expect(TokenType::RPAREN);
     expect(TokenType::COLON);
 
-    changeState(ParserState::IN_FUNCTION_BODY, currentToken(), "Func Body");
-    auto body = parseBlock();
-    return make_unique<FunctionDefNode>(std::move(name), std::move(params), std::move(body));
+    changeState(ParserState::IN_FUNCTION_BODY, currentType(), "Func Body");
+    auto def = make<FunctionDefNode>(name, params, nullptr);
+    def->body = openBlock(def);
+    return def;
 }
 
-unique_ptr<ASTNode> Parser::parseForStatement() {
-    changeState(ParserState::IN_IF_CONDITION, currentToken(), "For Loop");
+ASTNode* Parser::parseForStatement() {
+    changeState(ParserState::IN_IF_CONDITION, currentType(), "For Loop");
     expect(TokenType::FOR);
-    auto iterator = make_unique<IdentifierNode>(currentToken());
+    auto iterator = make<IdentifierNode>(currentToken());
     expect(TokenType::IDENTIFIER);
     expect(TokenType::IN);
 
     // Check if generic or range
-    if (currentToken().type == TokenType::IDENTIFIER && currentToken().value == "range") {
+    static const SymbolId range = symbolOf("range");
+    if (currentType() == TokenType::IDENTIFIER && currentToken().symbol == range) {
         // --- RANGE LOOP ---
         advance(); // consume 'range'
         expect(TokenType::LPAREN);
-        vector<unique_ptr<ASTNode>> args;
+        ArenaVector<ASTNode*> args(*m_arena);
         args.push_back(parseExpression());
-        while (currentToken().type == TokenType::COMMA) {
+        while (currentType() == TokenType::COMMA) {
             advance();
             args.push_back(parseExpression());
         }
         expect(TokenType::RPAREN);
         expect(TokenType::COLON);
 
-        unique_ptr<ASTNode> start, stop, step;
+        ASTNode* start = nullptr;
+        ASTNode* stop = nullptr;
+        ASTNode* step = nullptr;
         if (args.size() == 1) {
-            start = make_unique<NumberNode>(Token{TokenType::NUMBER, "0", 0});
+            start = make<NumberNode>(0, QStringView(u"0"));
             stop = std::move(args[0]);
-            step = make_unique<NumberNode>(Token{TokenType::NUMBER, "1", 0});
+            step = make<NumberNode>(0, QStringView(u"1"));
         } else if (args.size() == 2) {
             start = std::move(args[0]);
             stop = std::move(args[1]);
-            step = make_unique<NumberNode>(Token{TokenType::NUMBER, "1", 0});
+            step = make<NumberNode>(0, QStringView(u"1"));
         } else if (args.size() >= 3) {
             start = std::move(args[0]);
             stop = std::move(args[1]);
             step = std::move(args[2]);
         }
 
-        changeState(ParserState::IN_IF_BODY, currentToken(), "For Body");
-        auto body = parseBlock();
-        return make_unique<ForNode>(std::move(iterator), std::move(start), std::move(stop), std::move(step), std::move(body));
+        changeState(ParserState::IN_IF_BODY, currentType(), "For Body");
+        auto loop = make<ForNode>(iterator, start, stop, step, nullptr);
+        loop->body = openBlock(loop);
+        return loop;
     }
     else {
         // --- GENERIC LOOP ---
         auto iterable = parseExpression();
         expect(TokenType::COLON);
-        changeState(ParserState::IN_IF_BODY, currentToken(), "For Body");
-        auto body = parseBlock();
-        return make_unique<ForNode>(std::move(iterator), std::move(iterable), std::move(body));
+        changeState(ParserState::IN_IF_BODY, currentType(), "For Body");
+        auto loop = make<ForNode>(iterator, iterable, nullptr);
+        loop->body = openBlock(loop);
+        return loop;
     }
 }
 
-unique_ptr<ASTNode> Parser::parseIfStatement() {
-    changeState(ParserState::IN_IF_CONDITION, currentToken(), "If Condition");
-    if (currentToken().type == TokenType::ELIF) expect(TokenType::ELIF);
+ASTNode* Parser::parseIfStatement() {
+    changeState(ParserState::IN_IF_CONDITION, currentType(), "If Condition");
+    if (currentType() == TokenType::ELIF) expect(TokenType::ELIF);
     else expect(TokenType::IF);
 
     auto condition = parseExpression();
     expect(TokenType::COLON);
-    changeState(ParserState::IN_IF_BODY, currentToken(), "If Body");
-    auto body = parseBlock();
-
-    auto ifNode = make_unique<IfNode>(std::move(condition), std::move(body));
-
-    while (currentToken().type == TokenType::INDENT || currentToken().type == TokenType::DEDENT) advance();
-
-    if (currentToken().type == TokenType::ELIF) {
-        ifNode->else_branch = parseIfStatement();
-    } else if (currentToken().type == TokenType::ELSE) {
-        advance();
-        expect(TokenType::COLON);
-        ifNode->else_branch = parseBlock();
-    }
+    changeState(ParserState::IN_IF_BODY, currentType(), "If Body");
+    auto ifNode = make<IfNode>(condition, nullptr);
+    ifNode->body = openBlock(ifNode); // closeBlock() picks up elif/else
     return ifNode;
 }
 
-unique_ptr<ASTNode> Parser::parseWhileStatement() {
-    changeState(ParserState::IN_IF_CONDITION, currentToken(), "While Condition");
+ASTNode* Parser::parseWhileStatement() {
+    changeState(ParserState::IN_IF_CONDITION, currentType(), "While Condition");
     expect(TokenType::WHILE);
     auto condition = parseExpression();
     expect(TokenType::COLON);
-    changeState(ParserState::IN_IF_BODY, currentToken(), "While Body");
-    auto body = parseBlock();
-    return make_unique<WhileNode>(std::move(condition), std::move(body));
+    changeState(ParserState::IN_IF_BODY, currentType(), "While Body");
+    auto loop = make<WhileNode>(condition, nullptr);
+    loop->body = openBlock(loop);
+    return loop;
 }
 
-unique_ptr<ASTNode> Parser::parseTryExceptStatement() {
-    changeState(ParserState::IN_TRY_BLOCK, currentToken(), "Try Block");
+ASTNode* Parser::parseTryExceptStatement() {
+    changeState(ParserState::IN_TRY_BLOCK, currentType(), "Try Block");
     expect(TokenType::TRY);
     expect(TokenType::COLON);
-    auto tryBody = parseBlock();
-
-    while (currentToken().type == TokenType::INDENT || currentToken().type == TokenType::DEDENT) advance();
-
-    unique_ptr<BlockNode> exceptBody = nullptr;
-    if (currentToken().type == TokenType::EXCEPT) {
-        changeState(ParserState::IN_EXCEPT_BLOCK, currentToken(), "Except Block");
-        advance();
-        expect(TokenType::COLON);
-        exceptBody = parseBlock();
-    }
-    return make_unique<TryExceptNode>(std::move(tryBody), std::move(exceptBody));
+    auto tryNode = make<TryExceptNode>(nullptr, nullptr);
+    tryNode->try_body = openBlock(tryNode); // closeBlock() picks up except
+    return tryNode;
 }
 
 // --- Expression Parsing ---
 
-unique_ptr<ASTNode> Parser::parseExpression() {
-    changeState(ParserState::IN_EXPRESSION, currentToken(), "Expression");
-    return parseLogicalOr();
-}
-
-unique_ptr<ASTNode> Parser::parseLogicalOr() {
-    auto node = parseComparison();
-    while (currentToken().type == TokenType::OR) {
-        Token op = currentToken();
-        advance();
-        auto right = parseComparison();
-        node = make_unique<BinaryOpNode>(std::move(node), op, std::move(right));
+// Binding powers for precedence climbing, loosest first, as in Python:
+//   or < and < not < comparisons < + - < * / // % < unary - < **
+// Comparisons do not chain, though: Python reads a < b < c as a < b and b < c,
+// which the translated C++ would not, so a comparison without brackets around
+// it cannot be the left operand of another (see parseExpression()). Nor can a
+// 'not' be the operand of anything tighter than itself.
+// An infix operator binds its left operand with 'left' and parses its right
+// operand with 'right': right = left + 1 makes it left-associative, equal
+// powers (**) make it right-associative. 'prefix' is the power a prefix
+// operator parses its operand with; 0 means the token is not that kind of operator.
+struct BindingPower {
+    uint8_t left = 0;
+    uint8_t right = 0;
+    uint8_t prefix = 0;
+};
+
+struct BindingPowerTable {
+    BindingPower of[Parser::TOKEN_TYPE_COUNT] = {};
+};
+
+constexpr BindingPowerTable buildBindingPowers() {
+    BindingPowerTable table;
+    table.of[int(TokenType::OR)] = {1, 2};
+    table.of[int(TokenType::AND)] = {3, 4};
+    table.of[int(TokenType::NOT)].prefix = 5;
+    for (TokenType t : {TokenType::DOUBLE_EQUAL, TokenType::NOT_EQUAL, TokenType::LESS,
+                        TokenType::LESS_EQUAL, TokenType::GREATER, TokenType::GREATER_EQUAL}) {
+        table.of[int(t)] = {7, 8};
     }
-    return node;
-}
-
-unique_ptr<ASTNode> Parser::parseComparison() {
-    auto node = parseTerm();
-    while (currentToken().type == TokenType::GREATER ||
-           currentToken().type == TokenType::LESS_EQUAL ||
-           currentToken().type == TokenType::DOUBLE_EQUAL) {
-        Token op = currentToken();
-        advance();
-        auto right = parseTerm();
-        node = make_unique<BinaryOpNode>(std::move(node), op, std::move(right));
+    table.of[int(TokenType::PLUS)] = {9, 10};
+    table.of[int(TokenType::MINUS)] = {9, 10, 13}; // Also unary minus
+    for (TokenType t : {TokenType::STAR, TokenType::SLASH, TokenType::DOUBLE_SLASH, TokenType::PERCENT}) {
+        table.of[int(t)] = {11, 12};
     }
-    return node;
+    table.of[int(TokenType::DOUBLE_STAR)] = {15, 15}; // -2 ** 2 is -(2 ** 2), 2 ** -1 is allowed
+    return table;
 }
 
-unique_ptr<ASTNode> Parser::parseTerm() {
-    auto node = parseFactor();
-    while (currentToken().type == TokenType::PLUS || currentToken().type == TokenType::MINUS) {
-        Token op = currentToken();
-        advance();
-        auto right = parseFactor();
-        node = make_unique<BinaryOpNode>(std::move(node), op, std::move(right));
-    }
-    return node;
-}
+constexpr BindingPowerTable BINDING_POWER = buildBindingPowers();
 
-unique_ptr<ASTNode> Parser::parseFactor() {
-    auto node = parseUnary();
-    while (currentToken().type == TokenType::STAR || currentToken().type == TokenType::SLASH) {
-        Token op = currentToken();
-        advance();
-        auto right = parseUnary();
-        node = make_unique<BinaryOpNode>(std::move(node), op, std::move(right));
-    }
-    return node;
+static bool isComparison(TokenType type) {
+    return BINDING_POWER.of[int(type)].left == BINDING_POWER.of[int(TokenType::LESS)].left;
 }
 
-unique_ptr<ASTNode> Parser::parseUnary() {
-    if (currentToken().type == TokenType::NOT || currentToken().type == TokenType::MINUS) {
-        Token op = currentToken();
-        advance();
-        auto right = parseUnary();
-        return make_unique<UnaryOpNode>(op, std::move(right));
-    }
-    return parsePrimary();
-}
-
-unique_ptr<ASTNode> Parser::parsePrimary() {
-    Token t = currentToken();
-    switch(t.type) {
-    case TokenType::NONE:   advance(); return make_unique<NoneNode>();
-    case TokenType::TRUE:   advance(); return make_unique<NumberNode>(Token{TokenType::NUMBER, "1"});
-    case TokenType::FALSE:  advance(); return make_unique<NumberNode>(Token{TokenType::NUMBER, "0"});
-    case TokenType::NUMBER: advance(); return make_unique<NumberNode>(t);
-    case TokenType::STRING: advance(); return make_unique<StringNode>(t);
-    case TokenType::LPAREN: {
-        advance();
-        auto expr = parseExpression();
-        expect(TokenType::RPAREN);
-        return expr;
-    }
-    case TokenType::IDENTIFIER: {
-        auto name = make_unique<IdentifierNode>(t);
-        advance();
-        // Function Call Check
-        if (currentToken().type == TokenType::LPAREN) {
+// Precedence climbing with an explicit stack: every prefix operator, '(' and
+// call that is still open, and every infix operator still waiting for its right
+// operand, sits on m_pending. An operand binds to the operator after it while
+// that operator's left power is at least the right power of the innermost
+// pending one; otherwise the pending operator takes the operand and closes.
+ASTNode* Parser::parseExpression() {
+    changeState(ParserState::IN_EXPRESSION, currentType(), "Expression");
+    const size_t base = m_pending.size();
+    m_expressions++;
+
+    for (;;) {
+        // Operand position
+        ASTNode* node;
+        const TokenType type = currentType();
+        if (const int prefix = BINDING_POWER.of[int(type)].prefix) {
+            // 'not' is looser than the operator waiting for it, so Python has
+            // no a + not b; a unary minus is tighter than all but **
+            if (m_pending.size() > base && m_pending.back().power > prefix && type == TokenType::NOT) {
+                fail(DiagnosticCode::UNEXPECTED_TOKEN);
+                continue; // Unwinds: there are no more tokens
+            }
+            pushPending(make<UnaryOpNode>(currentToken(), operatorSpelling(type), nullptr), prefix);
             advance();
-            vector<unique_ptr<ASTNode>> args;
-            if (currentToken().type != TokenType::RPAREN) {
-                args.push_back(parseExpression());
-                while (currentToken().type == TokenType::COMMA) {
+            continue;
+        }
+        if (type == TokenType::LPAREN) {
+            advance();
+            pushPending(nullptr, 0);
+            changeState(ParserState::IN_EXPRESSION, currentType(), "Expression");
+            continue;
+        }
+        if (type == TokenType::IDENTIFIER && peekType(1) == TokenType::LPAREN) {
+            auto call = make<FunctionCallNode>(make<IdentifierNode>(currentToken()), ArenaVector<ASTNode*>(*m_arena));
+            advance(); // name
+            advance(); // (
+            if (currentType() != TokenType::RPAREN) {
+                pushPending(call, 0);
+                changeState(ParserState::IN_EXPRESSION, currentType(), "Expression");
+                continue;
+            }
+            advance(); // )
+            node = call;
+        } else {
+            node = parsePrimary();
+        }
+
+        // Operator position: bind to the next operator, or close pending ones
+        const BinaryOpNode* comparison = nullptr; // Closed here, with no bracket around it since
+        for (;;) {
+            const int minPower = m_pending.size() > base ? m_pending.back().power : 0;
+            const BindingPower& power = BINDING_POWER.of[int(currentType())];
+            if (power.left != 0 && power.left >= minPower) {
+                if (node && node == comparison && isComparison(currentType())) {
+                    fail(DiagnosticCode::CHAINED_COMPARISON);
+                    continue; // Unwinds: there are no more tokens
+                }
+                pushPending(make<BinaryOpNode>(node, currentToken(), operatorSpelling(currentType()), nullptr),
+                            power.right);
+                advance();
+                break;
+            }
+            if (m_pending.size() == base) return node;
+
+            ASTNode* open = m_pending.back().node;
+            if (!open) {
+                m_pending.pop_back();
+                expect(TokenType::RPAREN);
+                comparison = nullptr;
+            } else if (auto unary = node_cast<UnaryOpNode>(open)) {
+                m_pending.pop_back();
+                unary->right = node;
+                node = unary;
+            } else if (auto binary = node_cast<BinaryOpNode>(open)) {
+                m_pending.pop_back();
+                binary->right = node;
+                node = binary;
+                if (isComparison(binary->op)) comparison = binary;
+            } else {
+                auto call = static_cast<FunctionCallNode*>(open);
+                call->arguments.push_back(node);
+                if (currentType() == TokenType::COMMA) {
                     advance();
-                    args.push_back(parseExpression());
+                    changeState(ParserState::IN_EXPRESSION, currentType(), "Expression");
+                    break; // Next argument; the call stays pending
                 }
+                m_pending.pop_back();
+                expect(TokenType::RPAREN);
+                node = call;
             }
-            expect(TokenType::RPAREN);
-            return make_unique<FunctionCallNode>(std::move(name), std::move(args));
         }
-        return name;
     }
+}
+
+// Leaves only: brackets and calls are opened by parseExpression()
+ASTNode* Parser::parsePrimary() {
+    const Token& t = currentToken(); // Nodes are built from it before advance()
+    ASTNode* leaf;
+    switch(currentType()) {
+    case TokenType::NONE:   advance(); return make<NoneNode>();
+    case TokenType::TRUE:   advance(); return make<NumberNode>(0, QStringView(u"1"));
+    case TokenType::FALSE:  advance(); return make<NumberNode>(0, QStringView(u"0"));
+    case TokenType::NUMBER: leaf = make<NumberNode>(t.line, arenaText(t)); advance(); return leaf;
+    case TokenType::STRING: leaf = make<StringNode>(t.line, arenaText(t)); advance(); return leaf;
+    case TokenType::IDENTIFIER: leaf = make<IdentifierNode>(t); advance(); return leaf;
     default:
-        // CHANGED: Trigger error detection
-        throw runtime_error("Syntax Error: Unexpected token '" + t.value.toStdString() + "' at line " + to_string(t.line));
+        fail(DiagnosticCode::UNEXPECTED_TOKEN);
+        return nullptr;
     }
 }
@@ -2,7 +2,11 @@
 #define PARSER_H
 
 #include "token.h"
+#include "lexer.h"
 #include "ast.h"
+#include "diagnostic.h"
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <memory>
 #include <utility>
@@ -38,45 +42,194 @@ struct AutomatonTransition {
         : fromState(from), toState(to), triggerToken(token) {}
 };
 
+// How much of its automaton walk a Parser records for visualization
+enum class ParserTrace {
+    OFF,    // Nothing (live checking, batch translation)
+    COUNTS, // How often each (from, to, trigger) transition fired
+    FULL    // COUNTS plus the state history and transition log in order
+};
+
+// Thrown by parse() for syntax, indentation and nesting errors; the message names the line too
+class SyntaxError : public runtime_error {
+public:
+    explicit SyntaxError(const Diagnostic& diagnostic)
+        : runtime_error(diagnostic.message), m_diagnostic(diagnostic) {}
+    const Diagnostic& diagnostic() const { return m_diagnostic; }
+    int line() const { return m_diagnostic.span.line; }
+
+private:
+    Diagnostic m_diagnostic;
+};
+
+// Asked at the start of every top-level statement of a buffered parse whether it
+// already has the statements from there on (see IncrementalParser)
+class StatementCache {
+public:
+    virtual ~StatementCache() = default;
+    // 'first' is the token the statement starts at, or END_OF_FILE once the input
+    // is done; 'errors' is how many diagnostics the parse has so far. Either append
+    // the statements for tokens [first, end) to 'program' and return end, or
+    // return 'first' to have them parsed.
+    virtual int statementStart(int first, ProgramNode& program, int errors) = 0;
+};
+
 class Parser {
 public:
-    Parser(const vector<Token>& tokens);
+    static constexpr int STATE_COUNT = int(ParserState::END_STATEMENT) + 1;
+    static constexpr int TOKEN_TYPE_COUNT = int(TokenType::EXCEPT) + 1;
+    static constexpr int DEFAULT_MAX_DEPTH = 10000;
+
+    // Streaming: tokens are pulled from the lexer on demand
+    explicit Parser(Lexer& lexer, ParserTrace trace = ParserTrace::OFF);
+    // Borrowed: reads an already lexed buffer in place (it must outlive the parser)
+    Parser(const TokenBuffer& tokens, SourceView source, ParserTrace trace = ParserTrace::OFF);
+    // Without error recovery parse() throws a SyntaxError at the first error and
+    // tryParse() returns it instead; nothing is thrown inside the parser either way
     unique_ptr<ProgramNode> parse();
+    Result<unique_ptr<ProgramNode>> tryParse();
+    // Appends the statements to an existing program, in its arena; errors are
+    // left in diagnostics() (IncrementalParser keeps one program across edits)
+    void parseInto(ProgramNode& program);
+
+    // How deep blocks and brackets/operators may nest together before parse()
+    // gives up with a "Nesting Error". Nesting costs heap, not stack, so this only
+    // bounds what pathological input can make every later pass chew through.
+    void setMaxDepth(int depth) { m_max_depth = depth; }
+    int maxDepth() const { return m_max_depth; }
+
+    // Off: parsing stops at the first error. On: it records each error, leaves an
+    // ErrorNode in place of the broken statement and carries on at the next line,
+    // so one pass reports every error and still returns a tree of the rest. Only
+    // a Nesting Error or a lexer error ends the parse early.
+    void setErrorRecovery(bool recover) { m_recover = recover; }
+    const vector<Diagnostic>& diagnostics() const { return m_diagnostics; }
+
+    // Borrowed buffers only (ignored when streaming). Statements the cache
+    // supplies are not traced.
+    void setStatementCache(StatementCache* cache) { m_cache = m_tokens ? cache : nullptr; }
+
+    // Whole expressions read so far, i.e. parseExpression() calls (for --bench-parser)
+    int expressionCount() const { return m_expressions; }
 
     // For Visualization
-    vector<pair<ParserState, Token>> getStateHistory() const { return m_state_history; }
-    vector<AutomatonTransition> getTransitions() const { return m_transitions; }
+    ParserTrace trace() const { return m_trace; }
+    ParserState currentState() const { return m_current_state; }
+    // COUNTS and FULL only (0 otherwise)
+    uint32_t transitionCount(ParserState from, ParserState to, TokenType trigger) const {
+        return m_transition_counts.empty() ? 0 : m_transition_counts[countIndex(from, to, trigger)];
+    }
+    // FULL only (empty otherwise)
+    const vector<pair<ParserState, TokenType>>& getStateHistory() const { return m_state_history; }
+    const vector<AutomatonTransition>& getTransitions() const { return m_transitions; }
 
 private:
-    vector<Token> m_tokens;
-    int m_pos = 0;
+    // Token source: exactly one of these is set
+    Lexer* m_lexer = nullptr;
+    const TokenBuffer* m_tokens = nullptr;
+    const uint8_t* m_kinds = nullptr; // Type checks scan these bytes, not whole tokens
+    int m_count = 0;
+    int m_next = 0;      // Index of the current token in m_tokens
+    int m_line_hint = 0; // Line-table run of the last token materialized from m_tokens
+
+    StatementCache* m_cache = nullptr;
+    SourceView m_source; // Buffer the token spans point into (must outlive parse())
+    Arena* m_arena = nullptr; // The tree being built allocates here (owned by its ProgramNode)
+
+    // Lookahead window: the current token plus what peekToken() asked for.
+    // The grammar needs at most peekToken(2), so a few slots are enough.
+    // Streaming fills it from the lexer; a borrowed buffer only materializes
+    // the tokens whose fields are actually read.
+    static constexpr int LOOKAHEAD = 4; // Power of two
+    Token m_ring[LOOKAHEAD];
+    int m_head = 0;   // Slot of the current token
+    int m_filled = 0; // Buffered tokens starting at m_head
+    Token m_eof{TokenType::END_OF_FILE}; // Returned for any lookahead past the end of a buffer
     ParserState m_current_state = ParserState::START;
-    vector<pair<ParserState, Token>> m_state_history;
+    ParserTrace m_trace = ParserTrace::OFF;
+    vector<uint32_t> m_transition_counts; // STATE_COUNT x STATE_COUNT x TOKEN_TYPE_COUNT, dense
+    vector<pair<ParserState, TokenType>> m_state_history; // Only the trigger's kind is drawn
     vector<AutomatonTransition> m_transitions;
 
-    void changeState(ParserState newState, Token triggerToken, const QString& description);
+    static int countIndex(ParserState from, ParserState to, TokenType trigger) {
+        return (int(from) * STATE_COUNT + int(to)) * TOKEN_TYPE_COUNT + int(trigger);
+    }
+    void startTrace();
+    // The description only documents the call site
+    void changeState(ParserState newState, TokenType trigger, const char* /*description*/) {
+        if (m_trace != ParserTrace::OFF) recordTransition(newState, trigger);
+        m_current_state = newState;
+    }
+    void recordTransition(ParserState newState, TokenType trigger);
 
-    Token currentToken();
-    Token peekToken(int offset = 1);
+    // Compound statements whose block is still being read, innermost last.
+    // Statements nest through this stack instead of through recursion.
+    struct OpenBlock {
+        ASTNode* owner;   // If, While, For, FunctionDef or TryExcept
+        BlockNode* block;
+        bool alternative; // The else/except block rather than the body
+    };
+    vector<OpenBlock> m_open_blocks;
+
+    // Operators and brackets of the current expression still waiting for their
+    // right-hand side, innermost last (see parseExpression)
+    struct PendingOperator {
+        ASTNode* node; // UnaryOpNode, BinaryOpNode or FunctionCallNode; nullptr for '('
+        int power;     // Binding power the right-hand side is parsed with
+    };
+    vector<PendingOperator> m_pending;
+    int m_max_depth = DEFAULT_MAX_DEPTH;
+    int m_expressions = 0;
+
+    bool m_recover = false;
+    bool m_failed = false;       // Unwinding from m_error (see fail())
+    bool m_fatal = false;        // m_error is a Nesting Error or the lexer's; recovery stops there
+    Diagnostic m_error;
+    int m_statement_line = 0;    // Where the statement being parsed starts (recovery only)
+    vector<Diagnostic> m_diagnostics;
+
+    void startStatement() {
+        if (m_recover) m_statement_line = currentToken().line;
+    }
+    // Records the error at the current token (see parser.cpp)
+    Q_DECL_COLD_FUNCTION void fail(DiagnosticCode code, TokenType expected = TokenType::ILLEGAL);
+    void recover(ErrorNode* error);
+    bool reuseStatements(ProgramNode& program);
+    void checkDepth();
+    BlockNode* openBlock(ASTNode* owner, bool alternative = false);
+    void closeBlock();
+    void pushPending(ASTNode* node, int power) {
+        m_pending.push_back({node, power});
+        checkDepth();
+    }
+
+    QString text(const Token& token) const;
+    QStringView arenaText(const Token& token);
+    template <typename T, typename... Args> T* make(Args&&... args) {
+        return m_arena->make<T>(std::forward<Args>(args)...);
+    }
+    Token pull();
+    Token pullFromLexer();
+    const Token& lookahead(int offset);
+    TokenType currentType() { return peekType(0); }
+    TokenType peekType(int offset = 1);
+    // Borrowed: a reference stays valid until the next advance()
+    const Token& currentToken() { return peekToken(0); }
+    const Token& peekToken(int offset = 1);
     void advance();
     void expect(TokenType type);
 
-    unique_ptr<ASTNode> parseStatement();
-    unique_ptr<BlockNode> parseBlock();
-    unique_ptr<ASTNode> parseExpression();
-    unique_ptr<ASTNode> parseLogicalOr();
-    unique_ptr<ASTNode> parseComparison();
-    unique_ptr<ASTNode> parseTerm();
-    unique_ptr<ASTNode> parseFactor();
-    unique_ptr<ASTNode> parseUnary();
-    unique_ptr<ASTNode> parsePrimary();
-
-    unique_ptr<ASTNode> parseFunctionDefinition();
-    unique_ptr<ASTNode> parseIfStatement();
-    unique_ptr<ASTNode> parseWhileStatement();
-    unique_ptr<ASTNode> parseForStatement();
-    unique_ptr<ASTNode> parseTryExceptStatement();
-    unique_ptr<ASTNode> parseAssignmentOrExpression();
+    ASTNode* parseStatement();
+    ASTNode* parseExpression();
+    ASTNode* parsePrimary();
+
+    // Compound statements: each reads its header and opens its block, which
+    // parse() then fills
+    ASTNode* parseFunctionDefinition();
+    ASTNode* parseIfStatement();
+    ASTNode* parseWhileStatement();
+    ASTNode* parseForStatement();
+    ASTNode* parseTryExceptStatement();
+    ASTNode* parseAssignmentOrExpression();
 };
 
 #endif // PARSER_H
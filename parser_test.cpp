@@ -0,0 +1,167 @@
+// Checks of the parser paths that must come out as a fresh parse does:
+// IncrementalParser after each edit of a script; and of the operators Python
+// would not take in a given place. Run by ctest; prints the first difference
+// found and fails.
+#include "flat_ast.h"
+#include "incremental_lexer.h"
+#include "incremental_parser.h"
+#include "lexer.h"
+#include "parser.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Every node with its lines, then the diagnostics
+static string describe(const ProgramNode* program, const vector<Diagnostic>& diagnostics) {
+    const FlatAst flat(program);
+    string text;
+    for (int i = 0; i < flat.size(); ++i) {
+        text += flat.label(i).toStdString() + "@" + to_string(flat[i].line) + "/" + to_string(flat[i].end) + " ";
+    }
+    for (const Diagnostic& diagnostic : diagnostics) {
+        text += "\n" + to_string(diagnostic.span.line) + ":" + to_string(diagnostic.span.column) + " " +
+                diagnostic.message;
+    }
+    return text;
+}
+
+// Feeds each version of a script to one IncrementalLexer and IncrementalParser,
+// the edit being whatever lies between the common prefix and suffix
+class EditChecker {
+public:
+    bool check(const QString& source) {
+        int prefix = 0;
+        const int common = min(m_source.size(), source.size());
+        while (prefix < common && m_source[prefix] == source[prefix]) ++prefix;
+        int suffix = 0;
+        while (suffix < common - prefix && m_source[m_source.size() - 1 - suffix] == source[source.size() - 1 - suffix]) {
+            ++suffix;
+        }
+        m_lexer.noteEdit(prefix, int(m_source.size()) - prefix - suffix, int(source.size()) - prefix - suffix);
+        m_source = source;
+
+        const Result<const TokenBuffer*> tokens = m_lexer.update(source);
+        if (!tokens) return true; // Nothing to parse, and the next update() lexes everything
+        const ProgramNode* program = m_parser.update(*tokens.value(), m_lexer.source());
+        Parser parser(*tokens.value(), m_lexer.source());
+        parser.setErrorRecovery(true);
+        const unique_ptr<ProgramNode> fresh = parser.parse();
+        m_reused += m_parser.lastReusedUnits();
+        return describe(program, m_parser.diagnostics()) == describe(fresh.get(), parser.diagnostics());
+    }
+
+    long long reused() const { return m_reused; }
+
+private:
+    QString m_source;
+    IncrementalLexer m_lexer;
+    IncrementalParser m_parser;
+    long long m_reused = 0;
+};
+
+// Edits that break the blocks a unit takes along (elif, else, except) and
+// restore them, between unchanged units above and below; then random edits
+static bool testIncremental() {
+    const QString head = "def f(a):\n    x = a + 1\n    return x\n\n";
+    const QString blocks = "if a > 1:\n    print(a)\nelif a:\n    print(3)\nelse:\n    print(2)\n"
+                           "try:\n    z = 1\nexcept:\n    z = -2\n";
+    const QString tail = "for i in range(3):\n    print(f(i))\ny = 3\n";
+    const vector<pair<QString, QString>> edits = {
+        {"elif a:", "elf a:"},            // Now an expression statement, and elif's block is stray
+        {"elif a:", "elif a"},            // No colon
+        {"else:\n", "else:\n\n"},          // Blank line before the block
+        {"else:\n    print(2)\n", ""},    // Gone
+        {"else:", "    else:"},           // Inside the elif block
+        {"elif a:\n", "y = 0\nelif a:\n"}, // A statement between if and elif
+        {"except:", "  except:"},          // Bad dedent
+        {"except:", "excep:"},
+        {"try:\n", ""},                    // An except with no try
+        {"    z = 1\n", ""},               // An empty try block
+        {"print(2)\n", "print(2\n"},       // Unclosed, up to the try
+    };
+    EditChecker checker;
+    const QString original = head + blocks + tail;
+    if (!checker.check(original)) return false;
+    for (const auto& [from, to] : edits) {
+        QString broken = original;
+        broken.replace(broken.indexOf(from), from.size(), to);
+        for (const QString& source : {broken, original, broken, broken + "z = 1\n", original}) {
+            if (checker.check(source)) continue;
+            fprintf(stderr, "differs from a fresh parse:\n%s\n", source.toStdString().c_str());
+            return false;
+        }
+    }
+    const long long reusedByEdits = checker.reused();
+
+    const char* pieces[] = {"def f(a):\n    x = a + 1\n    return x\n", "y = 3\n", "\n", "x", " = ", "print(", ")", "    ",
+                            "if a > 1:\n    print(a)\nelif a:\n    print(3)\nelse:\n    print(2)\n",
+                            "try:\n    z = 1\nexcept:\n    z = -2\n", "for i in range(3):\n    print(i)\n",
+                            "while x < 2:\n    x = x + 1\n", "g(1, 2)\n", "def", ":", "\n    ", "a + b * (c", "# c\n",
+                            "\"s\"", "elif", "else:\n", "except:\n", "-", "1.5", "k"};
+    mt19937 random(7);
+    auto pick = [&](int count) { return int(random() % unsigned(count)); };
+    auto piece = [&]() { return QString(pieces[pick(int(size(pieces)))]); };
+    for (int script = 0; script < 500; ++script) {
+        QString source;
+        for (int i = pick(30); i > 0; --i) source += piece();
+        EditChecker edited;
+        for (int edit = 0; edit < 30; ++edit) {
+            const int position = pick(source.size() + 1);
+            const int removed = pick(4) == 0 ? 0 : pick(min(8, int(source.size()) - position + 1));
+            QString added;
+            for (int i = pick(3); i > 0; --i) added += piece();
+            source = source.left(position) + added + source.mid(position + removed);
+            if (edited.check(source)) continue;
+            fprintf(stderr, "script %d edit %d differs from a fresh parse:\n%s\n", script, edit,
+                    source.toStdString().c_str());
+            return false;
+        }
+    }
+    if (reusedByEdits == 0) {
+        fprintf(stderr, "no unit was reused\n");
+        return false;
+    }
+    return true;
+}
+
+// 'not' only as the operand of something looser than itself: and, or, another
+// not, a bracket or an argument. A unary minus goes anywhere but before a not.
+static bool testNotOperand() {
+    const char* rejected[] = {"b = a + not a\n", "b = a == not a\n", "b = -not a\n", "b = 2 ** not a\n",
+                              "print(a * not a)\n", "b = not a < not a\n"};
+    const char* accepted[] = {"b = a and not a\n", "b = a or not not a\n", "b = not a == a\n", "b = (not a) + 1\n",
+                              "f(1, not a)\n", "b = a + -a\n", "b = - -a ** -a\n", "b = not -a\n"};
+    for (const char* source : rejected) {
+        Lexer lexer{QString(source)};
+        const TokenBuffer tokens = lexer.tokenize(1);
+        Parser parser(tokens, lexer.source());
+        const Result<unique_ptr<ProgramNode>> program = parser.tryParse();
+        const int column = int(string(source).rfind("not")) + 1;
+        if (!program && program.error().code == DiagnosticCode::UNEXPECTED_TOKEN &&
+            program.error().span.column == column) {
+            continue;
+        }
+        fprintf(stderr, "not a syntax error at column %d: %s", column, source);
+        return false;
+    }
+    for (const char* source : accepted) {
+        Lexer lexer{QString(source)};
+        const TokenBuffer tokens = lexer.tokenize(1);
+        Parser parser(tokens, lexer.source());
+        if (parser.tryParse()) continue;
+        fprintf(stderr, "a syntax error: %s", source);
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool passed = true;
+    passed = testIncremental() && passed;
+    passed = testNotOperand() && passed;
+    printf("%s\n", passed ? "passed" : "FAILED");
+    return passed ? 0 : 1;
+}
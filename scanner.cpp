@@ -0,0 +1,489 @@
+#include "scanner.h"
+
+// SSE2 is part of the x86-64 baseline. AVX2 is compiled per function through the
+// target attribute (GCC / Clang / MinGW), so no global -mavx2 flag is needed and
+// the binary still runs on CPUs without it.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCANNER_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(SCANNER_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define SCANNER_HAVE_AVX2
+#define SCANNER_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// ============================================================================
+// Scalar fallback (also finishes the tail of every vector loop)
+// ============================================================================
+
+// Scalar loops are shared by both encodings: Char is char16_t or unsigned char
+template <typename Char>
+static inline bool isBlank(Char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+template <typename Char>
+static inline bool isAsciiIdentifier(Char c) {
+    return unsigned((c | 0x20) - 'a') < 26u || unsigned(c - '0') < 10u || c == '_';
+}
+
+template <typename Char>
+static int newlineScalar(const Char* s, int pos, int end) {
+    while (pos < end && s[pos] != '\n') pos++;
+    return pos;
+}
+
+template <typename Char>
+static int blanksScalar(const Char* s, int pos, int end) {
+    while (pos < end && isBlank(s[pos])) pos++;
+    return pos;
+}
+
+template <typename Char>
+static int indentScalar(const Char* s, int pos, int end, int* width) {
+    int w = 0;
+    while (pos < end && (s[pos] == ' ' || s[pos] == '\t')) {
+        w += (s[pos] == '\t') ? 4 : 1;
+        pos++;
+    }
+    *width = w;
+    return pos;
+}
+
+template <typename Char>
+static int identifierScalar(const Char* s, int pos, int end) {
+    while (pos < end && isAsciiIdentifier(s[pos])) pos++;
+    return pos;
+}
+
+static inline const unsigned char* bytes(const char* s) { return reinterpret_cast<const unsigned char*>(s); }
+
+static int newlineScalar8(const char* s, int pos, int end) { return newlineScalar(bytes(s), pos, end); }
+static int blanksScalar8(const char* s, int pos, int end) { return blanksScalar(bytes(s), pos, end); }
+static int indentScalar8(const char* s, int pos, int end, int* width) { return indentScalar(bytes(s), pos, end, width); }
+static int identifierScalar8(const char* s, int pos, int end) { return identifierScalar(bytes(s), pos, end); }
+
+static const ScanKernels SCALAR_KERNELS = {
+    "scalar", newlineScalar<char16_t>, blanksScalar<char16_t>, indentScalar<char16_t>, identifierScalar<char16_t>,
+    newlineScalar8, blanksScalar8, indentScalar8, identifierScalar8
+};
+
+// ============================================================================
+// Bit helpers (movemask yields two bits per UTF-16 unit, one per UTF-8 byte)
+// ============================================================================
+
+#ifdef SCANNER_HAVE_SSE2
+
+static inline int firstSetBit(unsigned long long mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+static inline int countBits(unsigned long long mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int n = 0;
+    for (; mask; mask &= mask - 1) n++;
+    return n;
+#else
+    return __builtin_popcountll(mask);
+#endif
+}
+
+// Most blank and identifier runs are only a few units long. Checking those with
+// plain compares first keeps the vector setup off the common path.
+#define SCANNER_SHORT_RUN(inRun) \
+    for (int limit = pos + 8; pos < limit; ++pos) { \
+        if (pos >= end || !(inRun)) return pos; \
+    }
+
+// Bits of the first 'units' code units of a movemask
+static inline unsigned long long lowUnits(unsigned long long mask, int units) {
+    return mask & ((1ull << (2 * units)) - 1);
+}
+
+// ============================================================================
+// SSE2: 2 x 8 units per step
+// ============================================================================
+
+static inline __m128i load128(const char16_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline __m128i blankLanes128(__m128i v) {
+    return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16(' ')),
+                                     _mm_cmpeq_epi16(v, _mm_set1_epi16('\t'))),
+                        _mm_cmpeq_epi16(v, _mm_set1_epi16('\r')));
+}
+
+// Unsigned "c - lo <= span" via saturating subtraction, since SSE2 only compares signed
+static inline __m128i inRange128(__m128i v, char16_t lo, short span) {
+    __m128i offset = _mm_sub_epi16(v, _mm_set1_epi16(short(lo)));
+    return _mm_cmpeq_epi16(_mm_subs_epu16(offset, _mm_set1_epi16(span)), _mm_setzero_si128());
+}
+
+static inline __m128i identifierLanes128(__m128i v) {
+    __m128i alpha = inRange128(_mm_or_si128(v, _mm_set1_epi16(0x20)), 'a', 25);
+    __m128i digit = inRange128(v, '0', 9);
+    __m128i under = _mm_cmpeq_epi16(v, _mm_set1_epi16('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+static inline unsigned long long mask128(__m128i a, __m128i b) {
+    return unsigned(_mm_movemask_epi8(a)) | (unsigned long long)unsigned(_mm_movemask_epi8(b)) << 16;
+}
+
+static int newlineSse2(const char16_t* s, int pos, int end) {
+    const __m128i nl = _mm_set1_epi16('\n');
+    for (; pos + 16 <= end; pos += 16) {
+        unsigned long long hit = mask128(_mm_cmpeq_epi16(load128(s + pos), nl),
+                                         _mm_cmpeq_epi16(load128(s + pos + 8), nl));
+        if (hit) return pos + firstSetBit(hit) / 2;
+    }
+    return newlineScalar(s, pos, end);
+}
+
+static int blanksSse2(const char16_t* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isBlank(s[pos]));
+    for (; pos + 16 <= end; pos += 16) {
+        unsigned long long stop = ~mask128(blankLanes128(load128(s + pos)),
+                                           blankLanes128(load128(s + pos + 8))) & 0xFFFFFFFFull;
+        if (stop) return pos + firstSetBit(stop) / 2;
+    }
+    return blanksScalar(s, pos, end);
+}
+
+static int indentSse2(const char16_t* s, int pos, int end, int* width) {
+    const __m128i space = _mm_set1_epi16(' ');
+    const __m128i tab = _mm_set1_epi16('\t');
+    const int start = pos;
+    int tabs = 0;
+
+    for (; pos + 16 <= end; pos += 16) {
+        __m128i a = load128(s + pos), b = load128(s + pos + 8);
+        __m128i tabA = _mm_cmpeq_epi16(a, tab), tabB = _mm_cmpeq_epi16(b, tab);
+        unsigned long long tabBits = mask128(tabA, tabB);
+        unsigned long long stop = ~mask128(_mm_or_si128(_mm_cmpeq_epi16(a, space), tabA),
+                                           _mm_or_si128(_mm_cmpeq_epi16(b, space), tabB)) & 0xFFFFFFFFull;
+        if (stop) {
+            int run = firstSetBit(stop) / 2;
+            tabs += countBits(lowUnits(tabBits, run)) / 2;
+            *width = (pos + run - start) + 3 * tabs;
+            return pos + run;
+        }
+        tabs += countBits(tabBits) / 2;
+    }
+
+    int tailWidth = 0;
+    int tailStart = pos;
+    pos = indentScalar(s, pos, end, &tailWidth);
+    *width = (tailStart - start) + 3 * tabs + tailWidth;
+    return pos;
+}
+
+static int identifierSse2(const char16_t* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isAsciiIdentifier(s[pos]));
+    for (; pos + 16 <= end; pos += 16) {
+        unsigned long long stop = ~mask128(identifierLanes128(load128(s + pos)),
+                                           identifierLanes128(load128(s + pos + 8))) & 0xFFFFFFFFull;
+        if (stop) return pos + firstSetBit(stop) / 2;
+    }
+    return identifierScalar(s, pos, end);
+}
+
+// UTF-8 input: the same scans with one bit per byte, 2 x 16 bytes per step
+
+static inline __m128i load128(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline __m128i blankBytes128(__m128i v) {
+    return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+}
+
+static inline __m128i inRangeBytes128(__m128i v, char lo, char span) {
+    __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_subs_epu8(offset, _mm_set1_epi8(span)), _mm_setzero_si128());
+}
+
+static inline __m128i identifierBytes128(__m128i v) {
+    __m128i alpha = inRangeBytes128(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 25);
+    __m128i digit = inRangeBytes128(v, '0', 9);
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+static int newlineBytesSse2(const char* s, int pos, int end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; pos + 32 <= end; pos += 32) {
+        unsigned long long hit = mask128(_mm_cmpeq_epi8(load128(s + pos), nl),
+                                         _mm_cmpeq_epi8(load128(s + pos + 16), nl));
+        if (hit) return pos + firstSetBit(hit);
+    }
+    return newlineScalar8(s, pos, end);
+}
+
+static int blanksBytesSse2(const char* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isBlank(bytes(s)[pos]));
+    for (; pos + 32 <= end; pos += 32) {
+        unsigned long long stop = ~mask128(blankBytes128(load128(s + pos)),
+                                           blankBytes128(load128(s + pos + 16))) & 0xFFFFFFFFull;
+        if (stop) return pos + firstSetBit(stop);
+    }
+    return blanksScalar8(s, pos, end);
+}
+
+static int indentBytesSse2(const char* s, int pos, int end, int* width) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const int start = pos;
+    int tabs = 0;
+
+    for (; pos + 32 <= end; pos += 32) {
+        __m128i a = load128(s + pos), b = load128(s + pos + 16);
+        __m128i tabA = _mm_cmpeq_epi8(a, tab), tabB = _mm_cmpeq_epi8(b, tab);
+        unsigned long long tabBits = mask128(tabA, tabB);
+        unsigned long long stop = ~mask128(_mm_or_si128(_mm_cmpeq_epi8(a, space), tabA),
+                                           _mm_or_si128(_mm_cmpeq_epi8(b, space), tabB)) & 0xFFFFFFFFull;
+        if (stop) {
+            int run = firstSetBit(stop);
+            tabs += countBits(tabBits & ((1ull << run) - 1));
+            *width = (pos + run - start) + 3 * tabs;
+            return pos + run;
+        }
+        tabs += countBits(tabBits);
+    }
+
+    int tailWidth = 0;
+    int tailStart = pos;
+    pos = indentScalar8(s, pos, end, &tailWidth);
+    *width = (tailStart - start) + 3 * tabs + tailWidth;
+    return pos;
+}
+
+static int identifierBytesSse2(const char* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isAsciiIdentifier(bytes(s)[pos]));
+    for (; pos + 32 <= end; pos += 32) {
+        unsigned long long stop = ~mask128(identifierBytes128(load128(s + pos)),
+                                           identifierBytes128(load128(s + pos + 16))) & 0xFFFFFFFFull;
+        if (stop) return pos + firstSetBit(stop);
+    }
+    return identifierScalar8(s, pos, end);
+}
+
+static const ScanKernels SSE2_KERNELS = {
+    "sse2", newlineSse2, blanksSse2, indentSse2, identifierSse2,
+    newlineBytesSse2, blanksBytesSse2, indentBytesSse2, identifierBytesSse2
+};
+
+#endif // SCANNER_HAVE_SSE2
+
+// ============================================================================
+// AVX2: 2 x 16 units per step
+// ============================================================================
+
+#ifdef SCANNER_HAVE_AVX2
+
+SCANNER_AVX2 static inline __m256i load256(const char16_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+SCANNER_AVX2 static inline __m256i blankLanes256(__m256i v) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16(' ')),
+                                           _mm256_cmpeq_epi16(v, _mm256_set1_epi16('\t'))),
+                           _mm256_cmpeq_epi16(v, _mm256_set1_epi16('\r')));
+}
+
+SCANNER_AVX2 static inline __m256i inRange256(__m256i v, char16_t lo, short span) {
+    __m256i offset = _mm256_sub_epi16(v, _mm256_set1_epi16(short(lo)));
+    return _mm256_cmpeq_epi16(_mm256_subs_epu16(offset, _mm256_set1_epi16(span)), _mm256_setzero_si256());
+}
+
+SCANNER_AVX2 static inline __m256i identifierLanes256(__m256i v) {
+    __m256i alpha = inRange256(_mm256_or_si256(v, _mm256_set1_epi16(0x20)), 'a', 25);
+    __m256i digit = inRange256(v, '0', 9);
+    __m256i under = _mm256_cmpeq_epi16(v, _mm256_set1_epi16('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+SCANNER_AVX2 static inline unsigned long long mask256(__m256i a, __m256i b) {
+    return unsigned(_mm256_movemask_epi8(a)) | (unsigned long long)unsigned(_mm256_movemask_epi8(b)) << 32;
+}
+
+SCANNER_AVX2 static int newlineAvx2(const char16_t* s, int pos, int end) {
+    const __m256i nl = _mm256_set1_epi16('\n');
+    for (; pos + 32 <= end; pos += 32) {
+        unsigned long long hit = mask256(_mm256_cmpeq_epi16(load256(s + pos), nl),
+                                         _mm256_cmpeq_epi16(load256(s + pos + 16), nl));
+        if (hit) return pos + firstSetBit(hit) / 2;
+    }
+    return newlineSse2(s, pos, end);
+}
+
+SCANNER_AVX2 static int blanksAvx2(const char16_t* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isBlank(s[pos]));
+    for (; pos + 32 <= end; pos += 32) {
+        unsigned long long stop = ~mask256(blankLanes256(load256(s + pos)),
+                                           blankLanes256(load256(s + pos + 16)));
+        if (stop) return pos + firstSetBit(stop) / 2;
+    }
+    return blanksSse2(s, pos, end);
+}
+
+SCANNER_AVX2 static int indentAvx2(const char16_t* s, int pos, int end, int* width) {
+    const __m256i space = _mm256_set1_epi16(' ');
+    const __m256i tab = _mm256_set1_epi16('\t');
+    const int start = pos;
+    int tabs = 0;
+
+    for (; pos + 32 <= end; pos += 32) {
+        __m256i a = load256(s + pos), b = load256(s + pos + 16);
+        __m256i tabA = _mm256_cmpeq_epi16(a, tab), tabB = _mm256_cmpeq_epi16(b, tab);
+        unsigned long long tabBits = mask256(tabA, tabB);
+        unsigned long long stop = ~mask256(_mm256_or_si256(_mm256_cmpeq_epi16(a, space), tabA),
+                                           _mm256_or_si256(_mm256_cmpeq_epi16(b, space), tabB));
+        if (stop) {
+            int run = firstSetBit(stop) / 2;
+            tabs += countBits(lowUnits(tabBits, run)) / 2;
+            *width = (pos + run - start) + 3 * tabs;
+            return pos + run;
+        }
+        tabs += countBits(tabBits) / 2;
+    }
+
+    int tailWidth = 0;
+    int tailStart = pos;
+    pos = indentSse2(s, pos, end, &tailWidth);
+    *width = (tailStart - start) + 3 * tabs + tailWidth;
+    return pos;
+}
+
+SCANNER_AVX2 static int identifierAvx2(const char16_t* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isAsciiIdentifier(s[pos]));
+    for (; pos + 32 <= end; pos += 32) {
+        unsigned long long stop = ~mask256(identifierLanes256(load256(s + pos)),
+                                           identifierLanes256(load256(s + pos + 16)));
+        if (stop) return pos + firstSetBit(stop) / 2;
+    }
+    return identifierSse2(s, pos, end);
+}
+
+// UTF-8 input: 2 x 32 bytes per step
+
+SCANNER_AVX2 static inline __m256i load256(const char* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+SCANNER_AVX2 static inline __m256i blankBytes256(__m256i v) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+}
+
+SCANNER_AVX2 static inline __m256i inRangeBytes256(__m256i v, char lo, char span) {
+    __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_subs_epu8(offset, _mm256_set1_epi8(span)), _mm256_setzero_si256());
+}
+
+SCANNER_AVX2 static inline __m256i identifierBytes256(__m256i v) {
+    __m256i alpha = inRangeBytes256(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 25);
+    __m256i digit = inRangeBytes256(v, '0', 9);
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+SCANNER_AVX2 static int newlineBytesAvx2(const char* s, int pos, int end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; pos + 64 <= end; pos += 64) {
+        unsigned long long hit = mask256(_mm256_cmpeq_epi8(load256(s + pos), nl),
+                                         _mm256_cmpeq_epi8(load256(s + pos + 32), nl));
+        if (hit) return pos + firstSetBit(hit);
+    }
+    return newlineBytesSse2(s, pos, end);
+}
+
+SCANNER_AVX2 static int blanksBytesAvx2(const char* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isBlank(bytes(s)[pos]));
+    for (; pos + 64 <= end; pos += 64) {
+        unsigned long long stop = ~mask256(blankBytes256(load256(s + pos)),
+                                           blankBytes256(load256(s + pos + 32)));
+        if (stop) return pos + firstSetBit(stop);
+    }
+    return blanksBytesSse2(s, pos, end);
+}
+
+SCANNER_AVX2 static int indentBytesAvx2(const char* s, int pos, int end, int* width) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const int start = pos;
+    int tabs = 0;
+
+    for (; pos + 64 <= end; pos += 64) {
+        __m256i a = load256(s + pos), b = load256(s + pos + 32);
+        __m256i tabA = _mm256_cmpeq_epi8(a, tab), tabB = _mm256_cmpeq_epi8(b, tab);
+        unsigned long long tabBits = mask256(tabA, tabB);
+        unsigned long long stop = ~mask256(_mm256_or_si256(_mm256_cmpeq_epi8(a, space), tabA),
+                                           _mm256_or_si256(_mm256_cmpeq_epi8(b, space), tabB));
+        if (stop) {
+            int run = firstSetBit(stop);
+            tabs += countBits(tabBits & ((1ull << run) - 1));
+            *width = (pos + run - start) + 3 * tabs;
+            return pos + run;
+        }
+        tabs += countBits(tabBits);
+    }
+
+    int tailWidth = 0;
+    int tailStart = pos;
+    pos = indentBytesSse2(s, pos, end, &tailWidth);
+    *width = (tailStart - start) + 3 * tabs + tailWidth;
+    return pos;
+}
+
+SCANNER_AVX2 static int identifierBytesAvx2(const char* s, int pos, int end) {
+    SCANNER_SHORT_RUN(isAsciiIdentifier(bytes(s)[pos]));
+    for (; pos + 64 <= end; pos += 64) {
+        unsigned long long stop = ~mask256(identifierBytes256(load256(s + pos)),
+                                           identifierBytes256(load256(s + pos + 32)));
+        if (stop) return pos + firstSetBit(stop);
+    }
+    return identifierBytesSse2(s, pos, end);
+}
+
+static const ScanKernels AVX2_KERNELS = {
+    "avx2", newlineAvx2, blanksAvx2, indentAvx2, identifierAvx2,
+    newlineBytesAvx2, blanksBytesAvx2, indentBytesAvx2, identifierBytesAvx2
+};
+
+#endif // SCANNER_HAVE_AVX2
+
+// ============================================================================
+// Runtime selection
+// ============================================================================
+
+static const ScanKernels& selectScanKernels() {
+#ifdef SCANNER_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return AVX2_KERNELS;
+#endif
+#ifdef SCANNER_HAVE_SSE2
+    return SSE2_KERNELS;
+#else
+    return SCALAR_KERNELS;
+#endif
+}
+
+const ScanKernels& scanKernels() {
+    static const ScanKernels& kernels = selectScanKernels();
+    return kernels;
+}
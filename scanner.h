@@ -0,0 +1,36 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+// Bulk character scanning for the lexer's hot loops.
+// Every kernel works on raw UTF-16 code units and returns the index of the first
+// unit at or after 'pos' that ends the run (or 'end' if the run reaches it).
+// SSE2 / AVX2 versions look at 16-32 units per step; the best one for the running
+// CPU is picked once, with a portable scalar fallback.
+// The '8' variants do the same on the bytes of UTF-8 input; multibyte sequences
+// are all >= 0x80, so they simply end blank and identifier runs.
+
+struct ScanKernels {
+    const char* name;
+
+    // Next '\n' (end of a comment)
+    int (*newline)(const char16_t* s, int pos, int end);
+
+    // End of a run of ' ', '\t', '\r' (whitespace between tokens)
+    int (*blanks)(const char16_t* s, int pos, int end);
+
+    // End of the ' ' / '\t' indentation prefix; '*width' gets spaces + 4 * tabs
+    int (*indent)(const char16_t* s, int pos, int end, int* width);
+
+    // End of a run of ASCII [A-Za-z0-9_]. Stops at any non-ASCII unit so the
+    // caller can classify it with QChar.
+    int (*identifier)(const char16_t* s, int pos, int end);
+
+    int (*newline8)(const char* s, int pos, int end);
+    int (*blanks8)(const char* s, int pos, int end);
+    int (*indent8)(const char* s, int pos, int end, int* width);
+    int (*identifier8)(const char* s, int pos, int end);
+};
+
+const ScanKernels& scanKernels();
+
+#endif // SCANNER_H
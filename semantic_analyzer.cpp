@@ -1,288 +1,1413 @@
 #include "semantic_analyzer.h"
 #include "types.h"
+#include <climits>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
-SemanticAnalyzer::SemanticAnalyzer() {
-    // --- Define Built-in Functions ---
-    m_symbol_table.define("print", DataType::FUNCTION);
-    m_symbol_table.define("input", DataType::FUNCTION);
+void SemanticAnalyzer::Walk::error(DiagnosticCode code, SymbolId name, DataType expected, DataType found, const char* detail) {
+    if (m_full || m_outcome != Outcome::CHECKED) return;
+    // Stamped with the current line number found in AST traversal
+    m_problems->push_back({code, m_current_line, name, expected, found, detail});
+    m_full = int(m_problems->size()) >= m_max_problems;
+}
 
-    // Built-in Casts / Helpers
-    m_symbol_table.define("int", DataType::FUNCTION);
-    m_symbol_table.define("float", DataType::FUNCTION);
-    m_symbol_table.define("str", DataType::FUNCTION);
-    m_symbol_table.define("range", DataType::FUNCTION);
+Diagnostic SemanticAnalyzer::format(const Problem& problem) {
+    auto name = [&problem] { return Interner::global().name(problem.name).toStdString(); };
+    auto type = [](DataType type) { return DataTypeToString(type).toStdString(); };
+    string message;
+    switch (problem.code) {
+    case DiagnosticCode::UNDEFINED_VARIABLE:
+        message = "Variable '" + name() + "' is not defined.";
+        break;
+    case DiagnosticCode::UNDEFINED_FUNCTION:
+        message = "Function '" + name() + "' not defined.";
+        break;
+    case DiagnosticCode::FUNCTION_REDEFINED:
+        message = "Function '" + name() + "' already defined.";
+        break;
+    case DiagnosticCode::TYPE_MISMATCH:
+        if (problem.name) {
+            message = "Type Mismatch: Variable '" + name() + "' is type " + type(problem.expected) +
+                      " but assigned " + type(problem.found);
+        } else {
+            message = "Type Mismatch: Cannot add " + type(problem.expected) + " and " + type(problem.found);
+        }
+        break;
+    case DiagnosticCode::STRING_ARITHMETIC:
+        message = "Cannot perform arithmetic on Strings (except +).";
+        break;
+    case DiagnosticCode::RANGE_NOT_INTEGER:
+        message = string("Loop range '") + problem.detail + "' must be Integer.";
+        break;
+    case DiagnosticCode::RETURN_OUTSIDE_FUNCTION:
+        message = "Return statement outside of function.";
+        break;
+    case DiagnosticCode::INCONSISTENT_RETURN:
+        message = "Inconsistent return types in function '" + name() + "'. Expected " + type(problem.expected) +
+                  ", got " + type(problem.found);
+        break;
+    default:
+        break;
+    }
+    return {{problem.line, 0, 0}, problem.code, message + " at line " + to_string(problem.line)};
+}
 
-    // Pre-set return types for built-ins
-    if(auto sym = m_symbol_table.lookup("int")) sym->functionReturnType = DataType::INTEGER;
-    if(auto sym = m_symbol_table.lookup("float")) sym->functionReturnType = DataType::FLOAT;
-    if(auto sym = m_symbol_table.lookup("str")) sym->functionReturnType = DataType::STRING;
-    if(auto sym = m_symbol_table.lookup("input")) sym->functionReturnType = DataType::STRING;
+const vector<Diagnostic>& SemanticAnalyzer::diagnostics() const {
+    for (size_t i = m_diagnostics.size(); i < m_problems.size(); ++i) m_diagnostics.push_back(format(m_problems[i]));
+    return m_diagnostics;
 }
 
-void SemanticAnalyzer::error(const string& msg) {
-    // Throw error stamped with the current line number found in AST traversal
-    throw SemanticError(msg + " at line " + to_string(m_current_line));
+void SemanticAnalyzer::analyze(ProgramNode* program, int threads) {
+    Result<void> analyzed = tryAnalyze(program, threads);
+    if (!analyzed) throw SemanticError(analyzed.error());
 }
 
-void SemanticAnalyzer::analyze(ProgramNode* program) {
-    // Process all statements in the main body
-    for (const auto& statement : program->statements) {
-        visit(statement.get());
+Result<void> SemanticAnalyzer::tryAnalyze(ProgramNode* program, int threads) {
+    m_problems.clear();
+    m_diagnostics.clear();
+    if (threads <= 0) threads = max(1, int(thread::hardware_concurrency()));
+    if (program->arena.objects() < m_parallel_min_nodes) threads = 1;
+    // Kept checks keep their ids, so they need ranges of their own
+    m_plain = threads == 1 && !m_incremental;
+    m_program = program;
+    declareFunctions();
+    if (!m_incremental) m_cache.clear(); // See setIncremental()
+    // One thread makes them only if it has to (see checkInOrder(), checkUnit())
+    m_units.clear();
+    m_global_names.clear();
+    if (!m_plain) {
+        makeUnits(0);
+        findGlobalNames();
+        assignRanges();
     }
-}
 
-void SemanticAnalyzer::visit(ASTNode* node) {
-    if (!node) return;
+    checkUnits(threads);
+    for (const unique_ptr<SymbolTable>& table : m_function_tables) {
+        if (table) m_symbol_table->adopt(*table);
+    }
+    if (m_incremental) keepResults();
 
-    // Update current line if node has one
-    if (node->getLine() > 0) m_current_line = node->getLine();
+    for (const Unit& unit : m_units) {
+        for (size_t i = 0; i < unit.problems.size() && int(m_problems.size()) < m_max_diagnostics; ++i) {
+            m_problems.push_back(unit.problems[i]);
+        }
+    }
+    if (!m_problems.empty()) return format(m_problems.front());
+    return {};
+}
+
+// Binds the top-level defs in order in a table of their own, under the
+// globals. Without any, the globals go straight over the built-ins.
+void SemanticAnalyzer::declareFunctions() {
+    m_function_tables.clear();
+    m_symbol_table.reset();
+    m_signatures = make_unique<SymbolTable>();
+    m_first_signature = m_signatures->nextId();
+    m_def_units.clear();
+    m_defs.clear();
+    const ArenaVector<ASTNode*>& statements = m_program->statements;
+    for (int u = 0; u < statements.size(); ++u) {
+        auto def = node_cast<FunctionDefNode>(statements[u]);
+        if (!def) continue;
+        m_defs.push_back(u);
+        def->name->binding = m_signatures->define(def->name->symbol, DataType::FUNCTION);
+        if (def->name->binding != NO_BINDING) m_def_units.push_back(u);
+    }
+    m_symbol_table = make_unique<SymbolTable>(m_defs.empty() ? &SymbolTable::builtins() : m_signatures.get());
+}
 
-    // --- 1. Assignment ---
-    if (auto p = dynamic_cast<AssignmentNode*>(node)) {
-        DataType exprType = getExpressionType(p->expression.get());
+// A unit of every top-level statement, for the checks to keep their state in.
+// The ones before 'from' are checked already (see checkInOrder()).
+void SemanticAnalyzer::makeUnits(int from) {
+    m_units.clear();
+    m_units.resize(size_t(m_program->statements.size()));
+    for (int u = 0; u < int(m_units.size()); ++u) m_units[u].statement = m_program->statements[u];
+    for (int i = 0, bound = 0; i < int(m_defs.size()); ++i) {
+        const int u = m_defs[i];
+        m_units[u].def = i;
+        // m_def_units has the defs whose names were bound, in order too
+        if (bound < int(m_def_units.size()) && m_def_units[bound] == u) {
+            bound++;
+        } else if (u >= from) {
+            noteRedefinition(u, m_units[u].problems);
+        }
+    }
+}
 
-        // Check if variable exists
-        Symbol* existing = m_symbol_table.lookup(p->identifier->token.value);
+// The body of a def whose name was bound already is still checked; its returns
+// have no function symbol to update
+void SemanticAnalyzer::noteRedefinition(int unit, vector<Problem>& problems) const {
+    auto def = static_cast<FunctionDefNode*>(m_program->statements[unit]);
+    if (def->name->binding == NO_BINDING) {
+        problems.push_back({DiagnosticCode::FUNCTION_REDEFINED, def->getLine(), def->name->symbol});
+    }
+}
 
-        if (existing) {
-            if (existing->type != exprType) {
-                if (existing->type == DataType::FLOAT && exprType == DataType::INTEGER) {
-                    // Allow: x (float) = 5 (int)
-                } else {
-                    error("Type Mismatch: Variable '" + p->identifier->token.value.toStdString() +
-                          "' is type " + DataTypeToString(existing->type).toStdString() +
-                          " but assigned " + DataTypeToString(exprType).toStdString());
-                }
+// The names top-level code binds: assignment targets, loop variables and
+// nested defs, looked for in the statements only (not in expressions or bodies)
+void SemanticAnalyzer::findGlobalNames() {
+    m_global_names.assign(size_t(Interner::global().size()) + 1, 0);
+    auto bindsGlobal = [this](IdentifierNode* name) {
+        if (name && name->symbol < m_global_names.size()) m_global_names[name->symbol] = 1;
+    };
+    for (const Unit& unit : m_units) {
+        if (unit.def >= 0) continue;
+        m_scan.assign(1, unit.statement);
+        while (!m_scan.empty()) {
+            ASTNode* node = m_scan.back();
+            m_scan.pop_back();
+            switch (node->kind) {
+            case NodeKind::ASSIGNMENT:
+                bindsGlobal(static_cast<AssignmentNode*>(node)->identifier);
+                continue;
+            case NodeKind::FUNCTION_DEF:
+                bindsGlobal(static_cast<FunctionDefNode*>(node)->name);
+                continue;
+            case NodeKind::FOR:
+                bindsGlobal(static_cast<ForNode*>(node)->iterator);
+                break;
+            case NodeKind::BLOCK:
+            case NodeKind::IF:
+            case NodeKind::WHILE:
+            case NodeKind::TRY_EXCEPT:
+                break;
+            default:
+                continue;
             }
-        } else {
-            // New Variable Definition
-            m_symbol_table.define(p->identifier->token.value, exprType);
+            forEachChild(node, [this](ASTNode* child) {
+                if (child && (child->kind == NodeKind::BLOCK || child->kind == NodeKind::IF)) m_scan.push_back(child);
+            });
+        }
+    }
+}
+
+void SemanticAnalyzer::setIncremental(bool incremental) {
+    m_incremental = incremental;
+    // Nothing is found in m_cache any more. m_symbol_table may still read locals
+    // there (see keepResults()): the next analysis drops it once that is gone.
+    m_cache_index.clear();
+    m_stamp_index.clear();
+    m_ranges = 0;
+    m_last_reused = 0;
+}
+
+// Gives every def the range of ids it numbers its locals from on its own. A def
+// taken over from the last analysis keeps its range, as its locals come back
+// under their old ids (see reuse()); the others get ranges nobody uses. A def
+// node stamped with a kept check is that check's text; any other def is found
+// by its shape.
+void SemanticAnalyzer::assignRanges() {
+    const int defs = int(m_defs.size());
+    if (!m_incremental) {
+        m_local_ids = (BindingId(INT_MAX) - LOCAL_IDS) / BindingId(max(defs, 1));
+        for (int i = 0; i < defs; ++i) m_units[m_defs[i]].locals = LOCAL_IDS + BindingId(i) * m_local_ids;
+        return;
+    }
+    // More defs than ranges: start over, with room to grow
+    if (defs > m_ranges) {
+        m_cache.clear();
+        m_cache_index.clear();
+        m_stamp_index.clear();
+        m_ranges = max(2 * defs, 256);
+        m_local_ids = (BindingId(INT_MAX) - LOCAL_IDS) / BindingId(m_ranges);
+    }
+    if (m_kept.size() < size_t(defs)) m_kept.resize(size_t(defs)); // Emptied by keepResults()
+    m_range_used.assign(size_t(m_ranges), 0);
+    m_cache_taken.assign(m_cache.size(), 0);
+    for (int i = 0; i < defs; ++i) {
+        Unit& unit = m_units[m_defs[i]];
+        auto def = static_cast<FunctionDefNode*>(unit.statement);
+        unit.cached = def->checked ? findStamp(def->checked) : -1;
+        if (unit.cached < 0) {
+            KeptDef& kept = m_kept[i];
+            kept.shape.clear();
+            kept.key = appendShape(def, kept.shape);
+            unit.cached = findKept(kept);
         }
+        if (unit.cached < 0) continue;
+        m_cache_taken[unit.cached] = 1;
+        const int range = m_cache[unit.cached].range;
+        m_range_used[range] = 1;
+        unit.locals = LOCAL_IDS + BindingId(range) * m_local_ids;
+    }
+    int range = 0;
+    for (int i = 0; i < defs; ++i) {
+        Unit& unit = m_units[m_defs[i]];
+        if (unit.cached >= 0) continue;
+        while (m_range_used[range]) range++; // There are at least as many ranges as defs
+        m_range_used[range] = 1;
+        unit.locals = LOCAL_IDS + BindingId(range) * m_local_ids;
+    }
+}
 
-        // Annotate AST for Translator
-        p->identifier->determined_type = exprType;
-        p->determined_type = exprType;
+// What the check reads of a def's text, its nodes depth first (the children
+// last to first): per node its kind and child count, nulls included, then its
+// line from the def's if it keeps one (the others have their children's) and
+// what types it: an operator, the loop's form, a number's point, an identifier's
+// name. Defs of the same shape are checked alike, their problems lines apart.
+// Returns the shape's FNV-1a hash.
+uint32_t SemanticAnalyzer::appendShape(FunctionDefNode* def, vector<uint32_t>& shape) {
+    static constexpr uint32_t NO_NODE = 0xFF;
+    const int first = def->getLine() - 1;
+    uint32_t hash = 2166136261u;
+    auto add = [&shape, &hash](uint32_t word) {
+        shape.push_back(word);
+        hash = (hash ^ word) * 16777619u;
+    };
+    m_scan.assign(1, def);
+    while (!m_scan.empty()) {
+        ASTNode* node = m_scan.back();
+        m_scan.pop_back();
+        if (!node) {
+            add(NO_NODE);
+            continue;
+        }
+        const size_t children = m_scan.size();
+        forEachChild(node, [this](ASTNode* child) { m_scan.push_back(child); });
+        add(uint32_t(node->kind) | uint32_t(m_scan.size() - children) << 8);
+        switch (node->kind) {
+        case NodeKind::NUMBER: {
+            auto p = static_cast<NumberNode*>(node);
+            add(uint32_t(p->line - first));
+            add(p->value.contains('.'));
+            break;
+        }
+        case NodeKind::STRING:
+            add(uint32_t(static_cast<StringNode*>(node)->line - first));
+            break;
+        case NodeKind::IDENTIFIER: {
+            auto p = static_cast<IdentifierNode*>(node);
+            add(uint32_t(p->line - first));
+            add(p->symbol);
+            break;
+        }
+        case NodeKind::UNARY_OP: {
+            auto p = static_cast<UnaryOpNode*>(node);
+            add(uint32_t(p->line - first));
+            add(uint32_t(p->op));
+            break;
+        }
+        case NodeKind::BINARY_OP: {
+            auto p = static_cast<BinaryOpNode*>(node);
+            add(uint32_t(p->line - first));
+            add(uint32_t(p->op));
+            break;
+        }
+        case NodeKind::FOR:
+            add(static_cast<ForNode*>(node)->isRange);
+            break;
+        case NodeKind::SYNTAX_ERROR:
+            add(uint32_t(static_cast<ErrorNode*>(node)->line - first));
+            break;
+        default:
+            break;
+        }
     }
+    return hash;
+}
 
-    // --- 2. Function Definition ---
-    else if (auto p = dynamic_cast<FunctionDefNode*>(node)) {
-        QString funcName = p->name->token.value;
-        if (!m_symbol_table.define(funcName, DataType::FUNCTION)) {
-            error("Function '" + funcName.toStdString() + "' already defined.");
+// Index in m_cache of what the last analysis kept for a def of the same shape
+// as 'def', not taken by another def yet, -1 if nothing
+int SemanticAnalyzer::findKept(const KeptDef& def) const {
+    if (m_cache_index.empty()) return -1;
+    const size_t mask = m_cache_index.size() - 1;
+    for (size_t slot = def.key & mask; m_cache_index[slot]; slot = (slot + 1) & mask) {
+        const int entry = m_cache_index[slot] - 1;
+        const KeptDef& kept = m_cache[entry];
+        if (kept.key == def.key && !m_cache_taken[entry] && kept.shape == def.shape) {
+            return entry;
         }
+    }
+    return -1;
+}
 
-        m_current_function = p; // Track current function context
-        m_symbol_table.enterScope(); // Scope for params and body
+// Unique in the process, so no analyzer takes a def node for one of its checks
+// that another analyzer stamped
+static uint64_t nextStamp() {
+    static atomic<uint64_t> next{0};
+    return ++next;
+}
 
-        // Define Parameters
-        for(const auto& param : p->parameters) {
-            // HEURISTIC: If param name suggests string, make it string. Otherwise Integer.
-            QString pName = param->token.value;
-            DataType pType = DataType::INTEGER; // Default
-            if (pName == "text" || pName == "str" || pName == "msg" || pName == "s") {
-                pType = DataType::STRING;
-            }
+static size_t slotOf(uint64_t stamp, size_t mask) {
+    return size_t((stamp * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+// Index in m_cache of the check with the stamp, if no def has taken it yet
+int SemanticAnalyzer::findStamp(uint64_t stamp) const {
+    if (m_stamp_index.empty()) return -1;
+    const size_t mask = m_stamp_index.size() - 1;
+    for (size_t slot = slotOf(stamp, mask); m_stamp_index[slot]; slot = (slot + 1) & mask) {
+        const int entry = m_stamp_index[slot] - 1;
+        if (m_cache[entry].stamp == stamp) return m_cache_taken[entry] ? -1 : entry;
+    }
+    return -1;
+}
 
-            param->determined_type = pType;
-            m_symbol_table.define(pName, pType);
+// After the walks: the checks this analysis took over stay where they are in
+// m_cache, and the ones it made take the places of the others. m_symbol_table
+// adopts the locals of the ones taken over there, so m_cache keeps them until
+// the next analysis replaces the table.
+void SemanticAnalyzer::keepResults() {
+    const int defs = int(m_defs.size());
+    m_last_reused = 0;
+    m_cache_taken.assign(m_cache.size(), 0); // Now: taken over
+    for (int i = 0; i < defs; ++i) {
+        const Unit& unit = m_units[m_defs[i]];
+        if (!unit.reused) continue;
+        m_cache_taken[unit.cached] = 1;
+        KeptDef& kept = m_cache[unit.cached];
+        const int line = unit.statement->getLine();
+        for (Problem& problem : kept.problems) problem.line += line - kept.line;
+        kept.line = line;
+        m_last_reused++;
+    }
+    for (size_t entry = 0; entry < m_cache.size(); ++entry) {
+        if (!m_cache_taken[entry] && m_cache[entry].stamp) m_cache[entry] = KeptDef();
+    }
+    size_t entry = 0;
+    for (int i = 0; i < defs; ++i) {
+        if (m_units[m_defs[i]].reused || !m_kept[i].stamp) continue;
+        while (entry < m_cache.size() && m_cache_taken[entry]) entry++;
+        if (entry == m_cache.size()) {
+            m_cache.emplace_back();
+            m_cache_taken.push_back(0);
         }
+        m_cache[entry] = std::move(m_kept[i]);
+        m_kept[i].stamp = 0;
+        indexEntry(int(entry++));
+    }
+
+    m_saved.clear();
+    for (int i = 0; i < defs; ++i) {
+        const Unit& unit = m_units[m_defs[i]];
+        if (unit.reused) m_saved.push_back(&m_cache[unit.cached].locals);
+    }
+    m_symbol_table->adopt(m_saved);
+}
 
-        visit(p->body.get());
+// Both indexes anew, over the entries of m_cache that hold a check, with room
+// for the ones to come
+void SemanticAnalyzer::indexCache() {
+    size_t size = 16;
+    while (size < 4 * m_cache.size()) size *= 2;
+    m_cache_index.assign(size, 0);
+    m_stamp_index.assign(size, 0);
+    m_indexed = 0;
+    for (size_t i = 0; i < m_cache.size(); ++i) {
+        if (m_cache[i].stamp) indexEntry(int(i));
+    }
+}
 
-        m_symbol_table.leaveScope();
-        m_current_function = nullptr;
+// The slots of the check the entry held before stay until the next
+// indexCache(): lookups compare the entry's own key and stamp, so they only
+// cost a probe
+void SemanticAnalyzer::indexEntry(int entry) {
+    if (2 * size_t(m_indexed + 1) > m_cache_index.size()) {
+        indexCache(); // The entry with the rest
+        return;
     }
+    const size_t mask = m_cache_index.size() - 1;
+    size_t slot = m_cache[entry].key & mask;
+    while (m_cache_index[slot]) slot = (slot + 1) & mask;
+    m_cache_index[slot] = entry + 1;
+    slot = slotOf(m_cache[entry].stamp, mask);
+    while (m_stamp_index[slot]) slot = (slot + 1) & mask;
+    m_stamp_index[slot] = entry + 1;
+    m_indexed++;
+}
 
-    // --- 3. For Loop (Range vs Generic) ---
-    else if (auto p = dynamic_cast<ForNode*>(node)) {
-        m_symbol_table.enterScope();
+// Every thread takes the next job until every unit is checked: a unit queued
+// again once what it waited for was checked, the chain, or else the next def
+// that nobody has started. One thread does without all that (see
+// checkSerially()).
+void SemanticAnalyzer::checkUnits(int threads) {
+    const int count = m_program->statements.size();
+    m_progress = make_unique<atomic<char>[]>(size_t(count));
+    m_jobs.assign(1, count);
+    m_next_job = 0;
+    m_next_def = 0;
+    m_running = 0;
+    m_remaining = 1 + int(m_defs.size());
+    m_chain = 0;
+    m_chain_waits = -1;
+    m_first_open = 0;
+    m_settled = 0;
+    if (int(m_walks.size()) < threads) m_walks.resize(threads);
+    m_function_tables.resize(threads);
+    if (threads == 1) {
+        if (m_plain) {
+            m_chain = checkInOrder();
+            if (m_chain == count) return;
+            makeUnits(m_chain);
+        }
+        checkSerially();
+        return;
+    }
 
-        if (p->isRange) {
-            if(getExpressionType(p->start.get()) != DataType::INTEGER)
-                error("Loop range 'start' must be Integer.");
-            if(getExpressionType(p->stop.get()) != DataType::INTEGER)
-                error("Loop range 'stop' must be Integer.");
+    auto work = [this, count](int worker) {
+        unique_lock<mutex> guard(m_lock);
+        for (;;) {
+            int job = nextJob();
+            while (job < 0 && m_remaining > 0) {
+                if (m_running == 0) {
+                    force();
+                    job = nextJob();
+                } else {
+                    m_changed.wait(guard);
+                    job = nextJob();
+                }
+            }
+            if (job < 0) break;
+            m_running++;
+            guard.unlock();
 
-            p->iterator->determined_type = DataType::INTEGER;
-            m_symbol_table.define(p->iterator->token.value, DataType::INTEGER);
+            int waitsFor = -1;
+            const Outcome outcome = job == count ? checkChain(worker, waitsFor)
+                                                 : checkUnit(job, job + 1, worker, functionTable(worker), true, waitsFor);
+
+            guard.lock();
+            m_running--;
+            finish(job, outcome, waitsFor);
+            if (m_next_job < m_jobs.size() || m_running == 0 || m_remaining == 0) m_changed.notify_all();
         }
-        else {
-            DataType iterType = getExpressionType(p->iterable.get());
-            if (iterType == DataType::STRING) {
-                p->iterator->determined_type = DataType::STRING;
-                m_symbol_table.define(p->iterator->token.value, DataType::STRING);
-            } else {
-                m_symbol_table.define(p->iterator->token.value, DataType::UNDEFINED);
+    };
+    vector<thread> workers;
+    for (int i = 1; i < threads; ++i) workers.emplace_back(work, i);
+    work(0);
+    for (thread& worker : workers) worker.join();
+}
+
+// Under the lock; -1 if there is nothing to do for now
+int SemanticAnalyzer::nextJob() {
+    if (m_next_job < m_jobs.size()) return m_jobs[m_next_job++];
+    while (m_next_def < int(m_defs.size()) && m_units[m_defs[m_next_def]].started) m_next_def++;
+    if (m_next_def == int(m_defs.size())) return -1;
+    const int def = m_defs[m_next_def++];
+    m_units[def].started = true;
+    return def;
+}
+
+SymbolTable& SemanticAnalyzer::functionTable(int worker) {
+    if (m_plain) return *m_symbol_table;
+    unique_ptr<SymbolTable>& table = m_function_tables[worker];
+    if (!table) table = make_unique<SymbolTable>(m_signatures.get());
+    return *table;
+}
+
+// The chain's statements from m_chain that are checked in one walk: up to
+// CHAIN_BATCH of them, up to the next def, and a forced one alone, as the
+// ones after it may still wait
+int SemanticAnalyzer::chainBatchEnd() const {
+    const int count = int(m_units.size());
+    int last = m_chain + 1;
+    while (!m_units[m_chain].forced && last < count && last - m_chain < CHAIN_BATCH &&
+           m_units[last].def < 0) {
+        last++;
+    }
+    return last;
+}
+
+// One thread checks the program as the old single-table walk did: in order in
+// m_symbol_table, each def in line where it is, the rest in the batches the
+// chain makes (see chainBatchEnd()). That is all it takes unless a body calls
+// a def after it: returns the statement whose check waits, for the units to
+// take over from (see checkSerially()), or the statement count.
+int SemanticAnalyzer::checkInOrder() {
+    const int count = m_program->statements.size();
+    const int defs = int(m_defs.size());
+    Walk& walk = m_walks[0];
+    int next = 0; // The first def from 'first' on, in m_defs
+    for (int first = 0; first < count;) {
+        const bool def = next < defs && m_defs[next] == first;
+        const int last = def ? first + 1 : min(first + CHAIN_BATCH, next < defs ? m_defs[next] : count);
+        const SymbolTable::Mark mark = m_symbol_table->mark();
+        m_batch_problems.clear();
+        if (def) noteRedefinition(first, m_batch_problems);
+        if (walk.check(*this, first, last, *m_symbol_table, NO_BINDING, m_batch_problems, false) != Outcome::CHECKED) {
+            m_symbol_table->rollback(mark);
+            if (Symbol* symbol = m_signatures->definedSymbol(def ? static_cast<FunctionDefNode*>(
+                    m_program->statements[first])->name->binding : NO_BINDING)) {
+                symbol->functionReturnType = DataType::UNDEFINED;
             }
+            return first;
+        }
+        if (def) {
+            m_progress[first].store(DONE, memory_order_relaxed);
+            next++;
+        }
+        for (size_t i = 0; i < m_batch_problems.size() && int(m_problems.size()) < m_max_diagnostics; ++i) {
+            m_problems.push_back(m_batch_problems[i]);
+        }
+        first = last;
+    }
+    return count;
+}
+
+// A thread on its own goes through the program in passes, each running the
+// chain as far as it gets and then trying every def not done yet, in order.
+// Nothing here waits for anything else to be checked: a unit whose callee is
+// not started yet checks that first (see startSerially()), and otherwise stays
+// open for the next pass. A pass that settles nothing leaves every open unit
+// waiting in a cycle, so the one forceNext() picks is checked without waiting, as
+// the scheduler would.
+// Unless kept checks need ranges of ids (see setIncremental()), a def on its own
+// is checked in m_symbol_table too, over the globals bound so far: it looks up
+// no name they bind (see Walk::resolve()), so which ones those are is all one.
+// For the same reason the chain may as well check a def in line, as the old
+// walk did, unless that waits; then it is started as usual.
+void SemanticAnalyzer::checkSerially() {
+    const int count = int(m_units.size());
+    for (;;) {
+        const int chain = m_chain;
+        const int settled = m_settled;
+        checkChainSerially();
+        bool open = m_chain < count;
+        for (int def : m_defs) {
+            const char progress = m_progress[def].load(memory_order_relaxed);
+            if (progress == PENDING || progress == ON_ITS_OWN) startSerially(def);
+            open = open || m_progress[def].load(memory_order_relaxed) != DONE;
+        }
+        if (!open) return;
+        if (m_chain == chain && m_settled == settled) {
+            const int forced = forceNext();
+            if (forced != count) startSerially(forced);
         }
+    }
+}
 
-        visit(p->body.get());
-        m_symbol_table.leaveScope();
+// The chain for a thread on its own: it starts every def it gets to (or checks
+// it in line, see checkSerially()), and a statement that waits for a def nobody
+// started has that def checked first. It stops at one that waits for a def
+// that is started but not done.
+void SemanticAnalyzer::checkChainSerially() {
+    const int count = int(m_units.size());
+    while (m_chain < count) {
+        const bool def = m_units[m_chain].def >= 0;
+        if (def && m_progress[m_chain].load(memory_order_relaxed) == PENDING && m_plain) {
+            int waitsFor = -1;
+            if (checkUnit(m_chain, m_chain + 1, 0, *m_symbol_table, false, waitsFor) == Outcome::CHECKED) {
+                settle(m_chain, Outcome::CHECKED);
+                m_chain++;
+                continue;
+            }
+        }
+        if (def && m_progress[m_chain].load(memory_order_relaxed) == PENDING) startSerially(m_chain);
+        if (def && m_progress[m_chain].load(memory_order_relaxed) != IN_LINE) {
+            m_chain++;
+            continue;
+        }
+        const int last = def ? m_chain + 1 : chainBatchEnd();
+        int waitsFor = -1;
+        if (checkUnit(m_chain, last, 0, *m_symbol_table, false, waitsFor) == Outcome::CHECKED) {
+            if (def) settle(m_chain, Outcome::CHECKED);
+            m_chain = last;
+            continue;
+        }
+        if (m_units[waitsFor].started) return;
+        startSerially(waitsFor);
     }
+}
 
-    // --- 4. If Statement ---
-    else if (auto p = dynamic_cast<IfNode*>(node)) {
-        getExpressionType(p->condition.get());
-        visit(p->body.get());
-        if (p->else_branch) {
-            visit(p->else_branch.get());
+// Checks a def on its own for a thread on its own, after each def not started
+// yet that it waits for (kept on m_stack rather than recursing). If one it
+// waits for is started but not done, it and the defs under it on the stack
+// wait for the next pass.
+void SemanticAnalyzer::startSerially(int index) {
+    m_units[index].started = true;
+    m_stack.assign(1, index);
+    while (!m_stack.empty()) {
+        const int unit = m_stack.back();
+        int waitsFor = -1;
+        const Outcome outcome = checkUnit(unit, unit + 1, 0, functionTable(0), true, waitsFor);
+        if (outcome == Outcome::WAITS && !m_units[waitsFor].started) {
+            m_units[waitsFor].started = true;
+            m_stack.push_back(waitsFor);
+            continue;
+        }
+        m_stack.pop_back();
+        settle(unit, outcome);
+        if (outcome != Outcome::CHECKED) {
+            for (int waiting : m_stack) settle(waiting, Outcome::WAITS);
+            m_stack.clear();
         }
     }
+}
 
-    // --- 5. While Loop ---
-    else if (auto p = dynamic_cast<WhileNode*>(node)) {
-        getExpressionType(p->condition.get());
-        visit(p->body.get());
+// A thread on its own records how far a def got
+void SemanticAnalyzer::settle(int index, Outcome outcome) {
+    if (outcome == Outcome::WAITS) {
+        m_progress[index].store(ON_ITS_OWN, memory_order_relaxed);
+        return;
     }
+    m_progress[index].store(outcome == Outcome::CHECKED ? DONE : IN_LINE, memory_order_relaxed);
+    m_settled++;
+}
 
-    // --- 6. Try / Except ---
-    else if (auto p = dynamic_cast<TryExceptNode*>(node)) {
-        visit(p->try_body.get());
-        if (p->except_body) {
-            visit(p->except_body.get());
+// The top-level statements in order, from where it last stopped. At a def it
+// waits until it is known whether the def goes in line; if so it is checked
+// here. Other statements are checked up to CHAIN_BATCH at a time, and checked
+// again together if one of them waits.
+SemanticAnalyzer::Outcome SemanticAnalyzer::checkChain(int worker, int& waitsFor) {
+    const int count = int(m_units.size());
+    while (m_chain < count) {
+        if (m_units[m_chain].def < 0) {
+            const int last = chainBatchEnd();
+            if (checkUnit(m_chain, last, worker, *m_symbol_table, false, waitsFor) == Outcome::WAITS) {
+                return Outcome::WAITS;
+            }
+            m_chain = last;
+            continue;
+        }
+        if (m_progress[m_chain].load(memory_order_acquire) == PENDING) startDef(m_chain, worker);
+        const char progress = m_progress[m_chain].load(memory_order_acquire);
+        if (progress == PENDING) {
+            waitsFor = m_chain;
+            return Outcome::WAITS;
+        }
+        if (progress == IN_LINE) {
+            if (checkUnit(m_chain, m_chain + 1, worker, *m_symbol_table, false, waitsFor) == Outcome::WAITS) {
+                return Outcome::WAITS;
+            }
+            unique_lock<mutex> guard(m_lock);
+            const size_t jobs = m_jobs.size();
+            complete(m_chain);
+            if (m_jobs.size() != jobs) m_changed.notify_all();
         }
+        m_chain++;
     }
+    return Outcome::CHECKED;
+}
+
+// Checks a def on its own for the chain, unless another thread has started it
+void SemanticAnalyzer::startDef(int index, int worker) {
+    {
+        unique_lock<mutex> guard(m_lock);
+        if (m_units[index].started) return;
+        m_units[index].started = true;
+    }
+    int waitsFor = -1;
+    const Outcome outcome = checkUnit(index, index + 1, worker, functionTable(worker), true, waitsFor);
+    unique_lock<mutex> guard(m_lock);
+    const size_t jobs = m_jobs.size();
+    finish(index, outcome, waitsFor);
+    if (m_jobs.size() != jobs) m_changed.notify_all();
+}
 
-    // --- 7. Return Statement ---
-    else if (auto p = dynamic_cast<ReturnNode*>(node)) {
-        if (!m_current_function) {
-            error("Return statement outside of function.");
+// Units index to last (exclusive) in one walk; their problems go to the first.
+// A check that did not get through is undone: the table and the problems are
+// as before it, and so is the def's return type.
+SemanticAnalyzer::Outcome SemanticAnalyzer::checkUnit(int index, int last, int worker, SymbolTable& table,
+                                                      bool onItsOwn, int& waitsFor) {
+    Unit& unit = m_units[index];
+    Outcome outcome;
+    if (onItsOwn && unit.cached >= 0 && !unit.forced && reuse(index, worker, outcome, waitsFor)) return outcome;
+
+    const SymbolTable::Mark mark = table.mark();
+    const size_t problems = unit.problems.size();
+    BindingId first = NO_BINDING;
+    KeptDef* kept = nullptr;
+    if (m_plain && onItsOwn) {
+        if (m_global_names.empty()) findGlobalNames();
+        first = table.nextId(); // Past every global bound so far
+    } else if (onItsOwn) {
+        first = unit.locals;
+        table.startSegment(first);
+        // A forced check saw return types of the moment (see force())
+        if (m_incremental && !unit.forced) kept = &m_kept[unit.def];
+    }
+
+    Walk& walk = m_walks[worker];
+    if (kept) kept->references.clear();
+    outcome = walk.check(*this, index, last, table, first, unit.problems, unit.forced,
+                         kept ? &kept->references : nullptr);
+    if (outcome == Outcome::CHECKED) {
+        // One cut short at the diagnostics limit is not kept
+        if (kept && int(unit.problems.size()) < m_max_diagnostics) {
+            auto def = static_cast<FunctionDefNode*>(unit.statement);
+            const Symbol* symbol = m_signatures->definedSymbol(def->name->binding);
+            if (unit.cached >= 0) { // Of the same shape
+                kept->key = m_cache[unit.cached].key;
+                kept->shape = m_cache[unit.cached].shape;
+            }
+            kept->stamp = nextStamp();
+            kept->line = def->getLine();
+            kept->range = int((first - LOCAL_IDS) / m_local_ids);
+            kept->redefined = !symbol;
+            kept->returnType = symbol ? symbol->functionReturnType : DataType::UNDEFINED;
+            kept->problems.assign(unit.problems.begin() + problems, unit.problems.end());
+            kept->locals = table.saveSegment();
+            kept->types.clear();
+            kept->bindings.clear();
+            walk.forEachNode(def, [kept](ASTNode* node) {
+                kept->types.push_back(node->determined_type);
+                if (auto name = node_cast<IdentifierNode>(node)) kept->bindings.push_back(name->binding);
+            });
+            def->checked = kept->stamp;
         }
+        return outcome;
+    }
+    table.rollback(mark);
+    unit.problems.resize(problems);
+    if (auto def = node_cast<FunctionDefNode>(unit.statement)) {
+        if (Symbol* symbol = m_signatures->definedSymbol(def->name->binding)) symbol->functionReturnType = DataType::UNDEFINED;
+    }
+    waitsFor = walk.waitsFor();
+    return outcome;
+}
 
-        DataType returnType = DataType::NONE;
-        if (p->expression) {
-            returnType = getExpressionType(p->expression.get());
+// Takes over what the last analysis kept for the def if its inputs are the same
+// (see setIncremental()), or waits for a callee where its check would. False
+// if it has to be checked.
+bool SemanticAnalyzer::reuse(int index, int worker, Outcome& outcome, int& waitsFor) {
+    Unit& unit = m_units[index];
+    KeptDef& kept = m_cache[unit.cached]; // This unit's alone
+    auto def = static_cast<FunctionDefNode*>(unit.statement);
+    Symbol* symbol = m_signatures->definedSymbol(def->name->binding);
+    if (kept.redefined != !symbol || unit.problems.size() + kept.problems.size() >= size_t(m_max_diagnostics)) {
+        return false;
+    }
+    for (const Reference& reference : kept.references) {
+        if (reference.name < m_global_names.size() && m_global_names[reference.name]) return false; // It goes in line
+    }
+    bool moved = false; // A signature the body uses has another id now
+    for (const Reference& reference : kept.references) {
+        BindingId id;
+        const Symbol* found = m_signatures->lookup(reference.name, &id);
+        if (!found || reference.kind == Reference::UNBOUND) {
+            if (found || reference.kind != Reference::UNBOUND) return false;
+            continue;
+        }
+        moved = moved || id != reference.binding;
+        if (reference.kind == Reference::BOUND) continue;
+        if ((found == symbol) != (reference.kind == Reference::SELF_CALL)) return false;
+        if (reference.kind == Reference::SELF_CALL) continue;
+        // Like Walk::awaitReturnType()
+        const BindingId signature = id - m_first_signature;
+        if (id >= m_first_signature && signature < m_def_units.size()) {
+            const int callee = m_def_units[signature];
+            if (m_progress[callee].load(memory_order_acquire) != DONE) {
+                outcome = Outcome::WAITS;
+                waitsFor = callee;
+                return true;
+            }
         }
+        if (found->functionReturnType != reference.returnType) return false;
+    }
 
-        Symbol* funcSym = m_symbol_table.lookup(m_current_function->name->token.value);
-        if (funcSym) {
-            if (funcSym->functionReturnType == DataType::UNDEFINED) {
-                funcSym->functionReturnType = returnType;
-            } else if (funcSym->functionReturnType != returnType) {
-                if (funcSym->functionReturnType == DataType::FLOAT && returnType == DataType::INTEGER) {
-                    // OK
-                } else {
-                    error("Inconsistent return types in function '" +
-                          m_current_function->name->token.value.toStdString() +
-                          "'. Expected " + DataTypeToString(funcSym->functionReturnType).toStdString() +
-                          ", got " + DataTypeToString(returnType).toStdString());
-                }
+    // Its nodes get their types and bindings back, unless they still have them.
+    // Locals keep their ids (the range stays with the def); a signature's
+    // depends on the defs before it.
+    const bool restore = def->checked != kept.stamp;
+    if (restore || moved) {
+        const DataType* type = kept.types.data();
+        const BindingId* binding = kept.bindings.data();
+        m_walks[worker].forEachNode(def, [&](ASTNode* node) {
+            if (restore) node->determined_type = *type++;
+            auto name = node_cast<IdentifierNode>(node);
+            if (!name) return;
+            BindingId id = restore ? *binding++ : name->binding;
+            if (id != NO_BINDING && (id < unit.locals || id - unit.locals >= m_local_ids)) {
+                m_signatures->lookup(name->symbol, &id);
             }
+            name->binding = id;
+        });
+        def->checked = kept.stamp;
+        for (Reference& reference : kept.references) m_signatures->lookup(reference.name, &reference.binding);
+    }
+    for (Problem problem : kept.problems) {
+        problem.line += def->getLine() - kept.line;
+        unit.problems.push_back(problem);
+    }
+    if (symbol) symbol->functionReturnType = kept.returnType;
+    unit.reused = true; // m_symbol_table adopts its locals (see keepResults())
+    outcome = Outcome::CHECKED;
+    return true;
+}
+
+// Under the lock, after a job ran
+void SemanticAnalyzer::finish(int job, Outcome outcome, int waitsFor) {
+    const int count = int(m_units.size());
+    if (job == count) {
+        if (outcome == Outcome::CHECKED) {
+            m_remaining--;
+            return;
+        }
+        // For the def it is at to be decided, or for a callee to be checked
+        const char progress = m_progress[waitsFor].load(memory_order_relaxed);
+        if (progress == DONE || (waitsFor == m_chain && progress != PENDING)) {
+            m_jobs.push_back(count);
+        } else {
+            m_chain_waits = waitsFor;
         }
+        return;
     }
 
-    // --- 8. Expression Statements ---
-    else if (auto p = dynamic_cast<PrintNode*>(node)) {
-        getExpressionType(p->expression.get());
+    Unit& unit = m_units[job];
+    switch (outcome) {
+    case Outcome::CHECKED:
+        complete(job);
+        break;
+    case Outcome::WAITS:
+        m_progress[job].store(ON_ITS_OWN, memory_order_release);
+        if (m_chain_waits == job) {
+            m_chain_waits = -1;
+            m_jobs.push_back(count);
+        }
+        if (m_progress[waitsFor].load(memory_order_relaxed) == DONE) {
+            m_jobs.push_back(job);
+        } else {
+            unit.waiting = true;
+            unit.nextWaiter = m_units[waitsFor].firstWaiter;
+            m_units[waitsFor].firstWaiter = job;
+        }
+        break;
+    case Outcome::IN_LINE:
+        // Its callers go on waiting until the chain gets to it
+        m_progress[job].store(IN_LINE, memory_order_release);
+        if (m_chain_waits == job) {
+            m_chain_waits = -1;
+            m_jobs.push_back(count);
+        }
+        break;
     }
-    else if (auto p = dynamic_cast<BlockNode*>(node)) {
-        for(const auto& stmt : p->statements) visit(stmt.get());
+}
+
+// Under the lock: the unit is checked, so whatever waits for it can go on
+void SemanticAnalyzer::complete(int index) {
+    Unit& unit = m_units[index];
+    m_progress[index].store(DONE, memory_order_release);
+    m_remaining--;
+    for (int waiter = unit.firstWaiter; waiter >= 0; waiter = m_units[waiter].nextWaiter) {
+        if (!m_units[waiter].waiting) continue; // Forced meanwhile
+        m_units[waiter].waiting = false;
+        m_jobs.push_back(waiter);
     }
-    else if (dynamic_cast<FunctionCallNode*>(node) || dynamic_cast<IdentifierNode*>(node)) {
-        getExpressionType(node);
+    unit.firstWaiter = -1;
+    if (m_chain_waits == index) {
+        m_chain_waits = -1;
+        m_jobs.push_back(int(m_units.size()));
     }
 }
 
-DataType SemanticAnalyzer::getExpressionType(ASTNode* node) {
-    if (!node) return DataType::UNDEFINED;
-    if (node->getLine() > 0) m_current_line = node->getLine();
+// Under the lock: nothing runs and nothing is queued, yet units are left
+void SemanticAnalyzer::force() {
+    const int job = forceNext();
+    if (job == int(m_units.size())) {
+        m_chain_waits = -1;
+    } else {
+        m_units[job].waiting = false;
+    }
+    m_jobs.push_back(job);
+}
 
-    if (auto p = dynamic_cast<NumberNode*>(node)) {
-        if (p->token.value.contains('.')) {
-            p->determined_type = DataType::FLOAT;
-            return DataType::FLOAT;
+// The units left wait in a cycle (through calls). The first of them in the
+// text goes on without waiting: returns it, or m_units.size() for the chain.
+// Which one that is does not depend on the threads, as the units checked by
+// then are the ones that can be without forcing any.
+int SemanticAnalyzer::forceNext() {
+    const int count = int(m_units.size());
+    const int defs = int(m_defs.size());
+    while (m_first_open < defs && m_progress[m_defs[m_first_open]].load(memory_order_relaxed) != ON_ITS_OWN) {
+        m_first_open++;
+    }
+    if (m_chain < count && (m_first_open == defs || m_chain <= m_defs[m_first_open])) {
+        m_units[m_chain].forced = true;
+        return count;
+    }
+    m_units[m_defs[m_first_open]].forced = true;
+    return m_defs[m_first_open];
+}
+
+SemanticAnalyzer::Outcome SemanticAnalyzer::Walk::check(SemanticAnalyzer& analyzer, int unit, int last,
+                                                        SymbolTable& table, BindingId first, vector<Problem>& problems,
+                                                        bool forced, vector<Reference>* references) {
+    const ArenaVector<ASTNode*>& statements = analyzer.m_program->statements;
+    m_analyzer = &analyzer;
+    m_unit = unit;
+    m_forced = forced;
+    m_first_local = first;
+    // Room for the scopes too: they are at most one more than the bindings
+    m_last_local = first == NO_BINDING || analyzer.m_plain ? NO_BINDING : first + analyzer.m_local_ids - 2;
+    m_outcome = Outcome::CHECKED;
+    m_references = references;
+    m_last_reference = nullptr;
+    m_self = nullptr;
+    m_table = &table;
+    m_problems = &problems;
+    m_max_problems = analyzer.m_max_diagnostics;
+    m_full = int(problems.size()) >= m_max_problems;
+    m_current_function = nullptr;
+    m_function_symbol = nullptr;
+    m_tasks.clear();
+
+    if (statements[unit]->kind == NodeKind::FUNCTION_DEF) {
+        auto def = static_cast<FunctionDefNode*>(statements[unit]);
+        Symbol* symbol = analyzer.m_signatures->definedSymbol(def->name->binding);
+        if (symbol) symbol->functionReturnType = DataType::UNDEFINED;
+        m_self = symbol;
+        if (m_full) return m_outcome;
+        m_current_line = def->getLine();
+        enterFunction(def, symbol);
+        run();
+        return m_outcome;
+    }
+    for (int u = unit; u < last && !stopped(); ++u) {
+        visit(statements[u]);
+        run();
+    }
+    return m_outcome;
+}
+
+void SemanticAnalyzer::Walk::run() {
+    while (!m_tasks.empty() && !stopped()) {
+        const Task task = m_tasks.back();
+        m_tasks.pop_back();
+        switch (task.action) {
+        case Task::VISIT:
+            visit(task.node);
+            break;
+        case Task::STATEMENTS:
+            visitStatements(task.node, static_cast<BlockNode*>(task.node)->statements, task.next);
+            break;
+        case Task::LEAVE_SCOPE:
+            m_table->leaveScope();
+            break;
+        case Task::LEAVE_FUNCTION:
+            m_table->leaveScope();
+            m_current_function = nullptr;
+            m_function_symbol = nullptr;
+            break;
         }
-        p->determined_type = DataType::INTEGER;
-        return DataType::INTEGER;
     }
-    if (auto p = dynamic_cast<StringNode*>(node)) {
-        p->determined_type = DataType::STRING;
-        return DataType::STRING;
+    // Cut short, it still closes its scopes: the table goes on to other units
+    for (; !m_tasks.empty(); m_tasks.pop_back()) {
+        if (m_tasks.back().action == Task::LEAVE_SCOPE || m_tasks.back().action == Task::LEAVE_FUNCTION) {
+            m_table->leaveScope();
+        }
     }
-    if (auto p = dynamic_cast<NoneNode*>(node)) {
-        p->determined_type = DataType::NONE;
-        return DataType::NONE;
+}
+// Visits statements in order until one schedules work (a compound statement's
+// body); the rest of the list is then scheduled to follow that work
+void SemanticAnalyzer::Walk::visitStatements(ASTNode* owner, const ArenaVector<ASTNode*>& statements, int first) {
+    for (int i = first; i < statements.size() && !stopped(); ++i) {
+        const size_t scheduled = m_tasks.size();
+        visit(statements[i]);
+        if (m_tasks.size() != scheduled) {
+            if (i + 1 < statements.size()) {
+                m_tasks.insert(m_tasks.begin() + scheduled, {owner, Task::STATEMENTS, i + 1});
+            }
+            return;
+        }
     }
+}
+
+void SemanticAnalyzer::Walk::visit(ASTNode* node) {
+    if (!node) return;
+
+    // Update current line if node has one
+    if (node->getLine() > 0) m_current_line = node->getLine();
+
+    visitNode(node, [this](auto* p) { check(p); });
+}
 
-    if (auto p = dynamic_cast<IdentifierNode*>(node)) {
-        Symbol* sym = m_symbol_table.lookup(p->token.value);
-        if (!sym) {
-            error("Variable '" + p->token.value.toStdString() + "' is not defined.");
+// A def on its own only sees its locals and the top-level defs, so a name bound
+// anywhere else that top-level code binds sends it in line
+const Symbol* SemanticAnalyzer::Walk::resolve(IdentifierNode* p) {
+    const Symbol* symbol = m_table->lookup(p->symbol, &p->binding);
+    if (m_first_local != NO_BINDING && (p->binding < m_first_local || p->binding == NO_BINDING)) {
+        if (p->symbol < m_analyzer->m_global_names.size() && m_analyzer->m_global_names[p->symbol]) {
+            m_outcome = Outcome::IN_LINE;
+        } else if (m_references) {
+            m_references->push_back({p->symbol, symbol ? Reference::BOUND : Reference::UNBOUND, DataType::UNDEFINED,
+                                     p->binding});
+            m_last_reference = p;
         }
-        p->determined_type = sym->type;
-        return sym->type;
     }
+    return symbol;
+}
 
-    if (auto p = dynamic_cast<BinaryOpNode*>(node)) {
-        DataType left = getExpressionType(p->left.get());
-        DataType right = getExpressionType(p->right.get());
+// So does running out of ids, however unlikely
+BindingId SemanticAnalyzer::Walk::bind(IdentifierNode* p, DataType type) {
+    p->binding = m_table->define(p->symbol, type);
+    if (p->binding != NO_BINDING && p->binding >= m_last_local) {
+        m_outcome = Outcome::IN_LINE;
+    }
+    return p->binding;
+}
 
-        if (p->op.type == TokenType::PLUS || p->op.type == TokenType::MINUS ||
-            p->op.type == TokenType::STAR || p->op.type == TokenType::SLASH) {
+// A call to a top-level def other than the one being checked needs its return
+// type, so the unit is checked again once that def is. A def on its own still
+// walks on, to find out whether it goes in line.
+void SemanticAnalyzer::Walk::awaitReturnType(BindingId function) {
+    if (m_forced || function < m_analyzer->m_first_signature || m_outcome != Outcome::CHECKED) return;
+    const BindingId signature = function - m_analyzer->m_first_signature;
+    if (signature >= m_analyzer->m_def_units.size()) return;
+    const int callee = m_analyzer->m_def_units[signature];
+    if (callee == m_unit || m_analyzer->m_progress[callee].load(memory_order_acquire) == DONE) return;
+    m_outcome = Outcome::WAITS;
+    m_waits_for = callee;
+}
 
-            // Be STRICT: Only String+String is allowed. Everything else is an error.
-            if (left == DataType::STRING || right == DataType::STRING) {
-                if (p->op.type == TokenType::PLUS) {
-                    if (left == DataType::STRING && right == DataType::STRING) {
-                        p->determined_type = DataType::STRING;
-                        return DataType::STRING;
-                    }
-                    // If we have String + Int (or vice versa), THROW ERROR.
-                    error("Type Mismatch: Cannot add " + DataTypeToString(left).toStdString() + " and " + DataTypeToString(right).toStdString());
-                }
-                // Minus, Star, Slash on strings -> ERROR
-                error("Cannot perform arithmetic on Strings (except +).");
-            }
+// Top-level code runs before the defs after it are bound, so only a body can
+// call one of them. A batch of the chain has no def in it (see chainBatchEnd()).
+bool SemanticAnalyzer::Walk::boundLater(BindingId function) const {
+    if (m_current_function || function < m_analyzer->m_first_signature) return false;
+    const BindingId signature = function - m_analyzer->m_first_signature;
+    return signature < m_analyzer->m_def_units.size() && m_analyzer->m_def_units[signature] > m_unit;
+}
+
+// The return type a call got from outside the body, once the callee is checked
+void SemanticAnalyzer::Walk::noteCall(IdentifierNode* name, const Symbol* callee) {
+    if (!m_references || m_last_reference != name) return;
+    Reference& reference = m_references->back();
+    if (callee == m_self) {
+        reference.kind = Reference::SELF_CALL;
+    } else {
+        reference.kind = Reference::CALL;
+        if (m_outcome == Outcome::CHECKED) reference.returnType = callee->functionReturnType;
+    }
+}
 
+// --- 1. Assignment ---
+void SemanticAnalyzer::Walk::check(AssignmentNode* p) {
+    DataType exprType = getExpressionType(p->expression);
 
-            if (left == DataType::FLOAT || right == DataType::FLOAT) {
-                p->determined_type = DataType::FLOAT;
-                return DataType::FLOAT;
+    // Check if variable exists
+    const Symbol* existing = resolve(p->identifier);
+
+    if (existing) {
+        if (existing->type != exprType && existing->type != POISONED && exprType != POISONED) {
+            if (existing->type == DataType::FLOAT && exprType == DataType::INTEGER) {
+                // Allow: x (float) = 5 (int)
+            } else {
+                error(DiagnosticCode::TYPE_MISMATCH, p->identifier->symbol, existing->type, exprType);
             }
+        }
+    } else {
+        // New Variable Definition (poisoned if its value is)
+        bind(p->identifier, exprType);
+    }
+
+    // Annotate AST for Translator
+    p->identifier->determined_type = annotation(exprType);
+    p->determined_type = annotation(exprType);
+}
+
+// --- 2. Function Definition ---
+void SemanticAnalyzer::Walk::check(FunctionDefNode* p) {
+    if (bind(p->name, DataType::FUNCTION) == NO_BINDING) {
+        // The body is still checked; its returns have no function symbol to update
+        error(DiagnosticCode::FUNCTION_REDEFINED, p->name->symbol);
+    }
+
+    enterFunction(p, m_table->definedSymbol(p->name->binding));
+}
 
-            p->determined_type = DataType::INTEGER;
-            return DataType::INTEGER;
+void SemanticAnalyzer::Walk::enterFunction(FunctionDefNode* p, Symbol* symbol) {
+    m_current_function = p; // Track current function context
+    m_function_symbol = symbol;
+    p->checked = 0; // Its nodes get this walk's types and bindings (see checkUnit())
+    m_table->enterScope(); // Scope for params and body
+
+    // Define Parameters
+    for(const auto& param : p->parameters) {
+        // HEURISTIC: If param name suggests string, make it string. Otherwise Integer.
+        static const SymbolId text = symbolOf("text"), str = symbolOf("str"), msg = symbolOf("msg"), s = symbolOf("s");
+        const SymbolId pName = param->symbol;
+        DataType pType = DataType::INTEGER; // Default
+        if (pName == text || pName == str || pName == msg || pName == s) {
+            pType = DataType::STRING;
         }
 
-        if (p->op.type == TokenType::GREATER || p->op.type == TokenType::LESS_EQUAL ||
-            p->op.type == TokenType::DOUBLE_EQUAL) {
-            p->determined_type = DataType::BOOLEAN;
-            return DataType::BOOLEAN;
+        param->determined_type = pType;
+        bind(param, pType);
+    }
+
+    schedule(p, Task::LEAVE_FUNCTION);
+    schedule(p->body);
+}
+
+// --- 3. For Loop (Range vs Generic) ---
+void SemanticAnalyzer::Walk::check(ForNode* p) {
+    m_table->enterScope();
+
+    if (p->isRange) {
+        const DataType start = getExpressionType(p->start);
+        if (start != DataType::INTEGER && start != POISONED)
+            error(DiagnosticCode::RANGE_NOT_INTEGER, 0, DataType::INTEGER, start, "start");
+        const DataType stop = getExpressionType(p->stop);
+        if (stop != DataType::INTEGER && stop != POISONED)
+            error(DiagnosticCode::RANGE_NOT_INTEGER, 0, DataType::INTEGER, stop, "stop");
+
+        p->iterator->determined_type = DataType::INTEGER;
+        bind(p->iterator, DataType::INTEGER);
+    }
+    else {
+        DataType iterType = getExpressionType(p->iterable);
+        if (iterType == DataType::STRING || iterType == POISONED) {
+            p->iterator->determined_type = annotation(iterType);
+            bind(p->iterator, iterType);
+        } else {
+            bind(p->iterator, DataType::UNDEFINED);
         }
+    }
+
+    schedule(p, Task::LEAVE_SCOPE);
+    schedule(p->body);
+}
+
+// --- 4. If Statement ---
+void SemanticAnalyzer::Walk::check(IfNode* p) {
+    getExpressionType(p->condition);
+    if (p->else_branch) {
+        schedule(p->else_branch);
+    }
+    schedule(p->body);
+}
 
-        if (p->op.type == TokenType::OR || p->op.type == TokenType::NOT) {
-            p->determined_type = DataType::BOOLEAN;
-            return DataType::BOOLEAN;
+// --- 5. While Loop ---
+void SemanticAnalyzer::Walk::check(WhileNode* p) {
+    getExpressionType(p->condition);
+    schedule(p->body);
+}
+
+// --- 6. Try / Except ---
+void SemanticAnalyzer::Walk::check(TryExceptNode* p) {
+    if (p->except_body) {
+        schedule(p->except_body);
+    }
+    schedule(p->try_body);
+}
+
+// --- 7. Return Statement ---
+void SemanticAnalyzer::Walk::check(ReturnNode* p) {
+    if (!m_current_function) {
+        error(DiagnosticCode::RETURN_OUTSIDE_FUNCTION);
+        getExpressionType(p->expression); // For the errors in it
+        return;
+    }
+
+    DataType returnType = DataType::NONE;
+    if (p->expression) {
+        returnType = getExpressionType(p->expression);
+    }
+
+    Symbol* funcSym = m_function_symbol;
+    if (funcSym && returnType != POISONED) {
+        if (funcSym->functionReturnType == DataType::UNDEFINED) {
+            funcSym->functionReturnType = returnType;
+        } else if (funcSym->functionReturnType != returnType) {
+            if (funcSym->functionReturnType == DataType::FLOAT && returnType == DataType::INTEGER) {
+                // OK
+            } else {
+                error(DiagnosticCode::INCONSISTENT_RETURN, m_current_function->name->symbol,
+                      funcSym->functionReturnType, returnType);
+            }
         }
     }
+}
+
+// --- 8. Expression Statements ---
+void SemanticAnalyzer::Walk::check(PrintNode* p) {
+    getExpressionType(p->expression);
+}
+
+void SemanticAnalyzer::Walk::check(BlockNode* p) {
+    visitStatements(p, p->statements, 0);
+}
+
+void SemanticAnalyzer::Walk::check(FunctionCallNode* p) {
+    getExpressionType(p);
+}
+
+void SemanticAnalyzer::Walk::check(IdentifierNode* p) {
+    getExpressionType(p);
+}
+
+// The operand'th operand of an operator node, nullptr past the last
+static ASTNode* operandOf(ASTNode* node, int operand) {
+    switch (node->kind) {
+    case NodeKind::BINARY_OP: {
+        auto p = static_cast<BinaryOpNode*>(node);
+        return operand == 0 ? p->left : operand == 1 ? p->right : nullptr;
+    }
+    case NodeKind::UNARY_OP:
+        return operand == 0 ? static_cast<UnaryOpNode*>(node)->right : nullptr;
+    case NodeKind::FUNCTION_CALL: {
+        auto p = static_cast<FunctionCallNode*>(node);
+        return operand < p->arguments.size() ? p->arguments[operand] : nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+// Post-order over the expression without recursion. Nodes are entered in the same
+// order as a recursive walk, so lines and errors come out the same.
+DataType SemanticAnalyzer::Walk::getExpressionType(ASTNode* node) {
+    if (!node) return DataType::UNDEFINED;
+    m_operators.clear();
+    m_operand_types.clear();
+
+    for (;;) {
+        if (node->getLine() > 0) m_current_line = node->getLine();
 
-    if (auto p = dynamic_cast<UnaryOpNode*>(node)) {
-        DataType t = getExpressionType(p->right.get());
-        if (p->op.type == TokenType::NOT) {
-            p->determined_type = DataType::BOOLEAN;
-            return DataType::BOOLEAN;
+        switch (node->kind) {
+        case NodeKind::BINARY_OP:
+        case NodeKind::UNARY_OP:
+            m_operators.push_back({node, nullptr, 0});
+            break;
+        case NodeKind::FUNCTION_CALL: {
+            auto p = static_cast<FunctionCallNode*>(node);
+            const Symbol* sym = resolve(p->name);
+            if (sym && boundLater(p->name->binding)) {
+                p->name->binding = NO_BINDING;
+                sym = nullptr;
+            }
+            if (!sym) {
+                // The arguments are still checked; the call is poisoned (see typeOf)
+                error(DiagnosticCode::UNDEFINED_FUNCTION, p->name->symbol);
+            } else {
+                awaitReturnType(p->name->binding);
+                noteCall(p->name, sym);
+            }
+            m_operators.push_back({node, sym, 0});
+            break;
+        }
+        default:
+            m_operand_types.push_back(visitNode(node, [this](auto* p) { return typeOf(p); }));
+            break;
         }
-        p->determined_type = t;
-        return t;
+
+        // Type every operator whose operands are done, until one still has an operand to enter
+        node = nullptr;
+        while (!m_operators.empty()) {
+            PendingOperator& top = m_operators.back();
+            if ((node = operandOf(top.node, top.operands))) {
+                top.operands++;
+                break;
+            }
+
+            const DataType* operands = m_operand_types.data() + m_operand_types.size() - top.operands;
+            DataType type = DataType::UNDEFINED;
+            switch (top.node->kind) {
+            case NodeKind::BINARY_OP:
+                type = operands[0] == POISONED || operands[1] == POISONED
+                           ? POISONED
+                           : typeOf(static_cast<BinaryOpNode*>(top.node), operands[0], operands[1]);
+                break;
+            case NodeKind::UNARY_OP:
+                type = operands[0] == POISONED ? POISONED : typeOf(static_cast<UnaryOpNode*>(top.node), operands[0]);
+                break;
+            default: // A call's type does not depend on its arguments
+                type = typeOf(static_cast<FunctionCallNode*>(top.node), top.callee);
+                break;
+            }
+            if (type == POISONED) top.node->determined_type = DataType::UNDEFINED;
+            m_operand_types.resize(m_operand_types.size() - top.operands + 1);
+            m_operand_types.back() = type;
+            m_operators.pop_back();
+        }
+        if (!node) return m_operand_types.back();
+    }
+}
+
+DataType SemanticAnalyzer::Walk::typeOf(NumberNode* p) {
+    if (p->value.contains('.')) {
+        p->determined_type = DataType::FLOAT;
+        return DataType::FLOAT;
     }
+    p->determined_type = DataType::INTEGER;
+    return DataType::INTEGER;
+}
+
+DataType SemanticAnalyzer::Walk::typeOf(StringNode* p) {
+    p->determined_type = DataType::STRING;
+    return DataType::STRING;
+}
+
+DataType SemanticAnalyzer::Walk::typeOf(NoneNode* p) {
+    p->determined_type = DataType::NONE;
+    return DataType::NONE;
+}
+
+DataType SemanticAnalyzer::Walk::typeOf(IdentifierNode* p) {
+    const Symbol* sym = resolve(p);
+    if (!sym) {
+        error(DiagnosticCode::UNDEFINED_VARIABLE, p->symbol);
+        p->determined_type = DataType::UNDEFINED;
+        return POISONED;
+    }
+    p->determined_type = annotation(sym->type);
+    return sym->type;
+}
 
-    if (auto p = dynamic_cast<FunctionCallNode*>(node)) {
-        Symbol* sym = m_symbol_table.lookup(p->name->token.value);
-        if (!sym) error("Function '" + p->name->token.value.toStdString() + "' not defined.");
+DataType SemanticAnalyzer::Walk::typeOf(BinaryOpNode* p, DataType left, DataType right) {
+    if (p->op == TokenType::PLUS || p->op == TokenType::MINUS ||
+        p->op == TokenType::STAR || p->op == TokenType::SLASH ||
+        p->op == TokenType::DOUBLE_SLASH || p->op == TokenType::PERCENT ||
+        p->op == TokenType::DOUBLE_STAR) {
 
-        for(auto& arg : p->arguments) {
-            getExpressionType(arg.get());
+        // Be STRICT: Only String+String is allowed. Everything else is an error.
+        if (left == DataType::STRING || right == DataType::STRING) {
+            if (p->op == TokenType::PLUS) {
+                if (left == DataType::STRING && right == DataType::STRING) {
+                    p->determined_type = DataType::STRING;
+                    return DataType::STRING;
+                }
+                // If we have String + Int (or vice versa), THROW ERROR.
+                error(DiagnosticCode::TYPE_MISMATCH, 0, left, right);
+                return POISONED;
+            }
+            // Any other arithmetic on strings -> ERROR
+            error(DiagnosticCode::STRING_ARITHMETIC);
+            return POISONED;
         }
 
-        if (sym->functionReturnType != DataType::UNDEFINED) {
-            p->determined_type = sym->functionReturnType;
-            return sym->functionReturnType;
+        // An int to a negative power is a float in Python, so only a literal
+        // exponent (never negative: minus is an operator) keeps ** exact
+        const bool fractional = p->op == TokenType::DOUBLE_STAR && p->right->kind != NodeKind::NUMBER;
+        if (left == DataType::FLOAT || right == DataType::FLOAT || fractional) {
+            p->determined_type = DataType::FLOAT;
+            return DataType::FLOAT;
         }
-        return DataType::NONE;
+
+        p->determined_type = DataType::INTEGER;
+        return DataType::INTEGER;
     }
 
+    if (p->op == TokenType::GREATER || p->op == TokenType::GREATER_EQUAL ||
+        p->op == TokenType::LESS || p->op == TokenType::LESS_EQUAL ||
+        p->op == TokenType::DOUBLE_EQUAL || p->op == TokenType::NOT_EQUAL) {
+        p->determined_type = DataType::BOOLEAN;
+        return DataType::BOOLEAN;
+    }
+
+    if (p->op == TokenType::OR || p->op == TokenType::AND || p->op == TokenType::NOT) {
+        p->determined_type = DataType::BOOLEAN;
+        return DataType::BOOLEAN;
+    }
     return DataType::UNDEFINED;
 }
+
+DataType SemanticAnalyzer::Walk::typeOf(UnaryOpNode* p, DataType t) {
+    if (p->op == TokenType::NOT) {
+        p->determined_type = DataType::BOOLEAN;
+        return DataType::BOOLEAN;
+    }
+    p->determined_type = t;
+    return t;
+}
+
+DataType SemanticAnalyzer::Walk::typeOf(FunctionCallNode* p, const Symbol* sym) {
+    if (!sym) return POISONED; // Not defined
+    if (m_outcome != Outcome::CHECKED) return POISONED; // The callee may still be being checked
+    // Set either way: a node kept from the last tree may have a type from then
+    p->determined_type = sym->functionReturnType;
+    if (sym->functionReturnType != DataType::UNDEFINED) return sym->functionReturnType;
+    return DataType::NONE;
+}
@@ -3,34 +3,365 @@
 
 #include "ast.h"
 #include "symbol_table.h"
+#include "diagnostic.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 using namespace std;
 
 class SemanticError : public runtime_error {
 public:
-    explicit SemanticError(const string& message) : runtime_error(message) {}
+    explicit SemanticError(const Diagnostic& diagnostic)
+        : runtime_error(diagnostic.message), m_diagnostic(diagnostic) {}
+    const Diagnostic& diagnostic() const { return m_diagnostic; }
+
+private:
+    Diagnostic m_diagnostic;
 };
 
 class SemanticAnalyzer {
 public:
-    SemanticAnalyzer();
-    void analyze(ProgramNode* program);
+    static constexpr int DEFAULT_MAX_DIAGNOSTICS = 100;
+    static constexpr int PARALLEL_MIN_NODES = 1 << 15;
+
+    // Both check the whole program and record every problem in diagnostics();
+    // analyze() throws the first as a SemanticError, tryAnalyze() returns it.
+    // Nothing is thrown inside the walk either way.
+    //
+    // An expression with an error in it is poisoned: its nodes get the UNDEFINED
+    // type and nothing else is reported about it, or about a variable assigned
+    // from it, so one mistake gives one diagnostic.
+    //
+    // Top-level defs are bound first, so a body may call a def that comes after
+    // it; top-level code may not, as it runs before that def is bound. Each body
+    // is then checked in its own scope over them, once the functions it calls
+    // are, on up to 'threads' threads (0 is one per core). Programs of fewer
+    // than parallelMinNodes() nodes get one thread, which checks everything in
+    // the one table. A body that uses a name the top-level code binds is checked
+    // in line with that code instead, seeing the globals bound before its def.
+    // Calls in a cycle see no return type for the functions not checked yet.
+    // Types and diagnostics are the same whatever the thread count, and so are
+    // the bindings, but for their ids.
+    void analyze(ProgramNode* program, int threads = 0);
+    Result<void> tryAnalyze(ProgramNode* program, int threads = 0);
+
+    // In the order of the statements they are in. The messages are only put
+    // together when asked for.
+    const vector<Diagnostic>& diagnostics() const;
+    // At most this many are kept, and a check ends once it has them
+    void setMaxDiagnostics(int count) { m_max_diagnostics = max(count, 1); }
+    int maxDiagnostics() const { return m_max_diagnostics; }
+    // PARALLEL_MIN_NODES unless set; 0 lets any program use the threads
+    void setParallelMinNodes(int nodes) { m_parallel_min_nodes = max(nodes, 0); }
+    int parallelMinNodes() const { return m_parallel_min_nodes; }
 
-    // Expose symbol table for the Translator to use later
-    const SymbolTable& getSymbolTable() const { return m_symbol_table; }
+    // Keep what checking each def on its own found, keyed by the def's text (as
+    // far as the check reads it, lines counted from the def's), for the next
+    // analysis to take over for a def with the same text whose inputs are the
+    // same too: the names the body uses but does not bind resolve as before, none
+    // of them is bound by top-level code, and the defs it calls return what they
+    // did. A def whose return type changes so has its callers checked again, and
+    // theirs if theirs changes. Its problems, return type, locals and node types
+    // come back as they were, on whichever tree it is in; a def node that still
+    // has them (FunctionDefNode::checked, e.g. one IncrementalParser handed back)
+    // is not walked at all. Top-level code and the defs checked in line with it
+    // are checked every time.
+    void setIncremental(bool incremental);
+    // Defs the last analysis took over from the one before (for profiling)
+    int lastReusedDefs() const { return m_last_reused; }
+
+    // Expose symbol table for the Translator to use later. It keeps every scope,
+    // so the bindings stamped on the tree (IdentifierNode::binding) resolve in it.
+    const SymbolTable& getSymbolTable() const { return *m_symbol_table; }
 
 private:
-    SymbolTable m_symbol_table;
-    FunctionDefNode* m_current_function = nullptr; // To track return types
-    int m_current_line = 0; // NEW: Tracks the current line being analyzed
+    // What error() was told, for diagnostics() to turn into text
+    struct Problem {
+        DiagnosticCode code;
+        int line;
+        SymbolId name = 0;          // The variable or function named in the message
+        DataType expected = DataType::UNDEFINED;
+        DataType found = DataType::UNDEFINED;
+        const char* detail = nullptr; // Which loop range bound
+    };
+
+    // How far a unit's check got. One that has to wait, or found that it belongs
+    // in line, is undone (see checkUnit()) and checked again later.
+    enum class Outcome {
+        CHECKED,
+        WAITS,   // For the return type of a def not checked yet
+        IN_LINE  // A def's body uses a global name
+    };
+
+    // A name a def's body uses without binding it, and what it was to the check
+    // (see setIncremental())
+    struct Reference {
+        enum Kind : char { UNBOUND, BOUND, CALL, SELF_CALL };
+        SymbolId name;
+        Kind kind;
+        DataType returnType; // Of a CALL's callee
+        BindingId binding;   // Its signature's id, as stamped on the def's nodes
+    };
+
+    // Checks one top-level statement, or a top-level def's body, against one
+    // SymbolTable. Every thread has its own.
+    class Walk {
+    public:
+        // A def on its own is checked in a scope of 'table' numbered from
+        // 'first' (see checkUnit()); anything else in the global scope, with
+        // 'first' NO_BINDING, along with the units after it up to 'last'.
+        // Problems go to 'problems'; a forced check does not wait for calls.
+        // A def on its own records the names it uses from outside in 'references'
+        Outcome check(SemanticAnalyzer& analyzer, int unit, int last, SymbolTable& table, BindingId first,
+                      vector<Problem>& problems, bool forced, vector<Reference>* references = nullptr);
+        int waitsFor() const { return m_waits_for; }
+
+        // Calls fn(node) for the nodes of a def but the def and its name, depth
+        // first (the children last to first)
+        template <typename Fn>
+        void forEachNode(FunctionDefNode* def, Fn&& fn) {
+            m_nodes.assign(1, def);
+            while (!m_nodes.empty()) {
+                ASTNode* node = m_nodes.back();
+                m_nodes.pop_back();
+                if (node != def) fn(node);
+                forEachChild(node, [this, def](ASTNode* child) {
+                    if (child && child != def->name) m_nodes.push_back(child);
+                });
+            }
+        }
+
+    private:
+        const SemanticAnalyzer* m_analyzer = nullptr;
+        int m_unit = 0;
+        bool m_forced = false;              // Calls do not wait
+        BindingId m_first_local = NO_BINDING; // On its own: its range of ids
+        BindingId m_last_local = NO_BINDING;
+        Outcome m_outcome = Outcome::CHECKED;
+        int m_waits_for = -1;
+        vector<Reference>* m_references = nullptr; // On its own, when the analyzer keeps them
+        IdentifierNode* m_last_reference = nullptr; // The name of the last one, for noteCall()
+        const Symbol* m_self = nullptr;             // The def's symbol, on its own
+
+        SymbolTable* m_table = nullptr;
+        FunctionDefNode* m_current_function = nullptr; // To track return types
+        Symbol* m_function_symbol = nullptr;           // Its symbol, nullptr if it was defined twice
+        int m_current_line = 0; // NEW: Tracks the current line being analyzed
+        vector<Problem>* m_problems = nullptr;
+        int m_max_problems = 0;
+        bool m_full = false; // The walk stops once set (see error())
+
+        // The type of a poisoned expression or variable while the walk is on. Never
+        // stored on the tree (see annotation()) and never the subject of a check.
+        static constexpr DataType POISONED = DataType(-1);
+        static DataType annotation(DataType type) { return type == POISONED ? DataType::UNDEFINED : type; }
+
+        // Work still to do, last first. Compound statements schedule their bodies rather
+        // than recursing, so nesting depth costs heap, not stack.
+        struct Task {
+            enum Action {
+                VISIT,
+                STATEMENTS,     // A Block's statements from 'next' on
+                LEAVE_SCOPE,
+                LEAVE_FUNCTION
+            };
+            ASTNode* node;
+            Action action;
+            int next;
+        };
+        vector<Task> m_tasks;
+
+        // getExpressionType()'s post-order: operators whose operands are being typed,
+        // and the types of the finished operands
+        struct PendingOperator {
+            ASTNode* node;
+            const Symbol* callee; // FunctionCall, nullptr if not defined
+            int operands;   // Entered so far
+        };
+        vector<PendingOperator> m_operators;
+        vector<DataType> m_operand_types;
+        vector<ASTNode*> m_nodes; // forEachNode()'s
+
+        // A def on its own that waits walks on (see awaitReturnType())
+        bool stopped() const {
+            return m_full || m_outcome == Outcome::IN_LINE ||
+                   (m_outcome == Outcome::WAITS && m_first_local == NO_BINDING);
+        }
+        void run();
+        void visit(ASTNode* node);
+        void schedule(ASTNode* node, Task::Action action = Task::VISIT) { m_tasks.push_back({node, action, 0}); }
+        void visitStatements(ASTNode* owner, const ArenaVector<ASTNode*>& statements, int first);
+        void enterFunction(FunctionDefNode* p, Symbol* symbol);
+        DataType getExpressionType(ASTNode* node);
+
+        // Name resolution, stamping the binding on the identifier
+        const Symbol* resolve(IdentifierNode* p);
+        BindingId bind(IdentifierNode* p, DataType type);
+        bool boundLater(BindingId function) const;
+        void awaitReturnType(BindingId function);
+        void noteCall(IdentifierNode* name, const Symbol* callee);
+
+        // Statement checks, picked by visit() through visitNode(); other kinds are ignored
+        void check(AssignmentNode* p);
+        void check(FunctionDefNode* p);
+        void check(ForNode* p);
+        void check(IfNode* p);
+        void check(WhileNode* p);
+        void check(TryExceptNode* p);
+        void check(ReturnNode* p);
+        void check(PrintNode* p);
+        void check(BlockNode* p);
+        void check(FunctionCallNode* p);
+        void check(IdentifierNode* p);
+        void check(ASTNode*) {}
+
+        // Leaf types, picked by getExpressionType() the same way
+        DataType typeOf(NumberNode* p);
+        DataType typeOf(StringNode* p);
+        DataType typeOf(NoneNode* p);
+        DataType typeOf(IdentifierNode* p);
+        DataType typeOf(ASTNode*) { return DataType::UNDEFINED; }
+
+        // Operator types, once their operands are typed
+        DataType typeOf(BinaryOpNode* p, DataType left, DataType right);
+        DataType typeOf(UnaryOpNode* p, DataType right);
+        DataType typeOf(FunctionCallNode* p, const Symbol* sym);
+
+        // Records a problem at the current line; diagnostics() formats it
+        Q_DECL_COLD_FUNCTION void error(DiagnosticCode code, SymbolId name = 0, DataType expected = DataType::UNDEFINED,
+                                        DataType found = DataType::UNDEFINED, const char* detail = nullptr);
+    };
+
+    // A top-level statement. The chain (see checkChain()) checks the statements
+    // in order in m_symbol_table, with the defs that go in line; every other def
+    // is checked on its own in a table of the thread's (m_function_tables).
+    struct Unit {
+        ASTNode* statement = nullptr;
+        vector<Problem> problems;
+        bool started = false;
+        bool forced = false;   // Checked without waiting (see force())
+        bool waiting = false;  // In the list of the unit it waits for
+        bool reused = false;   // Taken over from m_cache
+        int nextWaiter = -1;
+        int firstWaiter = -1;
+        int def = -1;          // Index in m_defs; -1 for other statements
+        int cached = -1;       // Index in m_cache
+        BindingId locals = NO_BINDING; // First id on its own (see assignRanges())
+    };
+    // What checking a def on its own found (see setIncremental())
+    struct KeptDef {
+        uint64_t stamp = 0;             // Unique (see FunctionDefNode::checked); 0 until kept
+        uint32_t key = 0;               // Hash of the shape
+        vector<uint32_t> shape;         // See appendShape()
+        int line = 0;                   // The def's then; its problems move with it
+        int range = 0;
+        bool redefined = false;
+        DataType returnType = DataType::UNDEFINED;
+        vector<Problem> problems;       // Without the redefinition
+        vector<Reference> references;   // What its check read, in the order met
+        vector<DataType> types;         // Of its nodes, in Walk::forEachNode() order
+        vector<BindingId> bindings;     // Of the identifiers among them
+        SymbolTable::SavedSegment locals;
+    };
+    // Of a def: PENDING until its first check, then IN_LINE (for the chain to
+    // check) or ON_ITS_OWN until it is DONE
+    enum Progress : char { PENDING, IN_LINE, ON_ITS_OWN, DONE };
+    // A def checked on its own numbers its bindings and scopes from
+    // LOCAL_IDS + range * m_local_ids; m_symbol_table's stay below LOCAL_IDS
+    static constexpr BindingId LOCAL_IDS = BindingId(1) << 30;
+    // Most top-level statements the chain checks in one walk
+    static constexpr int CHAIN_BATCH = 32;
+    BindingId m_local_ids = 0;
+
+    unique_ptr<SymbolTable> m_signatures = make_unique<SymbolTable>();   // The top-level defs
+    unique_ptr<SymbolTable> m_symbol_table = make_unique<SymbolTable>(); // Globals; adopts the function tables
+    vector<unique_ptr<SymbolTable>> m_function_tables;
+    vector<Walk> m_walks;
+
+    ProgramNode* m_program = nullptr;
+    vector<Unit> m_units;
+    unique_ptr<atomic<char>[]> m_progress; // By unit; read by the walks without the lock
+    BindingId m_first_signature = 0;
+    vector<int> m_defs;          // The units that are defs, in order
+    vector<int> m_def_units;     // By signature id, from m_first_signature
+    vector<char> m_global_names; // By SymbolId
+    vector<ASTNode*> m_scan;
+
+    // Scheduling, under m_lock. Jobs are units, or m_units.size() for the chain.
+    // Units are only started and forced under it too.
+    mutex m_lock;
+    condition_variable m_changed;
+    vector<int> m_jobs;
+    size_t m_next_job = 0;
+    int m_next_def = 0;       // Index into m_defs: the defs from here on may not be started yet
+    int m_running = 0;
+    int m_remaining = 0;      // The chain and the defs, until done
+    int m_chain = 0;          // First unit the chain has not checked
+    int m_chain_waits = -1;
+    int m_first_open = 0;     // Index into m_defs, for force()
+
+    // Checking on one thread (see checkSerially())
+    bool m_plain = false;     // In m_symbol_table alone, ids in one sequence
+    vector<Problem> m_batch_problems; // checkInOrder()'s, of one walk
+    int m_settled = 0;        // Defs done or sent in line so far
+    vector<int> m_stack;      // Defs whose checks wait for the one above
+
+    // Kept between analyses (see setIncremental()): the checks of the last one,
+    // each where it was taken over or made (see keepResults()), open-addressing
+    // indexes over their keys and their stamps (entry + 1 per slot, 0 = empty),
+    // and the ranges handed out, which stay with their defs
+    bool m_incremental = false;
+    vector<KeptDef> m_cache;
+    vector<int> m_cache_index;
+    vector<int> m_stamp_index;
+    int m_indexed = 0;          // Slots used in each index, stale ones too
+    vector<char> m_cache_taken; // By entry, in this analysis
+    vector<KeptDef> m_kept;     // By index in m_defs, for the next analysis; the shapes not found by stamp
+    int m_ranges = 0;
+    vector<char> m_range_used;
+    vector<const SymbolTable::SavedSegment*> m_saved;
+    int m_last_reused = 0;
 
-    void visit(ASTNode* node);
-    DataType getExpressionType(ASTNode* node);
+    vector<Problem> m_problems;
+    mutable vector<Diagnostic> m_diagnostics; // m_problems formatted, as far as asked for
+    int m_max_diagnostics = DEFAULT_MAX_DIAGNOSTICS;
+    int m_parallel_min_nodes = PARALLEL_MIN_NODES;
 
-    // Helper to throw errors with line numbers
-    void error(const string& msg);
+    void declareFunctions();
+    void makeUnits(int from);
+    void noteRedefinition(int unit, vector<Problem>& problems) const;
+    void findGlobalNames();
+    void assignRanges();
+    uint32_t appendShape(FunctionDefNode* def, vector<uint32_t>& shape);
+    int findKept(const KeptDef& def) const;
+    int findStamp(uint64_t stamp) const;
+    void keepResults();
+    void indexCache();
+    void indexEntry(int entry);
+    void checkUnits(int threads);
+    int nextJob();
+    SymbolTable& functionTable(int worker);
+    int chainBatchEnd() const;
+    int checkInOrder();
+    void checkSerially();
+    void checkChainSerially();
+    void startSerially(int index);
+    void settle(int index, Outcome outcome);
+    Outcome checkChain(int worker, int& waitsFor);
+    void startDef(int unit, int worker);
+    Outcome checkUnit(int unit, int last, int worker, SymbolTable& table, bool onItsOwn, int& waitsFor);
+    bool reuse(int unit, int worker, Outcome& outcome, int& waitsFor);
+    void finish(int job, Outcome outcome, int waitsFor);
+    void complete(int unit);
+    void force();
+    int forceNext();
+    static Diagnostic format(const Problem& problem);
 };
 
 #endif // SEMANTIC_ANALYZER_H
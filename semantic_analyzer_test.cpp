@@ -0,0 +1,241 @@
+// Checks of SemanticAnalyzer that no single script shows: the results do not
+// depend on the thread count, and an incremental analysis re-checks only what
+// an edit changed. Run by ctest; prints the first difference found and fails.
+#include "flat_ast.h"
+#include "incremental_parser.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantic_analyzer.h"
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Random programs of the shapes the scheduling has to get right: calls before
+// the def, cycles of calls, defs that use globals (checked in line), defs bound
+// twice, defs in top-level blocks, and type errors
+class ProgramGenerator {
+public:
+    explicit ProgramGenerator(unsigned seed) : m_random(seed) {}
+
+    string program() {
+        m_defs = 3 + pick(20);
+        string text = "base = 3\nlabel = 'x'\n";
+        for (int i = 0; i < m_defs; ++i) {
+            text += def(i);
+            if (pick(5) == 0) text += topLevel();
+        }
+        return text + "later = 2\n";
+    }
+
+    string def(int index) {
+        string text = "def f" + to_string(index) + "(" + (pick(3) == 0 ? "s" : "") + "):\n    t = 1\n";
+        for (int i = pick(5); i > 0; --i) text += bodyLine();
+        return text + returnLine();
+    }
+
+private:
+    mt19937 m_random;
+    int m_defs = 0;
+
+    int pick(int count) { return int(m_random() % unsigned(count)); }
+    string call() { return "f" + to_string(pick(m_defs + 2)) + "()"; } // Some are not defined
+
+    string bodyLine() {
+        switch (pick(11)) {
+        case 0: return "    t = " + call() + "\n";
+        case 1: return "    t = t + base\n";
+        case 2: return "    t = t + later\n";
+        case 3: return "    t = t + 'oops'\n";
+        case 4: return "    for k in range(t):\n        t = t + k\n";
+        case 5: return "    u = t * 2\n    t = u\n";
+        case 6: return "    s = str(t)\n";
+        case 7: return "    t = " + call() + " + 1\n";
+        case 8: return "    if t > 1:\n        t = " + call() + "\n";
+        case 9: return "    return t\n";
+        default: return "    t = t + 1\n";
+        }
+    }
+
+    string returnLine() {
+        switch (pick(6)) {
+        case 0: return "    return t\n";
+        case 1: return "    return 1.5\n";
+        case 2: return "    return label\n";
+        case 3: return "    return 'x'\n";
+        case 4: return "    return " + call() + "\n";
+        default: return "    return\n";
+        }
+    }
+
+    string topLevel() {
+        switch (pick(7)) {
+        case 0: return "g = " + call() + "\n";
+        case 1: return "print(" + call() + ")\n";
+        case 2: return "base = 'b'\n";
+        case 3: return "t = 5\n";
+        case 4: return "if base > 1:\n    def f" + to_string(pick(m_defs)) + "():\n        return base\n";
+        case 5: return "def f" + to_string(pick(m_defs)) + "():\n    return " + call() + "\n";
+        default: return "y = " + call() + " * 2\n";
+        }
+    }
+};
+
+// What the analysis left on the tree and in its table, and its diagnostics.
+// Renumbered, bindings and scopes go by first use instead of by id, as one
+// thread numbers them all in one table, and an incremental analysis keeps the
+// ids of the defs it takes over.
+static string describe(ProgramNode* program, const SemanticAnalyzer& analyzer, bool renumbered = false) {
+    const SymbolTable& table = analyzer.getSymbolTable();
+    const FlatAst flat(program);
+    map<long long, int> numbers;
+    auto number = [&](long long id) {
+        if (!renumbered) return to_string(id);
+        return to_string(numbers.emplace(id, int(numbers.size())).first->second);
+    };
+    string text;
+    for (int i = 0; i < flat.size(); ++i) {
+        text += to_string(int(flat[i].determined_type));
+        if (flat[i].kind == NodeKind::IDENTIFIER) {
+            text += "#" + (flat[i].binding == NO_BINDING ? string("-") : number(flat[i].binding));
+            if (const Symbol* symbol = table.symbol(flat[i].binding)) {
+                text += "=" + to_string(int(symbol->type)) + "/" + to_string(int(symbol->functionReturnType)) + "@" +
+                        number(-1 - table.scopeOf(flat[i].binding));
+            }
+        }
+        text += ' ';
+    }
+    for (const Diagnostic& diagnostic : analyzer.diagnostics()) text += "\n" + diagnostic.message;
+    return text;
+}
+
+static unique_ptr<ProgramNode> parse(const string& source) {
+    Lexer lexer(QString::fromStdString(source));
+    const TokenBuffer tokens = lexer.tokenize(1);
+    Parser parser(tokens, lexer.source());
+    parser.setErrorRecovery(true);
+    return parser.parse();
+}
+
+// On as many threads as asked for, however small the program
+static string analyze(const string& source, int threads, bool renumbered = false) {
+    const unique_ptr<ProgramNode> program = parse(source);
+    SemanticAnalyzer analyzer;
+    analyzer.setParallelMinNodes(0);
+    analyzer.tryAnalyze(program.get(), threads);
+    return describe(program.get(), analyzer, renumbered);
+}
+
+// Every program comes out the same on one thread (one table, no scheduler) and
+// on several
+static bool testThreadCounts() {
+    ProgramGenerator generator(1);
+    for (int i = 0; i < 400; ++i) {
+        const string source = generator.program();
+        const string serial = analyze(source, 1, true);
+        for (int threads : {2, 3, 8}) {
+            if (analyze(source, threads, true) == serial) continue;
+            fprintf(stderr, "program %d differs on %d threads:\n%s\n", i, threads, source.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// A body may call a def after it; top-level code, in a block or not, only the
+// defs before it. The diagnostics, on one thread and on several.
+static bool testForwardCalls() {
+    const struct {
+        const char* source;
+        const char* diagnostics;
+    } programs[] = {
+        {"print(g(1))\ndef g(n):\n    return n * 2\n", "\nFunction 'g' not defined. at line 1"},
+        {"def f():\n    return g(1)\ndef g(n):\n    return n * 2\nprint(f())\n", ""},
+        {"x = g()\ndef g():\n    return 1\ny = g() + 1\n", "\nFunction 'g' not defined. at line 1"},
+        {"if 1 > 0:\n    print(g())\ndef g():\n    return 1\n", "\nFunction 'g' not defined. at line 2"},
+        {"if 1 > 0:\n    def f():\n        return g()\n    print(f())\ndef g():\n    return 1\n", ""},
+    };
+    for (const auto& program : programs) {
+        for (int threads : {1, 4}) {
+            const string text = analyze(program.source, threads);
+            if (text.substr(min(text.find('\n'), text.size())) == program.diagnostics) continue;
+            fprintf(stderr, "on %d threads:\n%s\ngave:%s\n", threads, program.source, text.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// One def edited at a time: the analysis takes over every other def but the
+// callers whose callee's return type changed, and comes out as a fresh one
+// does, whether each version is parsed anew or IncrementalParser hands the
+// unchanged defs back
+static bool testIncremental() {
+    const string f0 = "def f0():\n    return 1\n";
+    const string f1 = "def f1():\n    return f0()\n";
+    const string f2 = "def f2():\n    t = f1()\n    return 1.5\n";
+    const string f3 = "def f3():\n    t = 1 + 'x'\n    return f2()\n";
+    const string f4 = "def f4(s):\n    return s\n";
+    const string f0String = "def f0():\n    return 'x'\n";
+    const string f2String = "def f2():\n    t = f1()\n    return t\n";
+    const string f4Renamed = "def f4(s):\n    u = s\n    return u\n";
+    const string globals = "x = 1\n\n";
+    const struct {
+        string source;
+        int reused;
+    } versions[] = {
+        {f0 + f1 + f2 + f3 + f4, 0},
+        {f0 + f1 + f2 + f3 + f4, 5},
+        {f0 + f1 + f2 + f3 + f4Renamed, 4},                         // Same return type
+        {f0String + f1 + f2 + f3 + f4Renamed, 2},                   // f1's changes, f2's does not
+        {globals + f0String + f1 + f2 + f3 + f4Renamed, 5},         // Lines moved
+        {globals + f0String + f1 + f2String + f3 + f4Renamed, 3},   // f2's changes
+        {globals + f0String + f1 + f2String + f2String + f3 + f4Renamed, 5}, // Defined twice
+        {globals + f0String + f1 + f2String + f3 + f4Renamed, 5},
+        {"def g():\n    return\n" + globals + f0String + f1 + f2String + f3 + f4Renamed, 5}, // Signatures moved
+    };
+    for (const bool reparsed : {true, false}) {
+        SemanticAnalyzer analyzer;
+        analyzer.setIncremental(true);
+        IncrementalParser parser;
+        for (size_t i = 0; i < size(versions); ++i) {
+            unique_ptr<ProgramNode> parsed;
+            ProgramNode* program;
+            if (reparsed) {
+                parsed = parse(versions[i].source);
+                program = parsed.get();
+            } else {
+                Lexer lexer(QString::fromStdString(versions[i].source));
+                const TokenBuffer tokens = lexer.tokenize(1);
+                program = parser.update(tokens, lexer.source());
+            }
+            analyzer.tryAnalyze(program, 1);
+            if (analyzer.lastReusedDefs() != versions[i].reused) {
+                fprintf(stderr, "version %zu reused %d defs, not %d (%s)\n", i, analyzer.lastReusedDefs(),
+                        versions[i].reused, reparsed ? "parsed anew" : "IncrementalParser");
+                return false;
+            }
+            if (describe(program, analyzer, true) != analyze(versions[i].source, 1, true)) {
+                fprintf(stderr, "version %zu differs from a fresh analysis (%s):\n%s\n", i,
+                        reparsed ? "parsed anew" : "IncrementalParser", versions[i].source.c_str());
+                return false;
+            }
+            // Another analysis of the tree leaves its own types and bindings on
+            // the nodes, which the next version must not take for its own
+            if (!reparsed && i % 2 == 1) SemanticAnalyzer().tryAnalyze(program, 1);
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool passed = true;
+    passed = testThreadCounts() && passed;
+    passed = testForwardCalls() && passed;
+    passed = testIncremental() && passed;
+    printf("%s\n", passed ? "passed" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#include "source_file.h"
+#include <climits>
+#include <stdexcept>
+
+using namespace std;
+
+SourceFile::SourceFile(const QString& path) : m_file(path) {
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        throw runtime_error("Cannot open " + path.toStdString() + ": " + m_file.errorString().toStdString());
+    }
+
+    const qint64 size = m_file.size();
+    if (size > INT_MAX) {
+        throw runtime_error(path.toStdString() + " is too large to translate");
+    }
+
+    uchar* mapped = size > 0 ? m_file.map(0, size) : nullptr;
+    if (mapped) {
+        m_data = reinterpret_cast<const char*>(mapped);
+        m_size = int(size);
+    } else {
+        m_fallback = m_file.readAll();
+        m_data = m_fallback.constData();
+        m_size = int(m_fallback.size());
+    }
+
+    // Skip a UTF-8 byte order mark; token offsets are relative to the text after it
+    if (m_size >= 3 && m_data[0] == '\xEF' && m_data[1] == '\xBB' && m_data[2] == '\xBF') {
+        m_data += 3;
+        m_size -= 3;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef SOURCE_FILE_H
+#define SOURCE_FILE_H
+
+#include "token.h"
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+// A script file mapped read-only into memory, so it can be lexed straight from
+// its UTF-8 bytes: no read() copy and no decode to QString before lexing.
+// Files that cannot be mapped (empty files, pipes) are read into a buffer instead.
+class SourceFile {
+public:
+    // Throws runtime_error if the file cannot be opened
+    explicit SourceFile(const QString& path);
+
+    const char* data() const { return m_data; }
+    int size() const { return m_size; }
+    SourceView view() const { return SourceView(m_data, m_size); }
+
+private:
+    QFile m_file;          // Owns the mapping; it goes away with the file
+    QByteArray m_fallback;
+    const char* m_data = "";
+    int m_size = 0;
+};
+
+#endif // SOURCE_FILE_H
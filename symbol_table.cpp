@@ -1,48 +1,234 @@
 #include "symbol_table.h"
+#include <algorithm>
 
 using namespace std;
 
-SymbolTable::SymbolTable() {
+SymbolTable::SymbolTable() : SymbolTable(&builtins()) {}
+
+SymbolTable::SymbolTable(const SymbolTable* outer) : m_outer(outer) {
+    if (outer) m_first = BindingId(outer->m_first + outer->m_bindings.size());
+    m_slots.resize(64);
+    m_shift = 32 - 6;
     // Start with the global scope
     enterScope();
+    if (outer) return;
+
+    // --- Define Built-in Functions ---
+    define(symbolOf("print"), DataType::FUNCTION);
+    define(symbolOf("input"), DataType::FUNCTION);
+
+    // Built-in Casts / Helpers
+    define(symbolOf("int"), DataType::FUNCTION);
+    define(symbolOf("float"), DataType::FUNCTION);
+    define(symbolOf("str"), DataType::FUNCTION);
+    define(symbolOf("range"), DataType::FUNCTION);
+
+    // Pre-set return types for built-ins
+    definedSymbol(resolve(symbolOf("int")))->functionReturnType = DataType::INTEGER;
+    definedSymbol(resolve(symbolOf("float")))->functionReturnType = DataType::FLOAT;
+    definedSymbol(resolve(symbolOf("str")))->functionReturnType = DataType::STRING;
+    definedSymbol(resolve(symbolOf("input")))->functionReturnType = DataType::STRING;
+}
+
+const SymbolTable& SymbolTable::builtins() {
+    // Built by the first caller, on whichever thread
+    static const SymbolTable table(nullptr);
+    return table;
+}
+
+// The slot holding the name, or the empty one it would take
+int SymbolTable::slotOf(SymbolId name) const {
+    const int mask = int(m_slots.size()) - 1;
+    int slot = int((name * 2654435769u) >> m_shift); // Fibonacci hashing: IDs are dense
+    while (m_slots[slot].name != name && m_slots[slot].name != 0) slot = (slot + 1) & mask;
+    return slot;
+}
+
+void SymbolTable::grow() {
+    vector<Slot> old(m_slots.size() * 2);
+    old.swap(m_slots);
+    m_shift--;
+    for (const Slot& slot : old) {
+        if (slot.name != 0) m_slots[slotOf(slot.name)] = slot;
+    }
 }
 
 void SymbolTable::enterScope() {
-    m_scopes.push_back({});
+    const int parent = m_open_scopes.empty() ? -1 : m_scopes[m_open_scopes.back()].id;
+    int id = int(m_scopes.size());
+    if (m_segment >= 0) {
+        Segment& segment = m_own_segments[m_segment];
+        id = int(segment.first) + segment.scopes++;
+    }
+    m_open_scopes.push_back(int(m_scopes.size()));
+    m_scopes.push_back({id, parent, int(m_open.size())});
 }
 
 void SymbolTable::leaveScope() {
-    if (!m_scopes.empty()) {
-        m_scopes.pop_back();
+    if (m_open_scopes.empty()) {
+        return;
+    }
+    const int start = m_scopes[m_open_scopes.back()].undo;
+    m_open_scopes.pop_back();
+    while (int(m_open.size()) > start) {
+        const Binding* binding = m_open.back();
+        m_slots[slotOf(binding->symbol.name)].binding = binding->shadows;
+        m_open.pop_back();
     }
 }
 
-bool SymbolTable::define(const QString& name, DataType type) {
-    if (m_scopes.empty()) {
-        return false; // Should never happen
+BindingId SymbolTable::define(SymbolId name, DataType type) {
+    if (m_open_scopes.empty()) {
+        return NO_BINDING; // Should never happen
     }
+    const int scope = m_scopes[m_open_scopes.back()].id;
 
     // Check if symbol already exists in the current scope
-    if (m_scopes.back().count(name)) {
-        return false; // Re-declaration error
+    int slot = slotOf(name);
+    Binding* current = m_slots[slot].binding;
+    if (current && current->scope == scope) {
+        return NO_BINDING; // Re-declaration error
+    }
+    if (scope == 0 && m_outer && m_outer->resolve(name) != NO_BINDING) {
+        return NO_BINDING; // A built-in
     }
 
-    m_scopes.back()[name] = {name, type};
-    return true;
+    if (m_slots[slot].name == 0) {
+        if (2 * (m_used + 1) > int(m_slots.size())) {
+            grow();
+            slot = slotOf(name);
+        }
+        m_slots[slot].name = name;
+        m_used++;
+    }
+    BindingId id = BindingId(m_first + m_bindings.size());
+    if (m_segment >= 0) {
+        Segment& segment = m_own_segments[m_segment];
+        id = segment.first + BindingId(segment.bindings++);
+    }
+    m_bindings.push_back({{name, type}, id, scope, current});
+    m_slots[slot].binding = &m_bindings.back();
+    m_open.push_back(&m_bindings.back());
+    return id;
 }
 
-Symbol* SymbolTable::lookup(const QString& name) {
-    if (m_scopes.empty()) {
-        return nullptr;
+const Symbol* SymbolTable::lookup(SymbolId name, BindingId* id) const {
+    // The slot already has the innermost binding; only the built-ins are further out
+    if (const Binding* binding = m_slots[slotOf(name)].binding) {
+        if (id) *id = binding->id;
+        return &binding->symbol;
     }
+    if (m_outer) return m_outer->lookup(name, id);
+    if (id) *id = NO_BINDING;
+    return nullptr;
+}
 
-    // Search from the innermost scope to the outermost
-    for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it) {
-        auto& scope = *it;
-        if (scope.count(name)) {
-            return &scope.at(name);
-        }
+const Symbol* SymbolTable::symbol(BindingId id) const {
+    const Binding* binding = bindingOf(id);
+    return binding ? &binding->symbol : nullptr;
+}
+
+// A function's own symbol, or one defined in it (its open segment)
+Symbol* SymbolTable::definedSymbol(BindingId id) {
+    if (id < m_first) return nullptr;
+    const size_t plain = m_plain_bindings < 0 ? m_bindings.size() : size_t(m_plain_bindings);
+    if (id - m_first < plain) return &m_bindings[id - m_first].symbol;
+    if (m_segment < 0) return nullptr;
+    const Segment& segment = m_own_segments[m_segment];
+    if (id < segment.first || id - segment.first >= BindingId(segment.bindings)) return nullptr;
+    return &m_bindings[segment.binding + (id - segment.first)].symbol;
+}
+
+// Built-ins and outer bindings are in the global scope, i.e. this table's too
+int SymbolTable::scopeOf(BindingId id) const {
+    const Binding* binding = bindingOf(id);
+    return binding ? binding->scope : -1;
+}
+
+int SymbolTable::parentScope(int scope) const {
+    const Scope* found = scopeById(scope);
+    return found ? found->parent : -1;
+}
+
+// The first segment starts numbering ids apart from the plain ones
+void SymbolTable::startSegment(BindingId first) {
+    if (m_plain_bindings < 0) {
+        m_plain_bindings = int(m_bindings.size());
+        m_plain_scopes = int(m_scopes.size());
+    }
+    m_segment = int(m_own_segments.size());
+    m_own_segments.push_back({first, this, nullptr, int(m_bindings.size()), int(m_scopes.size()), 0, 0});
+}
+
+void SymbolTable::adopt(const SymbolTable& table) {
+    m_segments.insert(m_segments.end(), table.m_own_segments.begin(), table.m_own_segments.end());
+    sortSegments();
+}
+
+// Bindings of closed scopes shadow nothing that matters any more
+SymbolTable::SavedSegment SymbolTable::saveSegment() const {
+    SavedSegment saved;
+    if (m_segment < 0) return saved;
+    const Segment& segment = m_own_segments[m_segment];
+    saved.first = segment.first;
+    saved.bindings.reserve(size_t(segment.bindings));
+    for (int i = 0; i < segment.bindings; ++i) {
+        saved.bindings.push_back(m_bindings[size_t(segment.binding + i)]);
+        saved.bindings.back().shadows = nullptr;
+    }
+    saved.scopes.assign(m_scopes.begin() + segment.scope, m_scopes.begin() + segment.scope + segment.scopes);
+    return saved;
+}
+
+void SymbolTable::adopt(const vector<const SavedSegment*>& saved) {
+    for (const SavedSegment* segment : saved) {
+        m_segments.push_back({segment->first, nullptr, segment, 0, 0, int(segment->bindings.size()),
+                              int(segment->scopes.size())});
+    }
+    sortSegments();
+}
+
+void SymbolTable::sortSegments() {
+    sort(m_segments.begin(), m_segments.end(), [](const Segment& a, const Segment& b) { return a.first < b.first; });
+}
+
+// Whatever is on m_open beyond the mark was bound since in a scope that is
+// still open, i.e. one that was open at the mark
+void SymbolTable::rollback(const Mark& mark) {
+    while (m_open.size() > mark.open) {
+        const Binding* binding = m_open.back();
+        m_slots[slotOf(binding->symbol.name)].binding = binding->shadows;
+        m_open.pop_back();
     }
+    m_bindings.resize(mark.bindings);
+    m_scopes.resize(mark.scopes);
+    m_own_segments.resize(mark.segments);
+    if (m_segment >= int(mark.segments)) m_segment = -1;
+}
+
+// The segment whose range could hold the id
+const SymbolTable::Segment* SymbolTable::segmentOf(BindingId id) const {
+    auto after = upper_bound(m_segments.begin(), m_segments.end(), id,
+                             [](BindingId id, const Segment& segment) { return id < segment.first; });
+    return after == m_segments.begin() ? nullptr : &*(after - 1);
+}
+
+const SymbolTable::Binding* SymbolTable::bindingOf(BindingId id) const {
+    if (id < m_first) return m_outer ? m_outer->bindingOf(id) : nullptr;
+    const size_t plain = m_plain_bindings < 0 ? m_bindings.size() : size_t(m_plain_bindings);
+    if (id - m_first < plain) return &m_bindings[id - m_first];
+    const Segment* segment = segmentOf(id);
+    if (!segment || id - segment->first >= BindingId(segment->bindings)) return nullptr; // NO_BINDING, or unknown
+    const size_t index = size_t(segment->binding) + (id - segment->first);
+    return segment->table ? &segment->table->m_bindings[index] : &segment->saved->bindings[index];
+}
 
-    return nullptr; // Symbol not found
+const SymbolTable::Scope* SymbolTable::scopeById(int scope) const {
+    if (scope < 0) return nullptr;
+    const int plain = m_plain_scopes < 0 ? int(m_scopes.size()) : m_plain_scopes;
+    if (scope < plain) return &m_scopes[scope];
+    const Segment* segment = segmentOf(BindingId(scope));
+    if (!segment || scope - int(segment->first) >= segment->scopes) return nullptr;
+    const size_t index = size_t(segment->scope + (scope - int(segment->first)));
+    return segment->table ? &segment->table->m_scopes[index] : &segment->saved->scopes[index];
 }
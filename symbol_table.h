@@ -1,32 +1,167 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
-#include <QString>
-#include <map>
+#include <cstdint>
+#include <deque>
 #include <vector>
+#include "interner.h"
 #include "types.h"
 
 using namespace std;
 
 struct Symbol {
-    QString name;
+    SymbolId name;
     DataType type;
     // Store function return type separately
     DataType functionReturnType = DataType::UNDEFINED;
 };
 
+// Names one binding of a SymbolTable for good: the analyzer stamps it on every
+// identifier it resolves (IdentifierNode::binding), so later passes look the
+// symbol up by index instead of by name in scopes that are long closed
+using BindingId = uint32_t;
+constexpr BindingId NO_BINDING = UINT32_MAX;
+
+// Nested scopes in one open-addressing table keyed by SymbolId. A name's slot
+// points at its innermost binding and every binding remembers the one it
+// shadows, so define() and lookup() probe once however deep the scopes are.
+// Leaving a scope points the slots of the bindings it made back at what they
+// shadowed, so name lookups only see the open scopes.
+//
+// The bindings themselves are kept, numbered in definition order, along with
+// the tree of every scope entered: symbol(id) still answers for a function's
+// locals after the analysis left the function, in O(1).
+//
+// Under the global scope sits the read-only built-in scope (builtins()), built
+// once and shared by every table. The built-ins count as global names: they
+// cannot be redefined there, only shadowed in inner scopes. Any table can be the
+// outer scope of others the same way; its names count as global to them.
+//
+// Tables that are filled side by side over one outer table (see
+// SemanticAnalyzer) cannot number their bindings in one sequence. A table can
+// give each function body its own segment of ids instead, and one table
+// adopt()s the others' segments so it answers for all their bindings (in
+// O(log segments)).
 class SymbolTable {
 public:
+    // Just the global scope, over builtins()
     SymbolTable();
+    // A global scope that goes on from 'outer', which must outlive this table and
+    // is only read. Ids continue after the outer table's current ones. Without an
+    // outer table this is the built-in scope (see builtins()).
+    explicit SymbolTable(const SymbolTable* outer);
+    SymbolTable(const SymbolTable&) = delete; // Slots point into m_bindings
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    static const SymbolTable& builtins();
 
     void enterScope();
     void leaveScope();
 
-    bool define(const QString& name, DataType type);
-    Symbol* lookup(const QString& name);
+    // NO_BINDING if the name is already bound in the current scope
+    BindingId define(SymbolId name, DataType type);
+    // Innermost binding of the name in the open scopes, built-ins included, and its id
+    const Symbol* lookup(SymbolId name, BindingId* id = nullptr) const;
+    BindingId resolve(SymbolId name) const {
+        BindingId id;
+        lookup(name, &id);
+        return id;
+    }
+
+    // What define() numbers the next binding, before any startSegment()
+    BindingId nextId() const { return BindingId(m_first + m_bindings.size()); }
+
+    // Any binding ever made, nullptr for NO_BINDING
+    const Symbol* symbol(BindingId id) const;
+    // The same for bindings made in this table, the ones that may change (nullptr for built-ins)
+    Symbol* definedSymbol(BindingId id);
+
+    // The scope tree: 0 is the global scope (the built-ins' and every outer
+    // table's too), every other scope has a parent. scopeOf() is -1 for NO_BINDING.
+    int scopeOf(BindingId id) const;
+    int parentScope(int scope) const;
+
+    // Bindings and scopes made from now on are numbered first, first + 1, ...
+    // (scopes apart from bindings), up to the next startSegment(). The caller
+    // keeps the ranges of all tables apart, below INT_MAX.
+    void startSegment(BindingId first);
+    // Answer for the bindings and scopes of the other table's segments too. It
+    // must outlive this table and not change any more.
+    void adopt(const SymbolTable& table);
+
+    // A copy of the open segment once its scopes are closed, for other tables
+    // to adopt() later, as if its bindings had been made there
+    struct SavedSegment;
+    SavedSegment saveSegment() const;
+    // The same for saved segments, which this table reads in place: they must
+    // outlive it and not change any more either
+    void adopt(const vector<const SavedSegment*>& saved);
+
+    // Undoing part of a walk: rollback() forgets every binding, scope and
+    // segment made since mark(), once the scopes entered since are left again
+    struct Mark {
+        size_t bindings;
+        size_t scopes;
+        size_t open;
+        size_t segments;
+    };
+    Mark mark() const { return {m_bindings.size(), m_scopes.size(), m_open.size(), m_own_segments.size()}; }
+    void rollback(const Mark& mark);
 
 private:
-    vector<map<QString, Symbol>> m_scopes;
+    struct Binding {
+        Symbol symbol;
+        BindingId id;
+        int scope;        // Its id
+        Binding* shadows; // Binding of the same name it hides
+    };
+    struct Scope {
+        int id;
+        int parent;       // Id, -1 for the global scope
+        int undo;         // m_open.size() when it was entered
+    };
+    struct Segment {
+        BindingId first;
+        const SymbolTable* table; // nullptr for a saved one
+        const SavedSegment* saved;
+        int binding;      // Index of its first binding in table->m_bindings
+        int scope;        // and of its first scope in table->m_scopes (0 for a saved one)
+        int bindings;
+        int scopes;
+    };
+    struct Slot {
+        SymbolId name = 0;           // 0 = empty; a name keeps its slot once it has one
+        Binding* binding = nullptr;  // Innermost binding, nullptr when none is in scope
+    };
+
+    const SymbolTable* m_outer;
+    BindingId m_first = 0; // Id of m_bindings[0]; the outer table's ids come first
+    vector<Slot> m_slots;  // Power of two, at most half full
+    int m_used = 0;
+    int m_shift = 0;       // 32 - log2(m_slots.size())
+    deque<Binding> m_bindings; // In definition order; a deque so pointers into it stay put
+    vector<Scope> m_scopes;    // In the order they were entered
+    vector<int> m_open_scopes; // Innermost last
+    vector<Binding*> m_open;   // Bindings of the open scopes, for leaveScope() to undo
+    // Bindings and scopes before the first segment are numbered from m_first and 0
+    int m_plain_bindings = -1; // -1 until startSegment()
+    int m_plain_scopes = -1;
+    vector<Segment> m_own_segments; // In the order started
+    int m_segment = -1;             // The open one
+    vector<Segment> m_segments;     // Adopted, sorted by id
+
+    int slotOf(SymbolId name) const;
+    void grow();
+    const Segment* segmentOf(BindingId id) const;
+    const Binding* bindingOf(BindingId id) const;
+    const Scope* scopeById(int scope) const;
+    void sortSegments();
+};
+
+struct SymbolTable::SavedSegment {
+    BindingId first = NO_BINDING;
+    vector<Binding> bindings;
+    vector<Scope> scopes;
 };
 
 #endif // SYMBOL_TABLE_H
@@ -1,3 +1,71 @@
 #include "token.h"
 
-Token::Token() {}
+static bool isAscii(const char* bytes, int length) {
+    for (int i = 0; i < length; ++i) {
+        if (static_cast<unsigned char>(bytes[i]) >= 0x80) return false;
+    }
+    return true;
+}
+
+int SourceView::columnOf(int offset) const {
+    int start = offset;
+    while (start > 0 && (utf8 ? utf8[start - 1] : utf16[start - 1]) != '\n') start--;
+    return offset - start + 1;
+}
+
+QString Token::value(const SourceView& source) const {
+    switch (type) {
+    case TokenType::INDENT:      return "INDENT";
+    case TokenType::DEDENT:      return "DEDENT";
+    case TokenType::END_OF_FILE: return "EOF";
+    default: break;
+    }
+
+    QString decoded;
+    QStringView raw;
+    if (source.isUtf8()) {
+        const char* bytes = source.utf8 + offset;
+        decoded = isAscii(bytes, length) ? QString::fromLatin1(bytes, length)
+                                         : QString::fromUtf8(bytes, length);
+        raw = decoded;
+    } else {
+        raw = QStringView(reinterpret_cast<const QChar*>(source.utf16) + offset, length);
+    }
+
+    if (type != TokenType::STRING || !raw.contains('\\')) {
+        return source.isUtf8() ? decoded : raw.toString();
+    }
+
+    // Only strings pay for unescaping: "\x" becomes "x"
+    QString result;
+    result.reserve(raw.size());
+    for (qsizetype i = 0; i < raw.size(); ++i) {
+        if (raw[i] == '\\') {
+            if (++i >= raw.size()) break;
+        }
+        result += raw[i];
+    }
+    return result;
+}
+
+QStringView operatorSpelling(TokenType type) {
+    switch (type) {
+    case TokenType::NOT:           return u"not";
+    case TokenType::OR:            return u"or";
+    case TokenType::AND:           return u"and";
+    case TokenType::DOUBLE_EQUAL:  return u"==";
+    case TokenType::NOT_EQUAL:     return u"!=";
+    case TokenType::LESS:          return u"<";
+    case TokenType::LESS_EQUAL:    return u"<=";
+    case TokenType::GREATER:       return u">";
+    case TokenType::GREATER_EQUAL: return u">=";
+    case TokenType::PLUS:          return u"+";
+    case TokenType::MINUS:         return u"-";
+    case TokenType::STAR:          return u"*";
+    case TokenType::SLASH:         return u"/";
+    case TokenType::DOUBLE_SLASH:  return u"//";
+    case TokenType::PERCENT:       return u"%";
+    case TokenType::DOUBLE_STAR:   return u"**";
+    default:                       return QStringView();
+    }
+}
@@ -1,23 +1,84 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include "interner.h"
 #include <QString>
+#include <QStringView>
 
 enum class TokenType {
     ILLEGAL, END_OF_FILE, IDENTIFIER, NUMBER, STRING,
     DEF, IF, RETURN, PRINT,
     WHILE, ELSE, ELIF,FOR, IN,
-    NOT, OR, NONE, TRUE, FALSE,
-    EQUAL, DOUBLE_EQUAL, PLUS, MINUS, STAR, SLASH, LESS_EQUAL, GREATER,
+    NOT, OR, AND, NONE, TRUE, FALSE,
+    EQUAL, DOUBLE_EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL,
+    PLUS, MINUS, STAR, SLASH, DOUBLE_SLASH, PERCENT, DOUBLE_STAR,
     LPAREN, RPAREN, LBRACE, RBRACE, COLON, COMMA, SEMICOLON, DOT,
     INDENT, DEDENT,
     TRY, EXCEPT
 };
 
+// The buffer token spans index into. Either UTF-16 text (the editor contents) or
+// the raw bytes of a UTF-8 file; in the latter case offsets and lengths count bytes.
+struct SourceView {
+    const char16_t* utf16 = nullptr;
+    const char* utf8 = nullptr;
+    int length = 0;
+
+    SourceView() = default;
+    SourceView(const QString& text)
+        : utf16(reinterpret_cast<const char16_t*>(text.constData())), length(int(text.size())) {}
+    SourceView(QStringView text)
+        : utf16(reinterpret_cast<const char16_t*>(text.data())), length(int(text.size())) {}
+    SourceView(const char* bytes, int size) : utf8(bytes), length(size) {}
+
+    bool isUtf8() const { return utf8 != nullptr; }
+
+    // 1-based column of an offset, counted back to the start of its line
+    int columnOf(int offset) const;
+};
+
+#ifdef COUNT_TOKEN_COPIES
+#include <atomic>
+
+// Benchmark instrumentation (cmake -DCOUNT_TOKEN_COPIES=ON): every copy of a Token
+// goes through this member, so --bench-parser can report copies per parse.
+// Moves are free and not counted.
+struct TokenCopyCounter {
+    static inline std::atomic<long long> copies{0};
+    TokenCopyCounter() = default;
+    TokenCopyCounter(const TokenCopyCounter&) { copies.fetch_add(1, std::memory_order_relaxed); }
+    TokenCopyCounter(TokenCopyCounter&&) = default;
+    TokenCopyCounter& operator=(const TokenCopyCounter&) {
+        copies.fetch_add(1, std::memory_order_relaxed);
+        return *this;
+    }
+    TokenCopyCounter& operator=(TokenCopyCounter&&) = default;
+};
+#endif
+
+// A token does not own its text. It only records where the lexeme lives in the
+// source buffer, so lexing never allocates a string per token.
+// For STRING tokens the span covers the characters between the quotes.
 struct Token {
     TokenType type;
-    QString value;
+    int offset = 0; // Index of the first character in the source buffer
+    int length = 0; // Number of characters (0 for INDENT / DEDENT / EOF)
     int line = 0;
+    SymbolId symbol = 0; // IDENTIFIER only: the interned name (see interner.h)
+#ifdef COUNT_TOKEN_COPIES
+    TokenCopyCounter copies{};
+#endif
+
+    // Raw lexeme as a view into UTF-16 source (no allocation)
+    QStringView text(QStringView source) const { return source.mid(offset, length); }
+
+    // Materialized value: escape sequences resolved, placeholders for synthetic tokens.
+    // UTF-8 lexemes are decoded here, and only here (pure ASCII takes a Latin-1 fast path).
+    QString value(const SourceView& source) const;
 };
 
+// Fixed spelling of an operator token (empty for other types). Operator nodes
+// point at these instead of copying their lexeme.
+QStringView operatorSpelling(TokenType type);
+
 #endif // TOKEN_H
@@ -0,0 +1,68 @@
+#include "token_buffer.h"
+#include <algorithm>
+
+using namespace std;
+
+void TokenBuffer::reserve(int count) {
+    m_kinds.reserve(count);
+    m_offsets.reserve(count);
+    m_lengths.reserve(count);
+    m_symbols.reserve(count);
+}
+
+void TokenBuffer::clear() {
+    m_kinds.clear();
+    m_offsets.clear();
+    m_lengths.clear();
+    m_symbols.clear();
+    m_lines.clear();
+}
+
+int TokenBuffer::line(int index, int* hint) const {
+    if (m_lines.empty()) return 0;
+
+    int run;
+    if (hint && *hint >= 0 && *hint < int(m_lines.size())) {
+        run = *hint;
+        while (run + 1 < int(m_lines.size()) && int(m_lines[run + 1].firstToken) <= index) run++;
+        while (run > 0 && int(m_lines[run].firstToken) > index) run--;
+    } else {
+        auto it = upper_bound(m_lines.begin(), m_lines.end(), uint32_t(index),
+                              [](uint32_t i, const LineRun& r) { return i < r.firstToken; });
+        run = it == m_lines.begin() ? 0 : int(it - m_lines.begin()) - 1;
+    }
+    if (hint) *hint = run;
+    return int(m_lines[run].line);
+}
+
+void TokenBuffer::splice(int first, int last, const TokenBuffer& fresh, int offsetDelta, int lineDelta) {
+    const int oldSize = size();
+    const int tailLine = last < oldSize ? line(last) : 0;
+    const int tokenDelta = fresh.size() - (last - first);
+
+    m_kinds.erase(m_kinds.begin() + first, m_kinds.begin() + last);
+    m_kinds.insert(m_kinds.begin() + first, fresh.m_kinds.begin(), fresh.m_kinds.end());
+    m_offsets.erase(m_offsets.begin() + first, m_offsets.begin() + last);
+    m_offsets.insert(m_offsets.begin() + first, fresh.m_offsets.begin(), fresh.m_offsets.end());
+    m_lengths.erase(m_lengths.begin() + first, m_lengths.begin() + last);
+    m_lengths.insert(m_lengths.begin() + first, fresh.m_lengths.begin(), fresh.m_lengths.end());
+    m_symbols.erase(m_symbols.begin() + first, m_symbols.begin() + last);
+    m_symbols.insert(m_symbols.begin() + first, fresh.m_symbols.begin(), fresh.m_symbols.end());
+    for (size_t i = first + fresh.size(); i < m_offsets.size(); ++i) m_offsets[i] += offsetDelta;
+
+    // Line table: [head runs][fresh runs][tail runs, moved]
+    vector<LineRun> runs;
+    runs.reserve(m_lines.size() + fresh.m_lines.size() + 1);
+    size_t r = 0;
+    for (; r < m_lines.size() && int(m_lines[r].firstToken) < first; ++r) runs.push_back(m_lines[r]);
+    for (const LineRun& run : fresh.m_lines) appendRun(runs, run.firstToken + first, run.line);
+    if (last < oldSize) {
+        appendRun(runs, first + fresh.size(), tailLine + lineDelta);
+        for (; r < m_lines.size(); ++r) {
+            if (int(m_lines[r].firstToken) > last) {
+                appendRun(runs, m_lines[r].firstToken + tokenDelta, m_lines[r].line + lineDelta);
+            }
+        }
+    }
+    m_lines.swap(runs);
+}
@@ -0,0 +1,89 @@
+#ifndef TOKEN_BUFFER_H
+#define TOKEN_BUFFER_H
+
+#include "token.h"
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Leaves new elements uninitialized on resize(), so a buffer can be sized first
+// and then filled by several threads without a serial zeroing pass
+template <typename T>
+struct UninitializedAllocator : allocator<T> {
+    template <typename U> struct rebind { using other = UninitializedAllocator<U>; };
+    UninitializedAllocator() = default;
+    template <typename U> UninitializedAllocator(const UninitializedAllocator<U>&) {}
+    template <typename U> void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+    template <typename U, typename... Args> void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+// All tokens of a script as parallel arrays. The parser's type checks only walk
+// the one-byte kinds; offsets, lengths, symbols and lines are read when a Token is
+// materialized. Lines are stored once per source line that has tokens, since
+// most lines hold several.
+class TokenBuffer {
+public:
+    struct LineRun {
+        uint32_t firstToken; // Index of the first token on this line
+        uint32_t line;
+    };
+
+    void reserve(int count);
+    void clear();
+    void push_back(const Token& token) {
+        appendRun(m_lines, uint32_t(m_kinds.size()), uint32_t(token.line));
+        m_kinds.push_back(uint8_t(token.type));
+        m_offsets.push_back(uint32_t(token.offset));
+        m_lengths.push_back(uint32_t(token.length));
+        m_symbols.push_back(token.symbol);
+    }
+
+    int size() const { return int(m_kinds.size()); }
+    bool empty() const { return m_kinds.empty(); }
+
+    TokenType kind(int index) const { return TokenType(m_kinds[index]); }
+    const uint8_t* kinds() const { return m_kinds.data(); }
+    int offset(int index) const { return int(m_offsets[index]); }
+    int length(int index) const { return int(m_lengths[index]); }
+    SymbolId symbol(int index) const { return m_symbols[index]; }
+
+    // Binary search in the line table. With a hint (the run found last time, for
+    // callers that move through the buffer in order) it walks from there instead.
+    int line(int index, int* hint = nullptr) const;
+
+    Token at(int index, int* lineHint = nullptr) const {
+        return {kind(index), offset(index), length(index), line(index, lineHint), symbol(index)};
+    }
+    Token operator[](int index) const { return at(index); }
+    Token back() const { return at(size() - 1); }
+
+    const vector<LineRun>& lineRuns() const { return m_lines; }
+
+    // Replace tokens [first, last) with 'fresh' (whose lines are already final) and
+    // move everything after them by offsetDelta units and lineDelta lines
+    void splice(int first, int last, const TokenBuffer& fresh, int offsetDelta, int lineDelta);
+
+private:
+    friend class Lexer; // Lexer::tokenize() fills the arrays from several threads
+
+    vector<uint8_t, UninitializedAllocator<uint8_t>> m_kinds;
+    vector<uint32_t, UninitializedAllocator<uint32_t>> m_offsets;
+    vector<uint32_t, UninitializedAllocator<uint32_t>> m_lengths;
+    vector<SymbolId, UninitializedAllocator<SymbolId>> m_symbols;
+    vector<LineRun> m_lines; // Sorted by firstToken, one run per distinct line
+
+    static void appendRun(vector<LineRun>& runs, uint32_t firstToken, uint32_t line) {
+        if (!runs.empty() && runs.back().line == line) return;
+        runs.push_back({firstToken, line});
+    }
+};
+
+static_assert(int(TokenType::EXCEPT) < 256, "Token kinds are stored in one byte");
+
+#endif // TOKEN_BUFFER_H
@@ -0,0 +1,61 @@
+#ifndef TOKEN_SPEC_H
+#define TOKEN_SPEC_H
+
+#include "token.h"
+
+// Token specification for the table-driven lexer (see lexer_dfa.h).
+// Patterns use a small regex subset over code units:
+//   x  \x  .  [a-z_]  [^"\\]  ( | )  *  +  ?
+// '.' and negated classes also match every non-ASCII unit.
+// The longest match wins; on equal length the earlier rule does.
+//
+// Only the layout-free part of the lexer is described here. Indentation, newlines,
+// blanks and comments stay in Lexer::next(), keywords come from keywords.h, and
+// anything no rule starts with (non-ASCII letters, stray characters) is handed
+// back to the hand-written code, which also produces ILLEGAL.
+struct TokenRule {
+    const char* pattern;
+    TokenType type;
+    int trimStart = 0; // Units dropped from the edges of the lexeme (string quotes)
+    int trimEnd = 0;
+};
+
+constexpr TokenRule TOKEN_SPEC[] = {
+    {"[A-Za-z_][A-Za-z0-9_]*", TokenType::IDENTIFIER},
+    {"[0-9]+(\\.[0-9]*)?", TokenType::NUMBER},
+
+    // Strings: escapes keep the next unit, newlines included. An unterminated
+    // string runs to the end of the input.
+    {"\"([^\"\\\\]|\\\\.)*\"", TokenType::STRING, 1, 1},
+    {"\"([^\"\\\\]|\\\\.)*\\\\?", TokenType::STRING, 1, 0},
+    {"'([^'\\\\]|\\\\.)*'", TokenType::STRING, 1, 1},
+    {"'([^'\\\\]|\\\\.)*\\\\?", TokenType::STRING, 1, 0},
+
+    {"==", TokenType::DOUBLE_EQUAL},
+    {"=", TokenType::EQUAL},
+    {"!=", TokenType::NOT_EQUAL},
+    {"!", TokenType::ILLEGAL}, // So a lone '!' is a token and the table never backs up
+    {">=", TokenType::GREATER_EQUAL},
+    {">", TokenType::GREATER},
+    {"<=", TokenType::LESS_EQUAL},
+    {"<", TokenType::LESS},
+    {"\\+", TokenType::PLUS},
+    {"-", TokenType::MINUS},
+    {"\\*\\*", TokenType::DOUBLE_STAR},
+    {"\\*", TokenType::STAR},
+    {"//", TokenType::DOUBLE_SLASH},
+    {"/", TokenType::SLASH},
+    {"%", TokenType::PERCENT},
+    {"\\(", TokenType::LPAREN},
+    {"\\)", TokenType::RPAREN},
+    {"{", TokenType::LBRACE},
+    {"}", TokenType::RBRACE},
+    {":", TokenType::COLON},
+    {",", TokenType::COMMA},
+    {";", TokenType::SEMICOLON},
+    {"\\.", TokenType::DOT},
+};
+
+constexpr int TOKEN_RULE_COUNT = sizeof(TOKEN_SPEC) / sizeof(TOKEN_SPEC[0]);
+
+#endif // TOKEN_SPEC_H
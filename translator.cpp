@@ -1,5 +1,6 @@
 #include "translator.h"
 #include "types.h"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 
@@ -8,16 +9,21 @@ using namespace std;
 Translator::Translator(const SymbolTable& symbolTable) : m_symbol_table(symbolTable) {}
 
 // --- THE FIX: Helper to detect statements that do nothing ---
-bool isUselessStatement(const ASTNode* node) {
-    if (dynamic_cast<const NumberNode*>(node)) return true;     // e.g. "123"
-    if (dynamic_cast<const StringNode*>(node)) return true;     // e.g. "hello"
-    if (dynamic_cast<const NoneNode*>(node)) return true;       // e.g. None
-    if (dynamic_cast<const IdentifierNode*>(node)) return true; // e.g. "x" (variable by itself)
-    // We do NOT filter BinaryOp (math) or FunctionCallNode, as those might have side effects
-    return false;
+bool isUselessStatement(NodeKind kind) {
+    switch (kind) {
+    case NodeKind::NUMBER:     // e.g. "123"
+    case NodeKind::STRING:     // e.g. "hello"
+    case NodeKind::NONE:       // e.g. None
+    case NodeKind::IDENTIFIER: // e.g. "x" (variable by itself)
+        return true;
+    default:
+        // We do NOT filter BinaryOp (math) or FunctionCallNode, as those might have side effects
+        return false;
+    }
 }
 
-QString Translator::translate(const ProgramNode* program) {
+QString Translator::translate(const FlatAst& ast) {
+    m_ast = &ast;
     declaredVariables.clear(); // Reset declarations for a fresh run
     QString result;
 
@@ -38,33 +44,71 @@ QString Translator::translate(const ProgramNode* program) {
     result += "    return (double)a / (double)b;\n";
     result += "}\n\n";
 
+    // Python's // and % round toward negative infinity, C++'s / and % toward zero
+    result += "// Helpers: Python floor division and modulo\n";
+    result += "template <typename T, typename U>\n";
+    result += "auto floor_divide(T a, U b) -> decltype(a / b) {\n";
+    result += "    if (b == 0) throw runtime_error(\"Division by zero error\");\n";
+    result += "    return (decltype(a / b))floor((double)a / (double)b);\n";
+    result += "}\n\n";
+    result += "template <typename T, typename U>\n";
+    result += "auto python_mod(T a, U b) -> decltype(a / b) {\n";
+    result += "    return a - b * floor_divide(a, b);\n";
+    result += "}\n\n";
+
+    // pow() works in doubles, and some runtimes round pow(10, 2) down to 99
+    result += "// Helper: exact integer power, for ** with an int result\n";
+    result += "long long int_power(long long base, long long exponent) {\n";
+    result += "    long long result = 1;\n";
+    result += "    for (; exponent > 0; exponent >>= 1) {\n";
+    result += "        if (exponent & 1) result *= base;\n";
+    result += "        if (exponent > 1) base *= base;\n";
+    result += "    }\n";
+    result += "    return result;\n";
+    result += "}\n\n";
+
     QString functionsCode;
     QString mainBodyCode;
+    m_written_functions.clear();
+    m_forward_calls.clear();
+    vector<pair<SymbolId, QString>> heads; // Of the top-level functions, in order
 
     // 3. Separate Functions from Main Script
-    for (const auto& stmt : program->statements) {
+    const FlatAst::Node& program = ast[ast.root()];
+    for (uint32_t i = 0; i < program.count; ++i) {
+        const uint32_t stmt = ast.child(ast.root(), i);
         // --- APPLY THE FIX ---
         // Skip statements that don't do anything
-        if (isUselessStatement(stmt.get())) {
+        if (isUselessStatement(ast[stmt].kind)) {
             continue;
         }
 
-        if (dynamic_cast<const FunctionDefNode*>(stmt.get())) {
-            functionsCode += translateNode(stmt.get()) + "\n";
+        m_out.clear();
+        if (ast[stmt].kind == NodeKind::FUNCTION_DEF) {
+            const SymbolId name = ast[ast.child(stmt, 0)].value;
+            m_written_functions.insert(name);
+            write(stmt);
+            heads.push_back({name, m_out.left(m_out.indexOf(u") {") + 1)});
+            functionsCode += m_out + "\n";
         } else {
-            QString translatedStmt = translateNode(stmt.get());
-
+            write(stmt);
             // Logic to determine if we need a semicolon
             // Blocks (ending in '}') typically don't need one, expressions do.
-            if (!translatedStmt.endsWith("}")) {
-                translatedStmt += ";";
+            if (!m_out.endsWith(QChar('}'))) {
+                m_out += ";";
             }
 
-            mainBodyCode += "    " + translatedStmt + "\n";
+            mainBodyCode += "    " + m_out + "\n";
         }
     }
 
-    // 4. Assemble Final Output
+    // 4. Assemble Final Output. The analyzer lets a function call one defined
+    // further down, which C++ wants declared first.
+    QString prototypes;
+    for (const pair<SymbolId, QString>& head : heads) {
+        if (m_forward_calls.contains(head.first)) prototypes += head.second + ";\n";
+    }
+    if (!prototypes.isEmpty()) result += prototypes + "\n";
     result += functionsCode;
     result += "int main() {\n";
     result += mainBodyCode;
@@ -74,219 +118,301 @@ QString Translator::translate(const ProgramNode* program) {
     return result;
 }
 
-QString Translator::translateNode(const ASTNode* node) {
-    if (!node) return "";
+void Translator::write(uint32_t node) {
+    m_items.clear();
+    m_items.push_back({Item::NODE, node, {}, 0});
+
+    while (!m_items.empty()) {
+        const Item item = m_items.back();
+        m_items.pop_back();
+        const size_t top = m_items.size();
+
+        switch (item.kind) {
+        case Item::NODE:
+            enter(item.node);
+            break;
+        case Item::BLOCK:
+            enterBlock(item.node);
+            break;
+        case Item::TEXT:
+            m_out += item.text;
+            break;
+        case Item::STATEMENT_END:
+            // If it's a block-ender (if/while/try), no semicolon needed
+            m_out += m_out.endsWith(QChar('}')) ? "\n" : ";\n";
+            break;
+        case Item::STEP:
+        case Item::ITERABLE:
+            then(Item::NODE, item.node);
+            then(item.kind == Item::STEP ? Item::STEP_END : Item::ITERABLE_END, FlatAst::NONE, int(m_out.size()));
+            break;
+        case Item::STEP_END:
+            // Logic to handle ++ vs +=
+            if (QStringView(m_out).mid(item.mark) == u"1") {
+                m_out.chop(1);
+                m_out += "++";
+            } else {
+                m_out.insert(item.mark, u" += ");
+            }
+            break;
+        case Item::ITERABLE_END:
+            // Safety wrapper for string literals to ensure iterators work
+            if (item.mark < m_out.size() && m_out[item.mark] == QChar('"')) {
+                m_out.insert(item.mark, u"string(");
+                m_out += ")";
+            }
+            break;
+        case Item::LEAVE_FUNCTION:
+            // Restore Scope
+            declaredVariables = std::move(m_saved_declarations.back());
+            m_saved_declarations.pop_back();
+            break;
+        }
+
+        // Pieces were scheduled in reading order; flip them to come off the stack that way
+        reverse(m_items.begin() + top, m_items.end());
+    }
+}
+
+void Translator::enter(uint32_t node) {
+    if (node == FlatAst::NONE) return;
+    const FlatAst& ast = *m_ast;
+    const FlatAst::Node& n = ast[node];
 
+    switch (n.kind) {
     // --- ASSIGNMENT ---
-    if (auto p = dynamic_cast<const AssignmentNode*>(node)) {
-        QString varName = p->identifier->token.value;
-        QString expressionStr = translateNode(p->expression.get());
-        QString typeStr = DataTypeToString(p->expression->determined_type);
+    case NodeKind::ASSIGNMENT: {
+        const uint32_t identifier = ast.child(node, 0), expression = ast.child(node, 1);
+        const QString& varName = ast.name(identifier);
 
         // Check if variable is already declared in C++ scope
-        if (!declaredVariables.contains(varName)) {
-            declaredVariables.insert(varName);
-            return QString("%1 %2 = %3").arg(typeStr, varName, expressionStr);
+        if (!declaredVariables.contains(ast[identifier].value)) {
+            declaredVariables.insert(ast[identifier].value);
+            m_out += DataTypeToString(ast[expression].determined_type) + " " + varName + " = ";
         } else {
-            return QString("%1 = %2").arg(varName, expressionStr);
+            m_out += varName + " = ";
         }
+        then(Item::NODE, expression);
+        break;
     }
 
     // --- BINARY OPERATIONS ---
-    if (auto p = dynamic_cast<const BinaryOpNode*>(node)) {
-        QString left = translateNode(p->left.get());
-        QString right = translateNode(p->right.get());
-        QString op = p->op.value;
-
-        // Python -> C++ Operator Mapping
-        if (op == "or") op = "||";
-        else if (op == "and") op = "&&";
-
-        // Handle Division safely
-        else if (op == "/") {
-            return QString("safe_divide(%1, %2)").arg(left, right);
+    case NodeKind::BINARY_OP: {
+        const QStringView op = ast.text(node);
+
+        // Handle Division safely, and the operators C++ spells as functions
+        const char* function = op == u"/"  ? "safe_divide"
+                             : op == u"//" ? "floor_divide"
+                             : op == u"%"  ? "python_mod"
+                             : op == u"**" ? (n.determined_type == DataType::INTEGER ? "int_power" : "pow")
+                                           : nullptr;
+        if (function) {
+            m_out += function;
+            m_out += "(";
+            then(Item::NODE, ast.child(node, 0));
+            then(u", ");
+        } else {
+            // Python -> C++ Operator Mapping
+            m_out += "(";
+            then(Item::NODE, ast.child(node, 0));
+            then(u" ");
+            then(op == u"or" ? QStringView(u"||") : op == u"and" ? QStringView(u"&&") : op);
+            then(u" ");
         }
-
-        return QString("(%1 %2 %3)").arg(left, op, right);
+        then(Item::NODE, ast.child(node, 1));
+        then(u")");
+        break;
     }
 
     // --- UNARY OPERATIONS ---
-    if (auto p = dynamic_cast<const UnaryOpNode*>(node)) {
-        QString right = translateNode(p->right.get());
-        QString op = p->op.value;
-        if (op == "not") op = "!";
-        return QString("(%1%2)").arg(op, right);
+    case NodeKind::UNARY_OP: {
+        const QStringView op = ast.text(node);
+        m_out += "(";
+        m_out += op == u"not" ? QStringView(u"!") : op;
+        then(Item::NODE, ast.child(node, 0));
+        then(u")");
+        break;
     }
 
     // --- LITERALS ---
-    if (auto p = dynamic_cast<const IdentifierNode*>(node)) return p->token.value;
-    if (auto p = dynamic_cast<const NumberNode*>(node)) return p->token.value;
-    if (auto p = dynamic_cast<const StringNode*>(node)) return QString("\"%1\"").arg(p->token.value);
-    if (dynamic_cast<const NoneNode*>(node)) return "nullptr";
+    case NodeKind::IDENTIFIER: m_out += ast.name(node); break;
+    case NodeKind::NUMBER:     m_out += ast.text(node); break;
+    case NodeKind::STRING:     m_out += "\""; m_out += ast.text(node); m_out += "\""; break;
+    case NodeKind::NONE:       m_out += "nullptr"; break;
 
     // --- PRINT ---
-    if (auto p = dynamic_cast<const PrintNode*>(node)) {
-        return QString("cout << %1 << endl").arg(translateNode(p->expression.get()));
-    }
+    case NodeKind::PRINT:
+        m_out += "cout << ";
+        then(Item::NODE, ast.child(node, 0));
+        then(u" << endl");
+        break;
 
     // --- RETURN ---
-    if (auto p = dynamic_cast<const ReturnNode*>(node)) {
-        if (p->expression) return "return " + translateNode(p->expression.get());
-        return "return";
-    }
+    case NodeKind::RETURN:
+        if (ast.child(node, 0) != FlatAst::NONE) {
+            m_out += "return ";
+            then(Item::NODE, ast.child(node, 0));
+        } else {
+            m_out += "return";
+        }
+        break;
 
     // --- FUNCTION CALLS ---
-    if (auto p = dynamic_cast<const FunctionCallNode*>(node)) {
-        QString funcName = p->name->token.value;
+    case NodeKind::FUNCTION_CALL: {
+        static const SymbolId toInt = symbolOf("int"), toFloat = symbolOf("float"), toStr = symbolOf("str");
+        const SymbolId funcName = ast[ast.child(node, 0)].value;
+        const uint32_t argCount = n.count - 1; // Slot 0 is the name
 
         // Built-in Casts
-        if (funcName == "int") {
-            if (p->arguments.empty()) return "0";
-            return "(int)(" + translateNode(p->arguments[0].get()) + ")";
-        }
-        if (funcName == "float") {
-            if (p->arguments.empty()) return "0.0";
-            return "(double)(" + translateNode(p->arguments[0].get()) + ")";
-        }
-        if (funcName == "str") {
-            if (p->arguments.empty()) return "\"\"";
-            return "to_string(" + translateNode(p->arguments[0].get()) + ")";
+        const char* cast = funcName == toInt   ? "(int)("
+                         : funcName == toFloat ? "(double)("
+                         : funcName == toStr   ? "to_string("
+                                               : nullptr;
+        if (cast) {
+            if (argCount == 0) {
+                m_out += funcName == toInt ? "0" : funcName == toFloat ? "0.0" : "\"\"";
+            } else {
+                m_out += cast;
+                then(Item::NODE, ast.child(node, 1));
+                then(u")");
+            }
+            break;
         }
         // Standard Call
-        QString args;
-        for (size_t i = 0; i < p->arguments.size(); ++i) {
-            if (i > 0) args += ", ";
-            args += translateNode(p->arguments[i].get());
+        if (!m_saved_declarations.empty() && !m_written_functions.contains(funcName)) {
+            m_forward_calls.insert(funcName); // Inside a def, to one not written yet
+        }
+        m_out += ast.name(ast.child(node, 0)) + "(";
+        for (uint32_t i = 0; i < argCount; ++i) {
+            if (i > 0) then(u", ");
+            then(Item::NODE, ast.child(node, 1 + i));
         }
-        return QString("%1(%2)").arg(funcName, args);
+        then(u")");
+        break;
     }
 
     // --- IF STATEMENT ---
-    if (auto p = dynamic_cast<const IfNode*>(node)) {
-        QString condition = translateNode(p->condition.get());
-        QString body = translateBlock(p->body.get());
-        QString result = QString("if (%1) {\n%2    }").arg(condition, body);
-
-        if (p->else_branch) {
-            if (auto elseIf = dynamic_cast<const IfNode*>(p->else_branch.get())) {
-                result += " else " + translateNode(elseIf);
-            } else if (auto elseBlock = dynamic_cast<const BlockNode*>(p->else_branch.get())) {
-                result += " else {\n" + translateBlock(elseBlock) + "    }";
+    case NodeKind::IF: {
+        m_out += "if (";
+        then(Item::NODE, ast.child(node, 0));
+        then(u") {\n");
+        then(Item::BLOCK, ast.child(node, 1));
+        then(u"    }");
+
+        const uint32_t elseBranch = ast.child(node, 2);
+        if (elseBranch != FlatAst::NONE) {
+            if (ast[elseBranch].kind == NodeKind::IF) {
+                then(u" else ");
+                then(Item::NODE, elseBranch);
+            } else if (ast[elseBranch].kind == NodeKind::BLOCK) {
+                then(u" else {\n");
+                then(Item::BLOCK, elseBranch);
+                then(u"    }");
             }
         }
-        return result;
+        break;
     }
 
     // --- WHILE LOOP ---
-    if (auto p = dynamic_cast<const WhileNode*>(node)) {
-        return QString("while (%1) {\n%2    }")
-        .arg(translateNode(p->condition.get()), translateBlock(p->body.get()));
-    }
+    case NodeKind::WHILE:
+        m_out += "while (";
+        then(Item::NODE, ast.child(node, 0));
+        then(u") {\n");
+        then(Item::BLOCK, ast.child(node, 1));
+        then(u"    }");
+        break;
 
     // --- FOR LOOP ---
-    if (auto p = dynamic_cast<const ForNode*>(node)) {
-        QString iterName = p->iterator->token.value;
-        QString bodyStr = translateBlock(p->body.get());
+    case NodeKind::FOR: {
+        const QString& iterName = ast.name(ast.child(node, 0));
 
-        if (p->isRange) {
+        if (n.isRange) {
             // RANGE MODE: for(int i=0; i<10; i++)
-            QString startStr = translateNode(p->start.get());
-            QString stopStr = translateNode(p->stop.get());
-            QString stepStr = translateNode(p->step.get());
-
-            // Logic to handle ++ vs +=
-            QString stepCode;
-            if (stepStr == "1") stepCode = iterName + "++";
-            else stepCode = iterName + " += " + stepStr;
-
             // Declare iterator inside the loop scope (C++ standard)
-            return QString("for (int %1 = %2; %1 < %3; %4) {\n%5    }")
-                .arg(iterName, startStr, stopStr, stepCode, bodyStr);
+            m_out += "for (int " + iterName + " = ";
+            then(Item::NODE, ast.child(node, 1));
+            then(u"; ");
+            then(iterName);
+            then(u" < ");
+            then(Item::NODE, ast.child(node, 2));
+            then(u"; ");
+            then(iterName);
+            then(Item::STEP, ast.child(node, 3));
         } else {
             // GENERIC MODE: for(auto c : "text")
-            QString iterableStr = translateNode(p->iterable.get());
-
-            // Safety wrapper for string literals to ensure iterators work
-            if (iterableStr.startsWith("\"")) {
-                iterableStr = "string(" + iterableStr + ")";
-            }
-
-            return QString("for (auto %1 : %2) {\n%3    }")
-                .arg(iterName, iterableStr, bodyStr);
+            m_out += "for (auto " + iterName + " : ";
+            then(Item::ITERABLE, ast.child(node, 4));
         }
+        then(u") {\n");
+        then(Item::BLOCK, ast.child(node, 5));
+        then(u"    }");
+        break;
     }
 
     // --- TRY / EXCEPT ---
-    if (auto p = dynamic_cast<const TryExceptNode*>(node)) {
-        QString tryBody = translateBlock(p->try_body.get());
-        QString exceptBody;
-
-        if (p->except_body) {
-            exceptBody = translateBlock(p->except_body.get());
+    case NodeKind::TRY_EXCEPT:
+        // Map 'except' to 'catch (...)' which catches all C++ exceptions
+        m_out += "try {\n";
+        then(Item::BLOCK, ast.child(node, 0));
+        then(u"    } catch (...) {\n");
+        if (ast.child(node, 1) != FlatAst::NONE) {
+            then(Item::BLOCK, ast.child(node, 1));
         } else {
             // Default error message if no except block body provided (though parser usually ensures it)
-            exceptBody = "        cout << \"An error occurred.\" << endl;\n";
+            then(u"        cout << \"An error occurred.\" << endl;\n");
         }
-
-        // Map 'except' to 'catch (...)' which catches all C++ exceptions
-        return QString("try {\n%1    } catch (...) {\n%2    }")
-            .arg(tryBody, exceptBody);
-    }
+        then(u"    }");
+        break;
 
     // --- FUNCTION DEFINITION ---
-    if (auto p = dynamic_cast<const FunctionDefNode*>(node)) {
-        QString funcName = p->name->token.value;
+    case NodeKind::FUNCTION_DEF: {
+        const uint32_t name = ast.child(node, 0);
 
         // Scope Handling: Save global declarations, clear for function, restore after
-        QSet<QString> oldDeclared = declaredVariables;
+        m_saved_declarations.push_back(std::move(declaredVariables));
         declaredVariables.clear();
 
-        // Get return type from Symbol Table
-        Symbol* sym = const_cast<SymbolTable&>(m_symbol_table).lookup(funcName);
-        QString returnType = (sym && sym->functionReturnType != DataType::UNDEFINED)
-                                 ? DataTypeToString(sym->functionReturnType)
-                                 : "void";
+        // Get return type from Symbol Table, through the binding the analyzer resolved
+        const Symbol* sym = m_symbol_table.symbol(ast[name].binding);
+        m_out += (sym && sym->functionReturnType != DataType::UNDEFINED)
+                     ? DataTypeToString(sym->functionReturnType)
+                     : QString("void");
+        m_out += " " + ast.name(name) + "(";
 
-        // Process Parameters
-        QString params;
-        for (size_t i = 0; i < p->parameters.size(); ++i) {
-            if (i > 0) params += ", ";
+        // Process Parameters (the slots between name and body)
+        for (uint32_t i = 1; i + 1 < n.count; ++i) {
+            if (i > 1) m_out += ", ";
             // Assuming params are Int for simplicity, or could be auto if using C++20 templates
             // For this implementation, we rely on SemanticAnalyzer defaults (usually Int)
-            params += "int " + p->parameters[i]->token.value;
-            declaredVariables.insert(p->parameters[i]->token.value);
+            const uint32_t param = ast.child(node, i);
+            m_out += "int " + ast.name(param);
+            declaredVariables.insert(ast[param].value);
         }
 
-        QString body = translateBlock(p->body.get());
-
-        // Restore Scope
-        declaredVariables = oldDeclared;
-
-        return QString("%1 %2(%3) {\n%4}\n").arg(returnType, funcName, params, body);
+        m_out += ") {\n";
+        then(Item::BLOCK, ast.child(node, n.count - 1));
+        then(u"}\n");
+        then(Item::LEAVE_FUNCTION);
+        break;
     }
 
-    return "";
+    default:
+        break;
+    }
 }
 
-QString Translator::translateBlock(const BlockNode* block) {
-    QString result;
-    QString indent = "        "; // 8 spaces (inside main/func)
+void Translator::enterBlock(uint32_t block) {
+    const FlatAst& ast = *m_ast;
 
-    for (const auto& stmt : block->statements) {
+    for (uint32_t i = 0; i < ast[block].count; ++i) {
+        const uint32_t stmt = ast.child(block, i);
         // --- APPLY THE FIX IN BLOCKS TOO ---
-        if (isUselessStatement(stmt.get())) {
+        if (isUselessStatement(ast[stmt].kind)) {
             continue;
         }
 
-        QString translated = translateNode(stmt.get());
-
-        if (translated.endsWith("}")) {
-            // If it's a block-ender (if/while/try), no semicolon needed
-            result += indent + translated + "\n";
-        } else {
-            // Standard statement needs semicolon
-            result += indent + translated + ";\n";
-        }
+        then(u"        "); // 8 spaces (inside main/func)
+        then(Item::NODE, stmt);
+        then(Item::STATEMENT_END);
     }
-    return result;
 }
@@ -1,19 +1,51 @@
 #ifndef TRANSLATOR_H
 #define TRANSLATOR_H
-#include "ast.h"
+#include "flat_ast.h"
 #include "symbol_table.h"
 #include <QString>
 #include <QSet>
+#include <QStringView>
+#include <vector>
 
 class Translator {
 public:
     Translator(const SymbolTable& symbolTable);
-    QString translate(const ProgramNode* program);
+    QString translate(const FlatAst& ast);
 private:
     const SymbolTable& m_symbol_table;
-    QSet<QString> declaredVariables;
+    const FlatAst* m_ast = nullptr;
+    QSet<SymbolId> declaredVariables; // Interned names (see interner.h)
 
-    QString translateNode(const ASTNode* node);
-    QString translateBlock(const BlockNode* block);
+    // Code is written straight into m_out. Whatever comes after a node's first child
+    // waits on m_items, so nesting costs neither C++ stack nor re-copying the text
+    // of every subtree into its parent's.
+    struct Item {
+        enum Kind {
+            NODE,           // Translate a node
+            BLOCK,          // Translate a block's statements
+            TEXT,           // Write text
+            STATEMENT_END,  // ';' unless the statement ended in '}', then newline
+            STEP,           // For-range step: "++" if it is 1, else " += step"
+            STEP_END,
+            ITERABLE,       // For iterable: wrapped in string() if it is a literal
+            ITERABLE_END,
+            LEAVE_FUNCTION, // Restore the declarations saved on entering a def
+        };
+        Kind kind;
+        uint32_t node;
+        QStringView text;
+        int mark; // Output position the *_END items look back to
+    };
+    vector<Item> m_items;
+    vector<QSet<SymbolId>> m_saved_declarations;
+    QSet<SymbolId> m_written_functions; // Top-level defs, from the one being written on
+    QSet<SymbolId> m_forward_calls;     // Names called in a def before their own def was written
+    QString m_out;
+
+    void write(uint32_t node);      // Appends the translation of node to m_out
+    void enter(uint32_t node);      // Writes up to node's first child and schedules the rest
+    void enterBlock(uint32_t block);
+    void then(Item::Kind kind, uint32_t node = FlatAst::NONE, int mark = 0) { m_items.push_back({kind, node, {}, mark}); }
+    void then(QStringView text) { m_items.push_back({Item::TEXT, FlatAst::NONE, text, 0}); }
 };
 #endif // TRANSLATOR_H